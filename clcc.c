@@ -1,13 +1,30 @@
+#define _GNU_SOURCE                                 // For mremap, memmem, and memrchr
+
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include <ctype.h>
 #include <errno.h>
+#include <math.h>
 #include <string.h>
 #include <sysexits.h>
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <argp.h>
 #include <CL/opencl.h>
@@ -18,6 +35,10 @@
 
 
 //---------------------------------------------------------------------------------------------------------------//
+typedef struct MemoryHeader_ MemoryHeader;
+typedef struct ArenaBlock_ ArenaBlock;
+typedef struct Arena_ Arena;
+
 typedef struct Vector_ Vector;
 typedef struct MVector_ MVector;
 
@@ -29,9 +50,14 @@ typedef struct MaybeString_* MaybeString;
 typedef struct MVectorString_ MVectorString;
 typedef struct VectorString_ VectorString;
 
+typedef struct Hash_ Hash;
+
 typedef enum Command_ Command;
+typedef enum StatsFormat_ StatsFormat;
+typedef struct WorkSize_ WorkSize;
 
 typedef enum Settings_CL_ Settings_CL;
+typedef enum Settings_Key_ Settings_Key;
 typedef struct MSettings_ MSettings;
 typedef struct Settings_ Settings;
 
@@ -44,6 +70,85 @@ typedef struct VectorCLDevice_ VectorCLDevice;
 typedef struct VectorCLPartitionProperty_ VectorCLPartitionProperty;
 #endif // CL_VERSION_1_2
 
+typedef struct Build_ Build;
+typedef struct MVectorBuild_ MVectorBuild;
+typedef struct VectorBuild_ VectorBuild;
+
+typedef struct Kernel_ Kernel;
+typedef struct VectorKernel_ VectorKernel;
+typedef struct KernelOccupancy_ KernelOccupancy;
+
+typedef enum RunArgumentType_ RunArgumentType;
+typedef struct RunArgument_ RunArgument;
+typedef struct Run_ Run;
+typedef struct RunVariant_ RunVariant;
+typedef struct VectorRunVariant_ VectorRunVariant;
+typedef struct RunBuilds_ RunBuilds;
+
+typedef enum JobState_ JobState;
+typedef struct Job_ Job;
+typedef struct Workers_ Workers;
+
+typedef struct CacheEntry_ CacheEntry;
+typedef struct Object_ Object;
+
+typedef struct Connection_ Connection;
+
+typedef enum SnapshotProperty_ SnapshotProperty;
+typedef struct SnapshotDevice_ SnapshotDevice;
+typedef struct SnapshotPlatform_ SnapshotPlatform;
+typedef struct Snapshot_ Snapshot;
+
+typedef struct DeviceInfo_ DeviceInfo;
+
+typedef enum StatsPhase_ StatsPhase;
+typedef struct StatsEntry_ StatsEntry;
+typedef struct Stats_ Stats;
+
+typedef struct Trace_ Trace;
+
+typedef struct BenchProgram_ BenchProgram;
+typedef struct BenchHost_ BenchHost;
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Memory (every allocation is preceded by a header saying its size and the arena it is from if it is not the heap)
+struct MemoryHeader_ {
+  size_t size;
+  Arena* arena;
+};
+
+// Largest allocation (so adding the header, rounding it up, and adding an arena block header can't wrap around)
+#define Memory_MAXIMUM (SIZE_MAX - sizeof(MemoryHeader)*2 - sizeof(ArenaBlock))
+
+// Arena (allocations made while it is the thread's current one and all released at once when it is reset)
+//
+// Blocks are used from the front and freeing or expanding the last allocation of the current one is done in place.
+#define Arena_BLOCK 65536
+
+struct ArenaBlock_ {
+  ArenaBlock* next;
+  size_t size;
+  size_t used;
+  size_t last;                                      // Offset of the last allocation (for in place changes)
+};
+
+struct Arena_ {
+  ArenaBlock* blocks;                               // Current block followed by the full ones
+  ArenaBlock* spare;                                // Standard sized blocks kept from a reset for reuse
+};
+
+// Arena the calling thread allocates from (the heap if none)
+static __thread Arena* Arena_current = 0;
+
+// Allocations made and blocks the arenas took from the heap
+static unsigned long long Memory_heapAllocations = 0;
+static unsigned long long Memory_heapBytes = 0;
+static unsigned long long Memory_arenaAllocations = 0;
+static unsigned long long Memory_arenaBytes = 0;
+static unsigned long long Memory_arenaBlocks = 0;
+static unsigned long long Memory_arenaResets = 0;
+
 
 //---------------------------------------------------------------------------------------------------------------//
 // Vector (all instances are just type specialized)
@@ -60,7 +165,7 @@ struct Vector_ {
 };
 
 
-// String (no terminating 0)
+// String (no terminating 0, allocation implied by number as block size doubled until it fits)
 #define MString_BLOCK 16
 
 struct MString_ {
@@ -89,11 +194,40 @@ struct VectorString_ {
   const String* elements;
 };
 
+// Whether String_map maps regular files (watching reads them instead as a file truncated while it is mapped faults)
+static int String_mapFiles = 1;
+
+
+// Hash (SHA-256 state and partially filled block)
+struct Hash_ {
+  uint32_t state[8];
+  uint64_t number;
+  unsigned char block[64];
+};
+
 
 // Types for argp parser
 enum Command_ {
   Command_UNSET = 0,
-  Command_LIST
+  Command_LIST,
+  Command_SERVE,
+  Command_BATCH,
+  Command_BENCH,
+  Command_WATCH
+};
+
+enum StatsFormat_ {
+  StatsFormat_NONE = 0,
+  StatsFormat_TABLE,
+  StatsFormat_JSON
+};
+
+// Global and (if given) local work sizes to run a kernel with
+struct WorkSize_ {
+  cl_uint dimensions;
+  size_t global[3];
+  cl_uint local_dimensions;                         // Zero to leave the local work size to the driver
+  size_t local[3];
 };
 
 struct MSettings_ {
@@ -102,6 +236,38 @@ struct MSettings_ {
   MaybeString platform;
   MaybeString device;
   MVectorString options;
+  size_t jobs;
+  MaybeString binary;
+  MaybeString cache;
+  unsigned long long cache_size;
+  MaybeString socket;
+  int share;
+  int async;
+  MaybeString manifest;
+  MaybeString snapshot;
+  int calls;
+  StatsFormat stats;
+  MaybeString trace;
+  size_t bench;
+  MaybeString baseline;
+  double threshold;
+  int depend;
+  MaybeString depfile;
+  MaybeString target;
+  int changed;
+  int separate;
+  StatsFormat resources;
+  StatsFormat occupancy;
+  int kernels;
+  MaybeString run;
+  WorkSize work;
+  MVectorString args;
+  size_t runs;
+  size_t warmup;
+  int tune;
+  MaybeString tuned;
+  int tune_math;
+  int specialize;
 };
 
 struct Settings_ {
@@ -110,6 +276,38 @@ struct Settings_ {
   MaybeString platform;
   MaybeString device;
   VectorString options;
+  size_t jobs;
+  MaybeString binary;
+  MaybeString cache;
+  unsigned long long cache_size;
+  MaybeString socket;
+  int share;
+  int async;
+  MaybeString manifest;
+  MaybeString snapshot;
+  int calls;
+  StatsFormat stats;
+  MaybeString trace;
+  size_t bench;
+  MaybeString baseline;
+  double threshold;
+  int depend;
+  MaybeString depfile;
+  MaybeString target;
+  int changed;
+  int separate;
+  StatsFormat resources;
+  StatsFormat occupancy;
+  int kernels;
+  MaybeString run;
+  WorkSize work;
+  VectorString args;
+  size_t runs;
+  size_t warmup;
+  int tune;
+  MaybeString tuned;
+  int tune_math;
+  int specialize;
 };
 
 
@@ -137,6 +335,352 @@ struct VectorCLPartitionProperty_ {
 #endif // CL_VERSION_1_2
 
 
+// Resources a kernel of a built program takes on a device
+struct Kernel_ {
+  String name;
+  size_t work_group_size;                           // Largest work group it can be enqueued with
+  size_t work_group_multiple;                       // Preferred multiple of the work group size
+  cl_ulong local_memory;
+  cl_ulong private_memory;                          // Per work item (register spills show up here)
+};
+
+struct VectorKernel_ {
+  size_t number;
+  Kernel* elements;
+};
+
+// Estimate of how many work groups of a kernel a compute unit holds at once
+//
+// Compute units are taken to hold as many work items as the largest work group the device allows unless the kernel's
+// own limit is lower (which drivers lower for kernels using many registers).  Groups are the given local work size
+// or else the kernel's limit.
+struct KernelOccupancy_ {
+  size_t group;                                     // Work group size the estimate is for
+  size_t groups;                                    // Work groups per compute unit (zero if one does not fit)
+  double occupancy;                                 // Fraction of the work items a compute unit could hold
+  const char* limit;                                // What holds the groups back ("local memory", "registers",
+                                                    // "group size" if it doesn't divide what is left, or why a
+                                                    // group doesn't fit: "work item sizes" or "work group size")
+};
+
+// Occupancy below which kernels are flagged
+#define KernelOccupancy_LOW 0.5
+
+
+// Kernel argument to run with as given on the command line
+enum RunArgumentType_ {
+  RunArgumentType_BUFFER,                           // Buffer of size bytes (random unless filled with value)
+  RunArgumentType_LOCAL,                            // Local memory of size bytes
+  RunArgumentType_SCALAR                            // Value of size bytes
+};
+
+struct RunArgument_ {
+  RunArgumentType type;
+  size_t size;
+  int fill;                                         // Buffer filled with the first four bytes of value
+  unsigned char value[8];
+};
+
+// Device times of the timed runs of the kernel (zero runs if it was not run)
+struct Run_ {
+  size_t runs;
+  long long minimum;                                // Nanoseconds
+  long long median;
+  long long maximum;
+  long long enqueue;                                // Mean host time taken by clEnqueueNDRangeKernel
+  WorkSize work;                                    // Work sizes it was run with
+};
+
+// Largest local work size candidate in each dimension (powers of two up to the largest work group of any device)
+#define Run_CANDIDATES 32
+
+// Run of the kernel built with a combination of math options (errors are against the strict build's buffers and
+// not a number if unknown)
+struct RunVariant_ {
+  String options;                                   // Math options separated by spaces (empty for strict)
+  cl_int status;
+  Run run;
+  double ulp;                                       // Largest error of a float in units in the last place
+  double relative;                                  // Largest relative error of a float
+};
+
+struct VectorRunVariant_ {
+  size_t number;
+  RunVariant* elements;
+};
+
+// Builds of the variants in progress with the driver (pending is guarded by the mutex)
+struct RunBuilds_ {
+  pthread_mutex_t mutex;
+  pthread_cond_t built;
+  size_t pending;
+  cl_platform_id platform_id;
+  cl_device_id device_id;
+  long long started;
+};
+
+
+// Build of the program for a single device (status, log, binary, and, if wanted, kernels and run times are filled in
+// by Job_end)
+struct Build_ {
+  cl_platform_id platform_id;
+  cl_device_id device_id;
+  cl_context context;                               // Job_begin uses a temporary one if zero
+  String platform_name;
+  String device_name;
+  cl_int status;
+  String log;
+  String binary;
+  VectorKernel kernels;
+  Run run;
+  VectorRunVariant variants;                        // Math option variants if tuning them
+};
+
+#define MVectorBuild_BLOCK 16
+
+struct MVectorBuild_ {
+  size_t number;
+  Build* elements;
+};
+
+struct VectorBuild_ {
+  size_t number;
+  const Build* elements;
+};
+
+
+// Group of builds done with one program (state is guarded by the workers mutex as the driver may change it)
+enum JobState_ {
+  JobState_WAITING,
+  JobState_BUILDING,
+  JobState_BUILT,
+  JobState_DONE
+};
+
+struct Job_ {
+  Build* builds;
+  size_t builds_number;
+  String* keys;                                     // Cache keys (empty if not caching)
+  int* cached;                                      // Builds filled in from the cache
+  cl_context context;                               // Temporary if the builds do not have one
+  cl_program program;                               // Zero if nothing needed building
+  JobState state;
+  Workers* workers;
+  long long started;                                // Clock when the build was started (for statistics)
+  VectorString codes;                               // Code being built (set by Job_begin)
+  VectorString options;                             // Options of the builds (with the device's definitions if
+                                                    // specializing)
+};
+
+
+// Pool of threads running jobs or a single thread keeping them in progress with the driver (next is the index of
+// the next job to start and reported the index of the first job not yet reported)
+struct Workers_ {
+  pthread_mutex_t mutex;
+  pthread_cond_t built;
+  size_t next;
+  size_t reported;
+  size_t jobs_number;
+  Job* jobs;
+  int report;
+  size_t failures;
+  VectorString codes;
+  const Settings* settings;
+};
+
+
+// Server connection (targets are shared by all connections and hold long lived contexts)
+struct Connection_ {
+  int socket;
+  VectorBuild targets;
+  const Settings* settings;
+};
+
+
+// Cache entry file details (for trimming least recently used)
+struct CacheEntry_ {
+  String name;
+  struct timespec time;
+  off_t size;
+};
+
+// Object compiled from a single source for a device kept for the life of the program (slot names the source, options,
+// and device so an object for a changed source replaces the one from before)
+struct Object_ {
+  String slot;
+  String key;
+  cl_int status;
+  String log;
+  String binary;
+  Object* next;
+};
+
+// All objects kept so far (guarded by mutex)
+static Object* Object_list = 0;
+static pthread_mutex_t Object_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+// Snapshot of the platforms and devices with the raw value of every device property in the table
+//
+// Pointers to its platforms and devices stand in for the driver's ids when it is the one in use.
+enum SnapshotProperty_ {
+#define CL_DEVICE_PROPERTY(ID, IDENT, TYPE, GROUP, DESC) \
+  SnapshotProperty##IDENT,
+#include "cldeviceprop.h"
+#undef CL_DEVICE_PROPERTY
+
+  SnapshotProperty_NUMBER
+};
+
+static const cl_device_info SnapshotProperty_ids[] = {
+#define CL_DEVICE_PROPERTY(ID, IDENT, TYPE, GROUP, DESC) \
+  ID,
+#include "cldeviceprop.h"
+#undef CL_DEVICE_PROPERTY
+};
+
+struct SnapshotDevice_ {
+  const SnapshotPlatform* platform;
+  cl_int statuses[SnapshotProperty_NUMBER];         // What the driver returned for each property
+  String values[SnapshotProperty_NUMBER];
+};
+
+struct SnapshotPlatform_ {
+  String name;
+  size_t devices_number;
+  SnapshotDevice* devices;
+};
+
+struct Snapshot_ {
+  String name;                                      // File it is kept in (if it is in use)
+  size_t platforms_number;
+  SnapshotPlatform* platforms;
+};
+
+// Snapshot the CL routines answer from instead of the driver (if any)
+static const Snapshot* Snapshot_current = 0;
+
+
+// Device properties memoized per device (each is filled in from the driver the first time it is asked for)
+struct DeviceInfo_ {
+  cl_device_id device_id;
+  DeviceInfo* next;
+
+#define CL_DEVICE_PROPERTY(ID, IDENT, TYPE, GROUP, DESC) \
+  int known##IDENT;                                 /* Whether it is filled in */ \
+  unsigned int calls##IDENT;                        /* Driver calls it took (zero if the snapshot answered) */ \
+  TYPE IDENT;
+#include "cldeviceprop.h"
+#undef CL_DEVICE_PROPERTY
+};
+
+// All devices asked about so far (guarded by mutex) and the driver calls for properties made and saved
+//
+// Calls are also counted per thread so a query can tell how many driver calls it took itself.
+static DeviceInfo* DeviceInfo_list = 0;
+static pthread_mutex_t DeviceInfo_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long long CL_deviceInfoCalls = 0;
+static unsigned long long CL_deviceInfoSaved = 0;
+static __thread unsigned int CL_deviceInfoThreadCalls = 0;
+
+
+// Statistics of the time spent in each phase per platform and device (zero ids if not for a particular one)
+enum StatsPhase_ {
+  StatsPhase_LOAD,                                  // First platform query (when the ICD loader loads the drivers)
+  StatsPhase_PLATFORMS,
+  StatsPhase_DEVICES,
+  StatsPhase_CONTEXT,
+  StatsPhase_PROGRAM,
+  StatsPhase_BUILD,
+  StatsPhase_RUN,
+  StatsPhase_FILE,
+
+  StatsPhase_NUMBER
+};
+
+static const char* const StatsPhase_names[] = {
+  "ICD load", "Platform query", "Device query", "Context create", "Program create", "Build", "Run",
+  "File read"
+};
+
+struct StatsEntry_ {
+  StatsPhase phase;
+  cl_platform_id platform_id;
+  cl_device_id device_id;
+  String platform_name;
+  String device_name;
+  unsigned long long count;
+  long long total;                                  // Nanoseconds
+  long long max;
+};
+
+#define Stats_BLOCK 16
+
+struct Stats_ {
+  pthread_mutex_t mutex;
+  StatsFormat format;
+  long long start;
+  int loaded;
+  size_t entries_number;
+  StatsEntry* entries;
+};
+
+// Statistics being gathered (if any)
+static Stats* Stats_current = 0;
+
+
+// Trace events of the OpenCL calls (JSON array in the Chrome trace event format written to name on exit)
+struct Trace_ {
+  pthread_mutex_t mutex;
+  String name;
+  long long start;
+  MString mevents;
+};
+
+// Trace being recorded (if any)
+static Trace* Trace_current = 0;
+
+
+// Scalar device properties not predefined when specializing (they don't describe the hardware, or change from run to
+// run and would make every build look new to the cache)
+static const cl_device_info Specialize_exclusions[] = {
+  CL_DEVICE_MAX_CLOCK_FREQUENCY,
+  CL_DEVICE_AVAILABLE,
+  CL_DEVICE_COMPILER_AVAILABLE,
+#ifdef CL_VERSION_1_2
+  CL_DEVICE_LINKER_AVAILABLE,
+  CL_DEVICE_PREFERRED_INTEROP_USER_SYNC,
+  CL_DEVICE_REFERENCE_COUNT,
+#endif // CL_VERSION_1_2
+};
+
+
+// Benchmark program (generated so the corpus is the same everywhere)
+struct BenchProgram_ {
+  const char* name;
+  String (*generate)();
+};
+
+// Benchmark of clcc's own routines (returns nanoseconds for the given number of elements)
+struct BenchHost_ {
+  const char* name;
+  long long (*run)(size_t number);
+};
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Memory routines
+static void* Memory_allocate(size_t size);
+static void* Memory_reallocate(void* pointer, size_t size);
+static void Memory_free(void* pointer);
+
+static Arena* Arena_create();
+static void Arena_free(Arena* arena);
+static Arena* Arena_use(Arena* arena);
+static void Arena_reset(Arena* arena);
+static MemoryHeader* Arena_allocate(Arena* arena, size_t size);
+
 //---------------------------------------------------------------------------------------------------------------//
 // String routines
 
@@ -146,6 +690,8 @@ static void CString_free(const char* cstring);
 
 // Mutable String
 static MString MString_raw(size_t number, char* elements);
+static size_t MString_capacity(size_t number);
+static MString MString_reserve(MString mstring, size_t number);
 static MString MString_empty();
 static MString MString_string(String string);
 static MString MString_cstring(const char* cstring);
@@ -154,6 +700,7 @@ static String MString_freeze(MString string);
 static MString MString_push(MString mstring0, char element);
 static MString MString_append(MString mstring0, String string1);
 static MString MString_cappend(MString mstring0, const char* cstring1);
+static MString MString_appendJSON(MString mstring0, String string1);
 
 // String
 static String String_raw(size_t number, const char* elements);
@@ -171,10 +718,15 @@ static VectorString String_split(String deliminator, String source);
 static VectorString String_csplit(const char* deliminator, String source);
 
 static String String_file(String name);
+static String String_map(String name);
+static void String_unmap(String string);
+static void String_fileWrite(String name, String contents);
 
 int String_compare(String string0, String string1);
 int String_ccompare(String string0, const char* cstring1);
 
+static int String_blank(String string);
+
 // Maybe String
 static MaybeString MaybeString_raw(String string);
 static MaybeString MaybeString_string(String string);
@@ -191,16 +743,31 @@ static MaybeString MaybeString_cappend(MaybeString maybe0, const char* cstring1)
 
 // Mutable Vector String
 static MVectorString MVectorString_raw(size_t number, String* elements);
+static size_t MVectorString_capacity(size_t number);
+static MVectorString MVectorString_reserve(MVectorString mvector, size_t number);
 static MVectorString MVectorString_empty();
 static VectorString MVectorString_freeze(MVectorString vector);
 
 static MVectorString MVectorString_push(MVectorString mvector, String string);
+static MVectorString MVectorString_pushRaw(MVectorString mvector, String string);
 static MVectorString MVectorString_cpush(MVectorString mvector, const char* cstring);
 static MVectorString MVectorString_append(MVectorString mvector0, VectorString vector1);
 
 // Vector String
 static VectorString VectorString_raw(size_t number, const String* elements);
 static void VectorString_free(VectorString vector);
+static void VectorString_freeViews(VectorString vector);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Hash routines
+static Hash Hash_initial();
+static Hash Hash_block(Hash hash);
+
+static Hash Hash_append(Hash hash, String string);
+static Hash Hash_cappend(Hash hash, const char* cstring);
+static Hash Hash_field(Hash hash, String string);
+
+static String Hash_final(Hash hash);
 
 //---------------------------------------------------------------------------------------------------------------//
 // Error handling routines
@@ -226,6 +793,8 @@ static Settings Settings_initial();
 static void Settings_free(Settings settings);
 
 static error_t Settings_parser(int key, char* arg, struct argp_state* state);
+static int Settings_size(const char* cstring, unsigned long long* size);
+static cl_uint Settings_workSize(const char* cstring, size_t* sizes);
 
 //---------------------------------------------------------------------------------------------------------------//
 // OpenCL routines
@@ -249,6 +818,9 @@ static String CL_platformName(cl_platform_id platform_id);
 
 static VectorCLDevice CL_devicesQuery(cl_platform_id platform_id);
 
+static cl_int CL_deviceInfo(cl_device_id device_id, cl_device_info property,
+                            size_t size, void* value, size_t* size_ret);
+
 static void CL_deviceProperty_Singleton(cl_device_id device_id, cl_device_info property,
                                         void* value, size_t value_size);
 static void CL_deviceProperty_Vector(cl_device_id device_id, cl_device_info property,
@@ -286,12 +858,306 @@ static VectorCLPartitionProperty CL_deviceProperty_VectorPartitionProperty(cl_de
 #include "cldeviceprop.h"
 #undef CL_DEVICE_PROPERTY
 
-static cl_context CL_contextCreate(cl_platform_id platform, cl_device_id device);
+static cl_context CL_contextCreate(cl_platform_id platform, VectorCLDevice devices);
 static void CL_contextFree(cl_context context);
 
-static cl_program CL_programCreate(cl_context context, cl_device_id device,
-                                   VectorString codes, VectorString options);
+static cl_program CL_programCreate(cl_context context, VectorCLDevice devices,
+                                   VectorString codes, VectorString options,
+                                   void (CL_CALLBACK* notify)(cl_program, void*), void* data, cl_int* status);
+static cl_int CL_programStatus(cl_program program, cl_device_id device);
+static String CL_programLog(cl_program program, cl_device_id device);
+static VectorCLDevice CL_programDevices(cl_program program);
+static VectorString CL_programBinaries(cl_program program);
+static String CL_programBinary(cl_program program, cl_device_id device);
+static VectorKernel CL_programKernels(cl_program program, cl_device_id device);
 static void CL_programFree(cl_program program);
+#ifdef CL_VERSION_1_2
+static cl_program CL_programCompile(cl_context context, cl_device_id device,
+                                    VectorString codes, VectorString options);
+static cl_program CL_programObject(cl_context context, cl_device_id device, String binary);
+static cl_program CL_programLink(cl_context context, cl_device_id device, VectorString options,
+                                 const cl_program* objects, size_t objects_number, cl_int* status);
+#endif // CL_VERSION_1_2
+
+//---------------------------------------------------------------------------------------------------------------//
+// Device information routines
+static DeviceInfo* DeviceInfo_get(cl_device_id device_id);
+static void DeviceInfo_free();
+
+#define CL_DEVICE_PROPERTY(ID, IDENT, TYPE, GROUP, DESC) \
+  static TYPE DeviceInfo##IDENT(cl_device_id device_id);
+#include "cldeviceprop.h"
+#undef CL_DEVICE_PROPERTY
+
+//---------------------------------------------------------------------------------------------------------------//
+// Build routines
+static Build Build_raw(cl_platform_id platform_id, String platform_name,
+                       cl_device_id device_id, String device_name);
+static void Build_free(Build build);
+
+static VectorString Build_codes(VectorString sources);
+static void Build_codesFree(VectorString codes);
+static MVectorBuild Build_select(MaybeString platform, MaybeString device);
+static MVectorBuild Build_filter(VectorBuild targets, MaybeString platform, MaybeString device);
+static VectorBuild Build_targets(MaybeString platform, MaybeString device, int share);
+static void Build_targetsFree(VectorBuild targets);
+
+static size_t Build_report(VectorBuild builds, size_t start, size_t end, MaybeString binary);
+static void Build_save(VectorBuild builds, size_t index, String prefix);
+static String Build_binaryName(VectorBuild builds, size_t index, String prefix);
+
+static MVectorBuild MVectorBuild_empty();
+static VectorBuild MVectorBuild_freeze(MVectorBuild mvector);
+static size_t MVectorBuild_capacity(size_t number);
+static MVectorBuild MVectorBuild_reserve(MVectorBuild mvector, size_t number);
+static MVectorBuild MVectorBuild_push(MVectorBuild mvector, Build build);
+
+static void VectorBuild_free(VectorBuild vector);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Kernel routines
+static VectorKernel VectorKernel_raw(size_t number, Kernel* elements);
+static void VectorKernel_free(VectorKernel vector);
+
+static int Kernel_compare(const void* kernel0, const void* kernel1);
+static void Kernel_report(VectorBuild builds, StatsFormat format);
+static KernelOccupancy Kernel_occupancy(cl_device_id device_id, const Kernel* kernel, WorkSize work);
+static void Kernel_reportOccupancy(VectorBuild builds, StatsFormat format, WorkSize work);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Run routines
+static int Run_argument(const char* cstring, RunArgument* argument);
+static Run Run_kernel(cl_context context, cl_program program, cl_device_id device, const Settings* settings,
+                      WorkSize work, String* outputs);
+static Run Run_tune(cl_context context, cl_program program, cl_device_id device, const Settings* settings);
+static void Run_report(VectorBuild builds);
+static void Run_writeTuned(VectorBuild builds, const Settings* settings);
+static MString Run_appendLocal(MString mstring, WorkSize work, const char* separator);
+
+static VectorRunVariant VectorRunVariant_raw(size_t number, RunVariant* elements);
+static void VectorRunVariant_free(VectorRunVariant vector);
+
+static VectorRunVariant Run_tuneMath(cl_context context, cl_platform_id platform_id, cl_device_id device,
+                                     VectorString codes, VectorString options, const Settings* settings);
+static void CL_CALLBACK Run_notify(cl_program program, void* data);
+static void Run_errors(String reference, String outputs, double* ulp, double* relative);
+static void Run_reportMath(VectorBuild builds);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Specialization routines
+static VectorString Specialize_options(VectorString options, cl_device_id device_id);
+static int Specialize_excluded(cl_device_info property);
+static MVectorString Specialize_appendNumber(MVectorString moptions, const char* name, unsigned long long value);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Job routines
+static Job Job_raw(Build* builds, size_t builds_number, Workers* workers);
+static int Job_begin(Job* job, VectorString codes, const Settings* settings,
+                     void (CL_CALLBACK* notify)(cl_program, void*));
+static void Job_end(Job* job, const Settings* settings);
+#ifdef CL_VERSION_1_2
+static void Job_separate(Job* job, VectorString codes, const Settings* settings);
+#endif // CL_VERSION_1_2
+
+static size_t Workers_run(MVectorBuild builds, VectorString codes, const Settings* settings, int report);
+static void* Workers_thread(void* data);
+static void Workers_async(Workers* workers);
+static void CL_CALLBACK Workers_notify(cl_program program, void* data);
+static void Workers_report(Workers* workers);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Cache routines
+static String Cache_key(VectorString codes, VectorString options, Build build);
+static String Cache_name(String directory, String key);
+static void Cache_create(String directory);
+
+static int Cache_load(String directory, String key, Build* build);
+static void Cache_store(String directory, String key, Build build);
+static void Cache_trim(String directory, unsigned long long size);
+static int Cache_compare(const void* entry0, const void* entry1);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Object routines
+#ifdef CL_VERSION_1_2
+static String Object_key(VectorString code, VectorString options, Build build);
+static String Object_slot(VectorString code, VectorString options, Build build);
+static int Object_load(const Settings* settings, String slot, String key, Build* object);
+static void Object_store(const Settings* settings, String slot, String key, Build object);
+static void Object_keep(String slot, String key, Build object);
+#endif // CL_VERSION_1_2
+static void Object_free();
+
+//---------------------------------------------------------------------------------------------------------------//
+// Snapshot routines
+static Snapshot* Snapshot_use(String name);
+static void Snapshot_free(Snapshot* snapshot);
+
+static String Snapshot_fingerprint();
+static Hash Snapshot_hashFile(Hash hash, String name);
+static Snapshot* Snapshot_query();
+static cl_int Snapshot_queryProperty(cl_device_id device_id, size_t property, String* value);
+static Snapshot* Snapshot_load(String name, String fingerprint);
+static void Snapshot_store(String name, String fingerprint, const Snapshot* snapshot);
+
+static MString Snapshot_write(MString mfile, String field);
+static int Snapshot_read(String file, size_t* offset, String* field);
+static int Snapshot_readNumber(String file, size_t* offset, long long* number);
+static int Snapshot_compare(const void* string0, const void* string1);
+
+static const SnapshotPlatform* Snapshot_platform(cl_platform_id platform_id);
+static const SnapshotDevice* Snapshot_device(cl_device_id device_id);
+static int Snapshot_resolve(MVectorBuild builds);
+static void Snapshot_invalidate();
+
+//---------------------------------------------------------------------------------------------------------------//
+// Statistics routines
+static Stats* Stats_use(StatsFormat format);
+static void Stats_exit();
+static void Stats_free(Stats* stats);
+
+static long long Stats_clock();
+static void Stats_record(StatsPhase phase, cl_platform_id platform_id, cl_device_id device_id, long long start);
+static void Stats_recordDevices(StatsPhase phase, VectorCLDevice devices, long long start);
+static void Stats_report(const Stats* stats);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Trace routines
+static Trace* Trace_use(String name);
+static void Trace_exit();
+static void Trace_free(Trace* trace);
+
+static void Trace_event(const char* name, long long start, long long end, MString margs);
+static MString Trace_arg(MString margs, const char* key, String value);
+static MString Trace_argNumber(MString margs, const char* key, long long value);
+static MString Trace_argDevices(MString margs, cl_uint number, const cl_device_id* devices);
+static MString Trace_argSizes(MString margs, const char* key, cl_uint number, const size_t* sizes);
+
+static cl_int Trace_clGetPlatformIDs(cl_uint number, cl_platform_id* platforms, cl_uint* number_ret);
+static cl_int Trace_clGetPlatformInfo(cl_platform_id platform, cl_platform_info property, size_t size, void* value,
+                                      size_t* size_ret);
+static cl_int Trace_clGetDeviceIDs(cl_platform_id platform, cl_device_type type, cl_uint number,
+                                   cl_device_id* devices, cl_uint* number_ret);
+static cl_int Trace_clGetDeviceInfo(cl_device_id device, cl_device_info property, size_t size, void* value,
+                                    size_t* size_ret);
+static cl_context Trace_clCreateContext(const cl_context_properties* properties, cl_uint number,
+                                        const cl_device_id* devices,
+                                        void (CL_CALLBACK* notify)(const char*, const void*, size_t, void*),
+                                        void* data, cl_int* status);
+static cl_int Trace_clReleaseContext(cl_context context);
+static cl_program Trace_clCreateProgramWithSource(cl_context context, cl_uint number, const char** strings,
+                                                  const size_t* lengths, cl_int* status);
+static cl_int Trace_clBuildProgram(cl_program program, cl_uint number, const cl_device_id* devices,
+                                   const char* options, void (CL_CALLBACK* notify)(cl_program, void*), void* data);
+static cl_int Trace_clGetProgramBuildInfo(cl_program program, cl_device_id device, cl_program_build_info property,
+                                          size_t size, void* value, size_t* size_ret);
+static cl_int Trace_clGetProgramInfo(cl_program program, cl_program_info property, size_t size, void* value,
+                                     size_t* size_ret);
+static cl_int Trace_clReleaseProgram(cl_program program);
+static cl_int Trace_clCreateKernelsInProgram(cl_program program, cl_uint number, cl_kernel* kernels,
+                                             cl_uint* number_ret);
+static cl_int Trace_clGetKernelInfo(cl_kernel kernel, cl_kernel_info property, size_t size, void* value,
+                                    size_t* size_ret);
+static cl_int Trace_clGetKernelWorkGroupInfo(cl_kernel kernel, cl_device_id device,
+                                             cl_kernel_work_group_info property, size_t size, void* value,
+                                             size_t* size_ret);
+static cl_int Trace_clReleaseKernel(cl_kernel kernel);
+static cl_kernel Trace_clCreateKernel(cl_program program, const char* name, cl_int* status);
+static cl_int Trace_clSetKernelArg(cl_kernel kernel, cl_uint index, size_t size, const void* value);
+static cl_mem Trace_clCreateBuffer(cl_context context, cl_mem_flags flags, size_t size, void* host, cl_int* status);
+static cl_int Trace_clReleaseMemObject(cl_mem buffer);
+static cl_int Trace_clReleaseCommandQueue(cl_command_queue queue);
+static cl_command_queue Trace_clCreateCommandQueue(cl_context context, cl_device_id device,
+                                                   cl_command_queue_properties properties, cl_int* status);
+static cl_int Trace_clEnqueueNDRangeKernel(cl_command_queue queue, cl_kernel kernel, cl_uint dimensions,
+                                           const size_t* global, const size_t* local, cl_event* event);
+static cl_int Trace_clEnqueueReadBuffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset,
+                                        size_t size, void* data);
+static cl_int Trace_clWaitForEvents(cl_uint number, const cl_event* events);
+static cl_int Trace_clGetEventProfilingInfo(cl_event event, cl_profiling_info property, size_t size, void* value,
+                                            size_t* size_ret);
+static cl_int Trace_clReleaseEvent(cl_event event);
+#ifdef CL_VERSION_1_2
+static cl_program Trace_clCreateProgramWithBinary(cl_context context, cl_uint number, const cl_device_id* devices,
+                                                  const size_t* lengths, const unsigned char** binaries,
+                                                  cl_int* binary_status, cl_int* status);
+static cl_int Trace_clCompileProgram(cl_program program, cl_uint number, const cl_device_id* devices,
+                                     const char* options, cl_uint headers_number, const cl_program* headers,
+                                     const char** header_names, void (CL_CALLBACK* notify)(cl_program, void*),
+                                     void* data);
+static cl_program Trace_clLinkProgram(cl_context context, cl_uint number, const cl_device_id* devices,
+                                      const char* options, cl_uint programs_number, const cl_program* programs,
+                                      void (CL_CALLBACK* notify)(cl_program, void*), void* data, cl_int* status);
+#endif // CL_VERSION_1_2
+
+//---------------------------------------------------------------------------------------------------------------//
+// Message routines
+static int Message_write(int socket, String message);
+static int Message_cwrite(int socket, const char* cmessage);
+static int Message_writeNumber(int socket, long long number);
+static int Message_writeMaybe(int socket, MaybeString maybe);
+static int Message_writeVector(int socket, VectorString vector);
+
+static MaybeString Message_read(int socket);
+static int Message_readNumber(int socket, long long* number);
+static int Message_readMaybe(int socket, MaybeString* maybe);
+static int Message_readVector(int socket, VectorString* vector);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Server routines
+static int Server_connect(String name);
+static VectorString Server_options(VectorString options);
+static VectorBuild Server_compile(String name, VectorString codes, Settings settings);
+static void* Server_thread(void* data);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Batch routines
+static VectorString Batch_words(String line);
+static MaybeString Batch_settings(VectorString words, const char* where, Settings* settings);
+static MaybeString Batch_sources(VectorString sources);
+static size_t Batch_report(VectorBuild builds, Settings job, size_t number, size_t line);
+static void Batch_error(String error, size_t number, size_t line);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Bench routines
+static String Bench_small();
+static String Bench_large();
+static String Bench_macros();
+static String Bench_kernels();
+
+static long long Bench_mstringPush(size_t number);
+static long long Bench_mstringAppend(size_t number);
+static long long Bench_mvectorPush(size_t number);
+static long long Bench_mvectorViews(size_t number);
+static long long Bench_splitCharacter(size_t number);
+static long long Bench_splitString(size_t number);
+static long long Bench_split(size_t number, const char* deliminator);
+
+static long long Bench_build(Build build, VectorString codes, const Settings* settings, const char* program);
+static long long Bench_percentile(long long* times, size_t number, unsigned int percent);
+static int Bench_compare(const void* time0, const void* time1);
+static long long Bench_baseline(VectorString lines, String key, size_t field);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Dependency routines
+static VectorString Dependency_scan(VectorString sources, VectorString options);
+static VectorString Dependency_includes(VectorString codes, VectorString options);
+static MVectorString Dependency_appendIncludes(MVectorString mfiles, String contents, String directory,
+                                               VectorString options);
+static int Dependency_find(String name, const String* directory, VectorString options, String* path);
+static int Dependency_file(String directory, String name, String* path);
+
+static String Dependency_name(Settings settings);
+static String Dependency_key(Settings settings);
+static MString Dependency_appendEscaped(MString mstring, String name);
+
+static void Dependency_write(Settings settings, VectorString files);
+static int Dependency_unchanged(Settings settings);
+
+//---------------------------------------------------------------------------------------------------------------//
+// Watch routines
+static int Watch_open(VectorString files, int* wds);
+static int Watch_wait(int watch, VectorString files, const int* wds, String* file);
+static void Watch_interrupt(int signal);
 
 //---------------------------------------------------------------------------------------------------------------//
 // Action routines
@@ -324,107 +1190,296 @@ static void Print_device_VectorPartitionProperty(unsigned int indent, VectorCLPa
 #include "cldeviceprop.h"
 #undef CL_DEVICE_PROPERTY
 
+static size_t Action_compileStep(Settings settings, const VectorBuild* targets, size_t* builds_number);
 static void Action_compile(Settings settings);
+static void Action_watch(Settings settings);
 static void Action_list(Settings settings);
+static void Action_serve(Settings settings);
+static void Action_batch(Settings settings);
+static void Action_bench(Settings settings);
 
 //---------------------------------------------------------------------------------------------------------------//
-// CStrings (terminating 0)
+// Memory (return zero on failure like the C library routines they stand in for)
 
-// Construction/destruction
-static const char* CString_string(const String string) {
-  char *cstring;
+// Allocate from the current arena (or the heap if there is none)
+static void* Memory_allocate(const size_t size) {
+  MemoryHeader* header;
 
-  if ( (cstring = malloc(sizeof *cstring * (string.number+1) )) == 0 )
-    Error_dieErrno(errno, EX_OSERR, "Unable to duplicate string of length %zd", string.number);
-  memcpy(cstring, string.elements, sizeof *cstring * string.number);
-  cstring[string.number] = 0;
+  if (size > Memory_MAXIMUM) {
+    errno = ENOMEM;
+    return 0;
+  }
 
-  return cstring;
+  if (Arena_current) {
+    if ( (header = Arena_allocate(Arena_current, size)) == 0 )
+      return 0;
+  }
+  else {
+    if ( (header = (MemoryHeader*)malloc(sizeof *header + size)) == 0 )
+      return 0;
+    header->arena = 0;
+    __sync_fetch_and_add(&Memory_heapAllocations, 1);
+    __sync_fetch_and_add(&Memory_heapBytes, size);
+  }
+
+  header->size = size;
+  return header+1;
 }
 
+// Reallocate where it was allocated (arena allocations are moved to the current allocator unless they are the
+// last one of the current arena and it has room)
+static void* Memory_reallocate(void* const pointer, const size_t size) {
+  if (!pointer)
+    return Memory_allocate(size);
+  if (size > Memory_MAXIMUM) {
+    errno = ENOMEM;
+    return 0;
+  }
 
-static void CString_free(const char* const cstring) {
-  free((void*)cstring);
-}
+  MemoryHeader* header = (MemoryHeader*)pointer - 1;
 
+  if (!header->arena) {
+    if ( (header = (MemoryHeader*)realloc(header, sizeof *header + size)) == 0 )
+      return 0;
+    if (size > header->size) {
+      __sync_fetch_and_add(&Memory_heapAllocations, 1);
+      __sync_fetch_and_add(&Memory_heapBytes, size - header->size);
+    }
+    header->size = size;
+    return header+1;
+  }
 
-//---------------------------------------------------------------------------------------------------------------//
-// Mutable String (no terminating 0)
+  if (header->arena == Arena_current) {
+    ArenaBlock* const block = Arena_current->blocks;
 
-// Construct/destruct string
-static MString MString_raw(const size_t number, char* elements) {
-  MString mstring = { number, elements };
-  return mstring;
-}
+    if (block && (char*)header == (char*)(block+1) + block->last) {
+      const size_t used = block->last + (sizeof *header + size + sizeof *header-1)/sizeof *header*sizeof *header;
 
+      if (used <= block->size) {
+        if (size > header->size)
+          __sync_fetch_and_add(&Memory_arenaBytes, size - header->size);
+        block->used = used;
+        header->size = size;
+        return header+1;
+      }
+    }
+  }
 
-static MString MString_empty() {
-  return MString_raw(0, 0);
+  void* const moved = Memory_allocate(size);
+  if (moved)
+    memcpy(moved, pointer, header->size < size ? header->size : size);
+  return moved;
 }
 
+// Free to the heap (arena allocations are only given back if they are the last one of the current arena)
+static void Memory_free(void* const pointer) {
+  if (!pointer)
+    return;
 
-static MString MString_string(const String string) {
-  char* elements;
+  MemoryHeader* const header = (MemoryHeader*)pointer - 1;
 
-  if ( (elements = (char*)malloc(sizeof *elements * (string.number+MString_BLOCK-1) /
-                                 MString_BLOCK * MString_BLOCK)) == 0)
-    Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for MString",
-                   sizeof *elements * (string.number+MString_BLOCK-1)/MString_BLOCK * MString_BLOCK);
-  memcpy(elements, string.elements, sizeof *elements * string.number);
+  if (!header->arena)
+    free(header);
+  else if (header->arena == Arena_current) {
+    ArenaBlock* const block = Arena_current->blocks;
 
-  return MString_raw(string.number, elements);
+    if (block && (char*)header == (char*)(block+1) + block->last)
+      block->used = block->last;
+  }
 }
 
 
-static MString MString_cstring(const char* const cstring) {
-  return MString_string(String_raw(strlen(cstring), cstring));
-}
-
+// Arena lifetime
+static Arena* Arena_create() {
+  Arena* arena;
 
-static String MString_freeze(MString mstring) {
-  // Release extra memory
-  if ( (mstring.elements = (char*)realloc(mstring.elements, sizeof *mstring.elements * mstring.number)) == 0 )
-    Error_dieErrno(errno, EX_OSERR, "Unable to reduce MString allocation to %zd bytes",
-                   sizeof *mstring.elements * mstring.number);
+  if ( (arena = (Arena*)malloc(sizeof *arena)) == 0 )
+    Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for arena", sizeof *arena);
+  arena->blocks = 0;
+  arena->spare = 0;
 
-  return *(String*)&mstring;
+  return arena;
 }
 
+static void Arena_free(Arena* const arena) {
+  Arena_reset(arena);
 
-// Extend string by character/string
-static MString MString_push(MString mstring, const char element) {
-  // Expand allocation by block size if required
-  if (mstring.number % MString_BLOCK == 0)
-    if ( (mstring.elements = (char*)realloc(mstring.elements,
-                                            sizeof *mstring.elements * (mstring.number+MString_BLOCK))) == 0 )
-      Error_dieErrno(errno, EX_OSERR, "Unable to expand MString allocation to %zd bytes",
-                     sizeof *mstring.elements * (mstring.number+MString_BLOCK));
+  while (arena->spare) {
+    ArenaBlock* const block = arena->spare;
+    arena->spare = block->next;
+    free(block);
+  }
+  free(arena);
+}
 
-  // Append element
-  mstring.elements[mstring.number] = element;
-  ++mstring.number;
 
-  return mstring;
+// Make arena the one the calling thread allocates from (zero for the heap) returning the previous one
+static Arena* Arena_use(Arena* const arena) {
+  Arena* const previous = Arena_current;
+  Arena_current = arena;
+  return previous;
 }
 
 
-static MString MString_append(MString mstring0, const String string1) {
-  // Expand allocation by multiples of block size if required
-  if ( (mstring0.number+MString_BLOCK-1)/MString_BLOCK <
-       (mstring0.number+string1.number+MString_BLOCK-1)/MString_BLOCK ) {
-    if ( (mstring0.elements = (char*)realloc(mstring0.elements, sizeof *mstring0.elements *
-                                             (mstring0.number+string1.number+MString_BLOCK-1) /
-                                             MString_BLOCK * MString_BLOCK)) == 0 )
-      Error_dieErrno(errno, EX_OSERR, "Unable to expand MString allocation to %zd bytes",
-                     sizeof *mstring0.elements *
-                     (mstring0.number+string1.number+MString_BLOCK-1)/MString_BLOCK * MString_BLOCK);
-  }
+// Release everything allocated from arena (keeping standard sized blocks for reuse)
+static void Arena_reset(Arena* const arena) {
+  while (arena->blocks) {
+    ArenaBlock* const block = arena->blocks;
+    arena->blocks = block->next;
 
-  // Append elements
-  memcpy(&mstring0.elements[mstring0.number], string1.elements, sizeof *mstring0.elements * string1.number);
-  mstring0.number += string1.number;
+    if (block->size == Arena_BLOCK) {
+      block->next = arena->spare;
+      arena->spare = block;
+    }
+    else
+      free(block);
+  }
 
-  return mstring0;
+  __sync_fetch_and_add(&Memory_arenaResets, 1);
+}
+
+
+// Header for size bytes from the arena (rounded up to keep the headers aligned and zero if no block could be had)
+static MemoryHeader* Arena_allocate(Arena* const arena, const size_t size) {
+  const size_t need = (sizeof(MemoryHeader) + size + sizeof(MemoryHeader)-1) /
+    sizeof(MemoryHeader)*sizeof(MemoryHeader);
+  ArenaBlock* block = arena->blocks;
+
+  if (!block || block->size - block->used < need) {
+    // Take a spare block if it is big enough and otherwise a new one just for this if it is big
+    if (arena->spare && need <= Arena_BLOCK) {
+      block = arena->spare;
+      arena->spare = block->next;
+    }
+    else {
+      const size_t block_size = need > Arena_BLOCK ? need : Arena_BLOCK;
+
+      if ( (block = (ArenaBlock*)malloc(sizeof *block + block_size)) == 0 )
+        return 0;
+      block->size = block_size;
+      __sync_fetch_and_add(&Memory_arenaBlocks, 1);
+    }
+
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+
+  MemoryHeader* const header = (MemoryHeader*)((char*)(block+1) + block->used);
+
+  block->last = block->used;
+  block->used += need;
+  header->arena = arena;
+
+  __sync_fetch_and_add(&Memory_arenaAllocations, 1);
+  __sync_fetch_and_add(&Memory_arenaBytes, size);
+
+  return header;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// CStrings (terminating 0)
+
+// Construction/destruction
+static const char* CString_string(const String string) {
+  char *cstring;
+
+  if ( (cstring = Memory_allocate(sizeof *cstring * (string.number+1) )) == 0 )
+    Error_dieErrno(errno, EX_OSERR, "Unable to duplicate string of length %zd", string.number);
+  if (string.number)
+    memcpy(cstring, string.elements, sizeof *cstring * string.number);
+  cstring[string.number] = 0;
+
+  return cstring;
+}
+
+
+static void CString_free(const char* const cstring) {
+  Memory_free((void*)cstring);
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Mutable String (no terminating 0)
+
+// Construct/destruct string
+static MString MString_raw(const size_t number, char* elements) {
+  MString mstring = { number, elements };
+  return mstring;
+}
+
+
+static MString MString_empty() {
+  return MString_raw(0, 0);
+}
+
+
+static MString MString_string(const String string) {
+  return MString_append(MString_empty(), string);
+}
+
+
+static MString MString_cstring(const char* const cstring) {
+  return MString_string(String_raw(strlen(cstring), cstring));
+}
+
+
+static String MString_freeze(MString mstring) {
+  // Spare capacity stays with the allocation (shrinking it would just be another copy)
+  return String_raw(mstring.number, mstring.elements);
+}
+
+
+// Allocation held for number elements (doubling keeps repeated extension amortized constant)
+static size_t MString_capacity(const size_t number) {
+  if (number == 0)
+    return 0;
+  if (number <= MString_BLOCK)
+    return MString_BLOCK;
+
+  // Next power of two (the block size is one) without looping as this is checked on every extension
+  return (size_t)1 << (sizeof(unsigned long long)*8 - __builtin_clzll(number-1));
+}
+
+
+// Ensure room for number elements
+static MString MString_reserve(MString mstring, const size_t number) {
+  const size_t capacity = MString_capacity(number);
+
+  if (MString_capacity(mstring.number) < capacity)
+    if ( (mstring.elements = (char*)Memory_reallocate(mstring.elements, sizeof *mstring.elements * capacity)) == 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to expand MString allocation to %zd bytes",
+                     sizeof *mstring.elements * capacity);
+
+  return mstring;
+}
+
+
+// Extend string by character/string
+static MString MString_push(MString mstring, const char element) {
+  // Allocation is full exactly when number is zero or a power of two past the block size
+  if ( mstring.number == 0 ||
+       (mstring.number >= MString_BLOCK && (mstring.number & (mstring.number-1)) == 0) )
+    mstring = MString_reserve(mstring, mstring.number+1);
+
+  // Append element
+  mstring.elements[mstring.number] = element;
+  ++mstring.number;
+
+  return mstring;
+}
+
+
+static MString MString_append(MString mstring0, const String string1) {
+  mstring0 = MString_reserve(mstring0, mstring0.number+string1.number);
+
+  // Append elements
+  if (string1.number)
+    memcpy(&mstring0.elements[mstring0.number], string1.elements, sizeof *mstring0.elements * string1.number);
+  mstring0.number += string1.number;
+
+  return mstring0;
 }
 
 
@@ -432,6 +1487,33 @@ static MString MString_cappend(MString mstring0, const char* const cstring1) {
   return MString_append(mstring0, String_raw(strlen(cstring1), cstring1));
 }
 
+// Extend string by string quoted as a JSON string
+static MString MString_appendJSON(MString mstring0, const String string1) {
+  mstring0 = MString_push(mstring0, '"');
+
+  for (size_t iterator = 0; iterator < string1.number; ++iterator) {
+    const unsigned char element = string1.elements[iterator];
+
+    switch (element) {
+    case '"':  mstring0 = MString_cappend(mstring0, "\\\""); break;
+    case '\\': mstring0 = MString_cappend(mstring0, "\\\\"); break;
+    case '\n': mstring0 = MString_cappend(mstring0, "\\n"); break;
+    case '\r': mstring0 = MString_cappend(mstring0, "\\r"); break;
+    case '\t': mstring0 = MString_cappend(mstring0, "\\t"); break;
+    default:
+      if (element < 0x20) {
+        char escape[7];
+        snprintf(escape, sizeof escape, "\\u%04x", element);
+        mstring0 = MString_cappend(mstring0, escape);
+      }
+      else
+        mstring0 = MString_push(mstring0, element);
+    }
+  }
+
+  return MString_push(mstring0, '"');
+}
+
 
 //---------------------------------------------------------------------------------------------------------------//
 // String (no terminating 0)
@@ -446,9 +1528,10 @@ static String String_raw(const size_t number, const char* const elements) {
 static String String_string(const String string) {
   char* elements;
 
-  if ( (elements = (char*)malloc(sizeof *elements * string.number)) == 0 )
+  if ( (elements = (char*)Memory_allocate(sizeof *elements * string.number)) == 0 )
     Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for string", sizeof *elements * string.number);
-  memcpy(elements, string.elements, sizeof *elements * string.number);
+  if (string.number)
+    memcpy(elements, string.elements, sizeof *elements * string.number);
 
   return String_raw(string.number, elements);
 }
@@ -460,7 +1543,7 @@ static String String_cstring(const char* const cstring) {
 
 
 static void String_free(const String string) {
-  free((void*)string.elements);
+  Memory_free((void*)string.elements);
 }
 
 
@@ -497,35 +1580,27 @@ static String String_cintercalate(const char* cstring, const VectorString source
 }
 
 
-// Split string
+// Split string (fields are views into source so release with VectorString_freeViews)
 static VectorString String_split(const String deliminator, const String source) {
   MVectorString target = MVectorString_empty();
 
-  size_t source_start = 0;
-  size_t source_iterator = 0;
-  for ( ; source_iterator < source.number; ++source_iterator ) {
-
-    // Compare deliminator to current portion of source
-    size_t deliminator_iterator = 0;
-    for ( ;
-          deliminator_iterator < deliminator.number &&
-            source_iterator+deliminator_iterator < source.number &&
-            ( deliminator.elements[deliminator_iterator] ==
-              source.elements[source_iterator + deliminator_iterator] );
-          ++deliminator_iterator );
-
-    // If they match, add deliminated string to vector and skip over
-    if (deliminator_iterator == deliminator.number) {
-      target = MVectorString_push(target, String_raw(source_iterator-source_start,
-                                                     &source.elements[source_start]));
-      source_iterator += deliminator_iterator;
-      source_start = source_iterator;
+  const char* field = source.elements;
+  const char* const source_end = source.elements + source.number;
+
+  // Single character deliminators scan with memchr and longer ones search with memmem (empty never matches)
+  if (deliminator.number > 0) {
+    const char* match;
+    while ( field < source_end &&
+            (match = deliminator.number == 1 ?
+             (const char*)memchr(field, deliminator.elements[0], source_end-field) :
+             (const char*)memmem(field, source_end-field, deliminator.elements, deliminator.number)) != 0 ) {
+      target = MVectorString_pushRaw(target, String_raw(match-field, field));
+      field = match + deliminator.number;
     }
   }
 
-  target = MVectorString_push(target, String_raw(source_iterator-source_start,
-                                                 &source.elements[source_start]));
-  
+  target = MVectorString_pushRaw(target, String_raw(source_end-field, field));
+
   return MVectorString_freeze(target);
 }
 
@@ -537,6 +1612,7 @@ static VectorString String_csplit(const char* const cdeliminator, const String s
 
 // File as string
 static String String_file(const String name) {
+  const long long start = Stats_clock();
   int file;
   char* buffer;
   size_t buffer_fill;
@@ -557,10 +1633,14 @@ static String String_file(const String name) {
     size_t buffer_size;
     ssize_t buffer_inc;
 
-    // Allocate an initial slurp buffer
+    // Allocate an initial slurp buffer (big enough for all of a regular file so it never has to be expanded)
+    struct stat status;
+
     buffer_fill = 0;
     buffer_size = 4096;
-    if ( (buffer = (char*)malloc(sizeof *buffer * buffer_size*2)) == 0 )
+    if (fstat(file, &status) == 0 && S_ISREG(status.st_mode))
+      buffer_size += status.st_size;
+    if ( (buffer = (char*)Memory_allocate(sizeof *buffer * buffer_size)) == 0 )
       Error_dieErrno(errno, EX_OSERR, "Unable to allocate initial slurp buffer of %zd bytes for \"%.*s\"",
                      sizeof *buffer * buffer_size, (int)name.number, name.elements);
 
@@ -568,7 +1648,7 @@ static String String_file(const String name) {
     do {
       // Maintain minimal buffer size to make kernel call worthwhile
       if (buffer_size - buffer_fill < 4096) {
-        if ( (buffer = (char*)realloc(buffer, sizeof *buffer * buffer_size*2)) == 0 )
+        if ( (buffer = (char*)Memory_reallocate(buffer, sizeof *buffer * buffer_size*2)) == 0 )
           Error_dieErrno(errno, EX_OSERR, "Unable to expand slurp buffer to %zd bytes for \"%.*s\"",
                          sizeof *buffer * buffer_size*2, (int)name.number, name.elements);
         buffer_size *= 2;
@@ -582,7 +1662,7 @@ static String String_file(const String name) {
     } while (buffer_inc > 0);
 
     // Resize slurp buffer to fit exactly
-    buffer = (char*)realloc(buffer, sizeof *buffer * buffer_fill);
+    buffer = (char*)Memory_reallocate(buffer, sizeof *buffer * buffer_fill);
   }
 
   // Close file
@@ -595,10 +1675,149 @@ static String String_file(const String name) {
                      (int)name.number, name.elements);
   }
 
+  Stats_record(StatsPhase_FILE, 0, 0, start);
+
   return String_raw(buffer_fill, buffer);
 }
 
 
+// File mapped into memory ("-" is standard input and anything that cannot be mapped, such as a pipe, or regular files
+// if String_mapFiles is off, is streamed into anonymous memory that is expanded by remapping so nothing is ever
+// copied) to be released with String_unmap
+static String String_map(const String name) {
+  const long long start = Stats_clock();
+  const int input = name.number == 1 && name.elements[0] == '-';
+  int file;
+  char* elements;
+  size_t number;
+
+  // Open the file
+  if (input)
+    file = STDIN_FILENO;
+  else {
+    const char* cname = CString_string(name);
+
+    if ( (file = open(cname, O_RDONLY)) < 0)
+      Error_dieErrno(errno, EX_NOINPUT, "Unable to open \"%.*s\" for mapping",
+                     (int)name.number, name.elements);
+
+    CString_free(cname);
+  }
+
+  // Map regular files as they are
+  struct stat status;
+
+  if (fstat(file, &status) < 0)
+    Error_dieErrno(errno, EX_NOINPUT, "Unable to get status of \"%.*s\" for mapping",
+                   (int)name.number, name.elements);
+
+  if (String_mapFiles && S_ISREG(status.st_mode) && status.st_size > 0 &&
+      (elements = (char*)mmap(0, status.st_size, PROT_READ, MAP_PRIVATE, file, 0)) != MAP_FAILED)
+    number = status.st_size;
+
+  // Stream in everything else doubling the anonymous memory everytime it fills up
+  else {
+    size_t size = 65536;
+    ssize_t increment;
+
+    if ( (elements = (char*)mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) ==
+         MAP_FAILED )
+      Error_dieErrno(errno, EX_OSERR, "Unable to map %zd bytes for reading \"%.*s\"",
+                     size, (int)name.number, name.elements);
+
+    number = 0;
+    do {
+      if (size - number < 4096) {
+        if ( (elements = (char*)mremap(elements, size, size*2, MREMAP_MAYMOVE)) == MAP_FAILED )
+          Error_dieErrno(errno, EX_OSERR, "Unable to expand mapping to %zd bytes for reading \"%.*s\"",
+                         size*2, (int)name.number, name.elements);
+        size *= 2;
+      }
+
+      while ( (increment = read(file, &elements[number], size - number)) < 0 && errno == EINTR );
+      if (increment < 0)
+        Error_dieErrno(errno, EX_OSERR, "Unable to read all of \"%.*s\" into mapping",
+                       (int)name.number, name.elements);
+      number += increment;
+    } while (increment > 0);
+
+    // Release the pages past the end (all of them if there was nothing to read as nothing is returned to unmap)
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t used = (number+page-1)/page*page;
+
+    if (number == 0)
+      munmap(elements, size);
+    else if (used < size)
+      munmap(&elements[used], size - used);
+  }
+
+  // Close file
+  if (!input) {
+    int status;
+
+    while ( (status = close(file)) < 0 && errno == EINTR );
+    if (status < 0)
+      Error_dieErrno(errno, EX_OSERR, "Unable to close \"%.*s\" after mapping",
+                     (int)name.number, name.elements);
+  }
+
+  Stats_record(StatsPhase_FILE, 0, 0, start);
+
+  // Empty files have nothing mapped (but still need a valid pointer for the OpenCL routines)
+  if (number == 0)
+    return String_raw(0, "");
+
+  return String_raw(number, elements);
+}
+
+static void String_unmap(const String string) {
+  if (string.number > 0)
+    munmap((void*)string.elements, string.number);
+}
+
+
+// String as file
+static void String_fileWrite(const String name, const String contents) {
+  int file;
+
+  // Open the file
+  {
+    const char* cname = CString_string(name);
+
+    if ( (file = open(cname, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+      Error_dieErrno(errno, EX_CANTCREAT, "Unable to open \"%.*s\" for writing",
+                     (int)name.number, name.elements);
+
+    CString_free(cname);
+  }
+
+  // Write out everything (may take several calls)
+  {
+    size_t contents_fill = 0;
+    ssize_t contents_inc;
+
+    while (contents_fill < contents.number) {
+      if ( (contents_inc = write(file, &contents.elements[contents_fill], contents.number - contents_fill)) < 0 ) {
+        if (errno == EINTR)
+          continue;
+        Error_dieErrno(errno, EX_IOERR, "Unable to write all of \"%.*s\"", (int)name.number, name.elements);
+      }
+      contents_fill += contents_inc;
+    }
+  }
+
+  // Close file
+  {
+    int status;
+
+    while ( (status = close(file)) < 0 && errno == EINTR );
+    if (status < 0)
+      Error_dieErrno(errno, EX_IOERR, "Unable to close \"%.*s\" after writing",
+                     (int)name.number, name.elements);
+  }
+}
+
+
 // Compare strings
 int String_compare(const String string0, const String string1) {
   if (string0.number > string1.number) {
@@ -619,6 +1838,15 @@ int String_ccompare(const String string0, const char* const cstring1) {
 }
 
 
+// Check for nothing but whitespace
+static int String_blank(const String string) {
+  for (size_t iterator = 0; iterator < string.number; ++iterator)
+    if ( !isspace((unsigned char)string.elements[iterator]) )
+      return 0;
+  return 1;
+}
+
+
 //---------------------------------------------------------------------------------------------------------------//
 // Maybe String
 
@@ -626,7 +1854,7 @@ int String_ccompare(const String string0, const char* const cstring1) {
 static MaybeString MaybeString_raw(const String string) {
   struct MaybeString_* maybe;
 
-  if ( (maybe = (struct MaybeString_*)malloc(sizeof(struct MaybeString_))) == 0 )
+  if ( (maybe = (struct MaybeString_*)Memory_allocate(sizeof(struct MaybeString_))) == 0 )
     Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd for MaybeString", sizeof(struct MaybeString_));
   maybe->value = string;
 
@@ -652,7 +1880,7 @@ static MaybeString MaybeString_nothing() {
 static void MaybeString_free(const MaybeString maybe) {
   if (maybe) {
     String_free(maybe->value);
-    free(maybe);
+    Memory_free(maybe);
   }
 }
 
@@ -712,27 +1940,50 @@ static MVectorString MVectorString_empty() {
 
 
 static VectorString MVectorString_freeze(MVectorString mvector) {
-  // Release extra memory
-  if ( (mvector.elements = (String*)realloc(mvector.elements,
-                                            sizeof *mvector.elements * mvector.number)) == 0 )
-    Error_dieErrno(errno, EX_OSERR, "Unable to reduce MVectorString allocation to %zd bytes",
-                   sizeof *mvector.elements * mvector.number);
+  // Spare capacity stays with the allocation (shrinking it would just be another copy)
+  return VectorString_raw(mvector.number, mvector.elements);
+}
+
+
+// Allocation held for number elements (doubling keeps repeated extension amortized constant)
+static size_t MVectorString_capacity(const size_t number) {
+  if (number == 0)
+    return 0;
+  if (number <= MVectorString_BLOCK)
+    return MVectorString_BLOCK;
 
-  return *(VectorString*)&mvector;
+  // Next power of two (the block size is one) without looping as this is checked on every extension
+  return (size_t)1 << (sizeof(unsigned long long)*8 - __builtin_clzll(number-1));
+}
+
+
+// Ensure room for number elements
+static MVectorString MVectorString_reserve(MVectorString mvector, const size_t number) {
+  const size_t capacity = MVectorString_capacity(number);
+
+  if (MVectorString_capacity(mvector.number) < capacity)
+    if ( (mvector.elements = (String*)Memory_reallocate(mvector.elements, sizeof *mvector.elements * capacity)) == 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to expand MVectorString allocation to %zd bytes",
+                     sizeof *mvector.elements * capacity);
+
+  return mvector;
 }
 
 
 // Extend vector string by string/strings
 static MVectorString MVectorString_push(MVectorString mvector, const String string) {
-  // Expand allocation by block size if required
-  if (mvector.number % MVectorString_BLOCK == 0)
-    if ( (mvector.elements = (String*)realloc(mvector.elements, sizeof *mvector.elements *
-                                              (mvector.number+MVectorString_BLOCK))) == 0 )
-      Error_dieErrno(errno, EX_OSERR, "Unable to expand MVectorString allocation to %zd bytes",
-                     sizeof *mvector.elements * (mvector.number+MVectorString_BLOCK));
+  return MVectorString_pushRaw(mvector, String_string(string));
+}
+
+// Append string itself (vector takes it over instead of a copy)
+static MVectorString MVectorString_pushRaw(MVectorString mvector, const String string) {
+  // Allocation is full exactly when number is zero or a power of two past the block size
+  if ( mvector.number == 0 ||
+       (mvector.number >= MVectorString_BLOCK && (mvector.number & (mvector.number-1)) == 0) )
+    mvector = MVectorString_reserve(mvector, mvector.number+1);
 
   // Append element
-  mvector.elements[mvector.number] = String_string(string);
+  mvector.elements[mvector.number] = string;
   ++mvector.number;
 
   return mvector;
@@ -745,19 +1996,11 @@ static MVectorString MVectorString_cpush(MVectorString mvector, const char* cons
 
 
 static MVectorString MVectorString_append(MVectorString mvector0, const VectorString vector1) {
-  // Expand allocation by multiples of block size if required
-  if ( (mvector0.number+MVectorString_BLOCK-1)/MVectorString_BLOCK 
-       < (mvector0.number+vector1.number+MVectorString_BLOCK-1)/MVectorString_BLOCK ) {
-    if ( (mvector0.elements = (String*)realloc(mvector0.elements, sizeof *mvector0.elements *
-                                               (mvector0.number+vector1.number+MVectorString_BLOCK-1) /
-                                               MVectorString_BLOCK * MVectorString_BLOCK)) == 0 )
-      Error_dieErrno(errno, EX_OSERR, "Unable to expand MVectorString allocation to %zd bytes",
-                     sizeof *mvector0.elements * (mvector0.number+vector1.number+MVectorString_BLOCK-1) /
-                     MVectorString_BLOCK * MVectorString_BLOCK);
-  }
+  mvector0 = MVectorString_reserve(mvector0, mvector0.number+vector1.number);
 
   // Append elements
-  memcpy(&mvector0.elements[mvector0.number], vector1.elements, sizeof *mvector0.elements * vector1.number);
+  if (vector1.number)
+    memcpy(&mvector0.elements[mvector0.number], vector1.elements, sizeof *mvector0.elements * vector1.number);
   mvector0.number += vector1.number;
 
   return mvector0;
@@ -776,7 +2019,148 @@ static VectorString VectorString_raw(const size_t number, const String* const el
 static void VectorString_free(const VectorString vector) {
   for (size_t iterator = 0; iterator < vector.number; ++iterator)
     String_free(vector.elements[iterator]);
-  free((void*)vector.elements);
+  Memory_free((void*)vector.elements);
+}
+
+// Release vector of views (strings are owned elsewhere)
+static void VectorString_freeViews(const VectorString vector) {
+  Memory_free((void*)vector.elements);
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Hash (SHA-256 as per FIPS 180-4)
+static const uint32_t Hash_constants[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define Hash_ROTATE(x, n) (((x) >> (n)) | ((x) << (32-(n))))
+
+
+// Construct hash
+static Hash Hash_initial() {
+  const Hash hash = {
+    { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 },
+    0,
+    { 0 }
+  };
+  return hash;
+}
+
+
+// Mix full block into state
+static Hash Hash_block(Hash hash) {
+  uint32_t schedule[64];
+
+  for (size_t iterator = 0; iterator < 16; ++iterator)
+    schedule[iterator] =
+      (uint32_t)hash.block[iterator*4+0] << 24 | (uint32_t)hash.block[iterator*4+1] << 16 |
+      (uint32_t)hash.block[iterator*4+2] <<  8 | (uint32_t)hash.block[iterator*4+3];
+  for (size_t iterator = 16; iterator < 64; ++iterator) {
+    const uint32_t word0 = schedule[iterator-15];
+    const uint32_t word1 = schedule[iterator-2];
+    schedule[iterator] = schedule[iterator-16] + schedule[iterator-7] +
+      (Hash_ROTATE(word0, 7) ^ Hash_ROTATE(word0, 18) ^ (word0 >> 3)) +
+      (Hash_ROTATE(word1, 17) ^ Hash_ROTATE(word1, 19) ^ (word1 >> 10));
+  }
+
+  uint32_t state[8];
+  memcpy(state, hash.state, sizeof state);
+
+  for (size_t iterator = 0; iterator < 64; ++iterator) {
+    const uint32_t temporary0 = state[7] +
+      (Hash_ROTATE(state[4], 6) ^ Hash_ROTATE(state[4], 11) ^ Hash_ROTATE(state[4], 25)) +
+      ((state[4] & state[5]) ^ (~state[4] & state[6])) + Hash_constants[iterator] + schedule[iterator];
+    const uint32_t temporary1 =
+      (Hash_ROTATE(state[0], 2) ^ Hash_ROTATE(state[0], 13) ^ Hash_ROTATE(state[0], 22)) +
+      ((state[0] & state[1]) ^ (state[0] & state[2]) ^ (state[1] & state[2]));
+
+    memmove(&state[1], &state[0], sizeof *state * 7);
+    state[4] += temporary0;
+    state[0] = temporary0 + temporary1;
+  }
+
+  for (size_t iterator = 0; iterator < 8; ++iterator)
+    hash.state[iterator] += state[iterator];
+
+  return hash;
+}
+
+
+// Extend hash by string
+static Hash Hash_append(Hash hash, const String string) {
+  for (size_t iterator = 0; iterator < string.number; ) {
+    const size_t block_fill = hash.number % sizeof hash.block;
+    const size_t block_inc = string.number - iterator < sizeof hash.block - block_fill ?
+      string.number - iterator : sizeof hash.block - block_fill;
+
+    memcpy(&hash.block[block_fill], &string.elements[iterator], block_inc);
+    hash.number += block_inc;
+    iterator += block_inc;
+
+    if (hash.number % sizeof hash.block == 0)
+      hash = Hash_block(hash);
+  }
+
+  return hash;
+}
+
+
+static Hash Hash_cappend(const Hash hash, const char* const cstring) {
+  return Hash_append(hash, String_raw(strlen(cstring), cstring));
+}
+
+
+// Extend hash by length prefixed string (so consecutive fields can't run together)
+static Hash Hash_field(const Hash hash, const String string) {
+  char length[8];
+
+  for (size_t iterator = 0; iterator < sizeof length; ++iterator)
+    length[iterator] = (char)((uint64_t)string.number >> (8*iterator));
+
+  return Hash_append(Hash_append(hash, String_raw(sizeof length, length)), string);
+}
+
+
+// Finish hash as hexadecimal string
+static String Hash_final(Hash hash) {
+  const uint64_t bits = hash.number * 8;
+
+  // Padding is a one bit, zeros up to the last eight bytes of a block, and then the bit length
+  {
+    const char one = (char)0x80;
+    hash = Hash_append(hash, String_raw(1, &one));
+  }
+  {
+    const char zero = 0;
+    while (hash.number % sizeof hash.block != sizeof hash.block - 8)
+      hash = Hash_append(hash, String_raw(1, &zero));
+  }
+  {
+    char length[8];
+    for (size_t iterator = 0; iterator < sizeof length; ++iterator)
+      length[iterator] = (char)(bits >> (56 - 8*iterator));
+    hash = Hash_append(hash, String_raw(sizeof length, length));
+  }
+
+  // Digest is state in big endian order
+  MString mdigest = MString_empty();
+  {
+    static const char digits[] = "0123456789abcdef";
+
+    for (size_t iterator = 0; iterator < 8; ++iterator)
+      for (int shift = 28; shift >= 0; shift -= 4)
+        mdigest = MString_push(mdigest, digits[(hash.state[iterator] >> shift) & 0xf]);
+  }
+
+  return MString_freeze(mdigest);
 }
 
 
@@ -926,7 +2310,8 @@ static void Error_vdieCL(const cl_int status, const int value, const char* const
 // Command line argp parser data
 static char Settings_doc[] = "Invoke the OpenCL compiler from the command line";
 
-static char Settings_args[] = "-l\nSOURCE";
+static char Settings_args[] =
+  "-l\n--serve=SOCKET\n--batch=MANIFEST\n--bench=RUNS [SOURCE...]\n--watch SOURCE...\nSOURCE";
  
 enum Settings_CL_ {
   Settings_CL_LB = 0x0fff,                          // Has to not overlap with ARGP_KEY_* or ASCII
@@ -947,15 +2332,123 @@ enum Settings_CL_ {
   Settings_CL_UB
 };
 
+enum Settings_Key_ {
+  Settings_KEY_LB = 0x1fff,                         // Has to not overlap with Settings_CL_*
+
+  Settings_KEY_CACHE,
+  Settings_KEY_CACHE_SIZE,
+  Settings_KEY_SERVE,
+  Settings_KEY_CONNECT,
+  Settings_KEY_SHARE_CONTEXT,
+  Settings_KEY_ASYNC,
+  Settings_KEY_BATCH,
+  Settings_KEY_SNAPSHOT,
+  Settings_KEY_PROPERTY_CALLS,
+  Settings_KEY_STATS,
+  Settings_KEY_TRACE,
+  Settings_KEY_BENCH,
+  Settings_KEY_BASELINE,
+  Settings_KEY_THRESHOLD,
+  Settings_KEY_MD,
+  Settings_KEY_MF,
+  Settings_KEY_MT,
+  Settings_KEY_IF_CHANGED,
+  Settings_KEY_WATCH,
+  Settings_KEY_SEPARATE,
+  Settings_KEY_RESOURCES,
+  Settings_KEY_OCCUPANCY,
+  Settings_KEY_RUN,
+  Settings_KEY_GLOBAL,
+  Settings_KEY_LOCAL,
+  Settings_KEY_ARG,
+  Settings_KEY_RUNS,
+  Settings_KEY_WARMUP,
+  Settings_KEY_TUNE,
+  Settings_KEY_TUNED,
+  Settings_KEY_TUNE_MATH,
+  Settings_KEY_SPECIALIZE,
+
+  Settings_KEY_UB
+};
+
 static struct argp_option Settings_options[] = {
   { "list",     'l', 0,             0, "List platforms and devices",         0 },
   { "platform", 'p', "platform",    0, "Only compile against given plaform", 1 },
   { "device",   'd', "device",      0, "Only compile against given device",  1 },
+  { "jobs",     'j', "jobs",        0, "Compile against up to given number of devices at once", 1 },
+
+  { "emit-binary", 'o', "prefix",   0,
+    "Write program binaries to prefix followed by platform-device.bin (platform-device-N.bin for identical devices)",
+    1 },
+  { "share-context", Settings_KEY_SHARE_CONTEXT, 0, 0,
+    "Build for all devices of a platform at once in a shared context", 1 },
+  { "async", Settings_KEY_ASYNC, 0, 0,
+    "Keep up to jobs builds in progress from one thread using completion callbacks", 1 },
+  { "if-changed", Settings_KEY_IF_CHANGED, 0, 0,
+    "Only compile if a file in the dependency file is newer than it or the options differ (implies MD)", 1 },
+  { "separate", Settings_KEY_SEPARATE, 0, 0,
+    "Compile each source on its own and link them (reusing objects of unchanged sources)", 1 },
+
+  { "serve",   Settings_KEY_SERVE,   "socket", 0, "Serve compilation requests on given unix socket", 0 },
+  { "connect", Settings_KEY_CONNECT, "socket", 0, "Have server on given unix socket do compilation", 1 },
+  { "batch",   Settings_KEY_BATCH, "manifest", 0,
+    "Compile each job (line of sources and options) in manifest reporting results as JSON lines", 0 },
+  { "bench",   Settings_KEY_BENCH, "runs", 0,
+    "Time given number of cold and warm builds per device of the built in corpus and of clcc's own string routines "
+    "(or builds of sources if given)", 0 },
+  { "baseline",  Settings_KEY_BASELINE,  "file",    0,
+    "Fail benchmark if slower than the medians in file (written instead if it does not exist)", 0 },
+  { "threshold", Settings_KEY_THRESHOLD, "percent", 0,
+    "Slowdown over the baseline that fails the benchmark (default 10)", 0 },
+  { "watch",   Settings_KEY_WATCH, 0, 0,
+    "Compile again every time a source or a file it includes changes (until interrupted)", 0 },
+
+  { "cache",      Settings_KEY_CACHE,      "dir",  0, "Reuse results of identical earlier builds kept in dir", 1 },
+  { "cache-size", Settings_KEY_CACHE_SIZE, "size", 0,
+    "Remove least recently used cache entries beyond size bytes (suffix K, M, or G)", 1 },
+  { "snapshot",   Settings_KEY_SNAPSHOT,   "file", 0,
+    "Answer platform and device queries from file (regenerated when the drivers change)", 1 },
+  { "property-calls", Settings_KEY_PROPERTY_CALLS, 0, 0,
+    "Report device property driver calls made and saved by remembering them", 1 },
+  { "stats",      Settings_KEY_STATS,      "table|json", OPTION_ARG_OPTIONAL,
+    "Report time spent in each phase per platform and device, CPU time, and peak memory on exit", 1 },
+  { "resources",  Settings_KEY_RESOURCES,  "table|json", OPTION_ARG_OPTIONAL,
+    "Report work group sizes and local and private memory of each kernel per device after building", 1 },
+  { "occupancy",  Settings_KEY_OCCUPANCY,  "table|json", OPTION_ARG_OPTIONAL,
+    "Estimate work groups per compute unit of each kernel per device flagging those held back by local memory "
+    "or registers", 1 },
+
+  { "run",    Settings_KEY_RUN,    "kernel", 0,
+    "Run kernel after building and report device times from profiling events", 1 },
+  { "global", Settings_KEY_GLOBAL, "size[,size[,size]]", 0, "Global work size to run kernel with", 1 },
+  { "local",  Settings_KEY_LOCAL,  "size[,size[,size]]", 0,
+    "Local work size to run kernel with or estimate occupancy for (default is up to the driver)", 1 },
+  { "arg",    Settings_KEY_ARG,    "type:value", 0,
+    "Next kernel argument: buffer:size[:value] (random or filled with the 32 bit int or float value), "
+    "local:size, or int, uint, long, ulong, float, or double:value (sizes take suffix K, M, or G)", 1 },
+  { "runs",   Settings_KEY_RUNS,   "runs", 0, "Timed runs of kernel (default 10)", 1 },
+  { "warmup", Settings_KEY_WARMUP, "runs", 0, "Untimed runs of kernel before the timed ones (default 3)", 1 },
+  { "tune",   Settings_KEY_TUNE,   "kernel", 0,
+    "Run kernel with every fitting power of two local work size and save the fastest per device", 1 },
+  { "tuned",  Settings_KEY_TUNED,  "file", 0,
+    "Save tuned local work sizes to file as JSON if it ends in .json or else as a C header "
+    "(default is kernel.tuned.h)", 1 },
+  { "tune-math", Settings_KEY_TUNE_MATH, "kernel", 0,
+    "Run kernel built with every combination of math options and report speed up and largest error of its "
+    "buffers (as floats) against the strict build", 1 },
+  { "trace",      Settings_KEY_TRACE,      "file", 0,
+    "Write every OpenCL call to file as Chrome trace events on exit", 1 },
 
   { 0,          'D', "name[=defn]", 0, "Predefine name as definition (default defn is 1)",     2 },
   { 0,          'I', "dir...",      0, "Add to list of directories searched for header files", 2 },
   { 0,          'w', 0,             0, "Disable all warnings",                                 2 },
   { 0,          'W', "error",       0, "Make all warnings errors",                             2 },
+  { "MD",       Settings_KEY_MD, 0,     0, "Write make rule of the files the sources include after compiling", 2 },
+  { "MF",       Settings_KEY_MF, "file", 0,
+    "Write make rule to file instead of the first source with its extension replaced by .d", 2 },
+  { "MT",       Settings_KEY_MT, "target", 0, "Target of make rule instead of the dependency file itself", 2 },
+  { "specialize", Settings_KEY_SPECIALIZE, 0, 0,
+    "Predefine CLCC_ macros of the properties and extensions of the device each build is for", 2 },
 
   { "cl-std",             Settings_CL_STD,             "CL1.1|CL1.2", 0,
     "Version of OpenCL language standard to use",       3 },
@@ -997,6 +2490,33 @@ static error_t Settings_parser(int key, char* arg, struct argp_state* state) {
   case ARGP_KEY_NO_ARGS:
     break;
   case ARGP_KEY_END:
+    if (msettings->depend && MaybeString_isNothing(msettings->depfile) && msettings->sources.number > 0 &&
+        String_ccompare(msettings->sources.elements[0], "-") == 0)
+      argp_error(state, "dependency file (-MF) required when first source is standard input");
+    if ((msettings->kernels || MaybeString_isJust(msettings->run)) && MaybeString_isJust(msettings->socket))
+      argp_error(state, "kernels can't be inspected or run for builds done by a server");
+    if (msettings->separate && msettings->command == Command_BENCH)
+      argp_error(state, "separate compiles can't be benchmarked as their objects are kept between runs");
+    if (msettings->specialize && MaybeString_isJust(msettings->socket) && msettings->command != Command_SERVE)
+      argp_error(state, "builds done by a server are only specialized if it is started with --specialize");
+    if (MaybeString_isJust(msettings->run) && msettings->command != Command_UNSET &&
+        msettings->command != Command_WATCH)
+      argp_error(state, "kernels can only be run when compiling");
+    if (MaybeString_isJust(msettings->run) && msettings->work.dimensions == 0)
+      argp_error(state, "global work size (--global) required to run kernel");
+    if (MaybeString_isNothing(msettings->run) && (msettings->work.dimensions != 0 ||
+                                                  (msettings->work.local_dimensions != 0 &&
+                                                   msettings->occupancy == StatsFormat_NONE) ||
+                                                  msettings->args.number != 0))
+      argp_error(state, "work sizes and kernel arguments are only for running a kernel (--run) or, for the local "
+                 "work size, estimating occupancy (--occupancy)");
+    if (msettings->tune && msettings->work.local_dimensions != 0)
+      argp_error(state, "local work size is what is tuned so it can't be given");
+    if (!msettings->tune && MaybeString_isJust(msettings->tuned))
+      argp_error(state, "tuned file is only for tuning a kernel (--tune)");
+    if (msettings->work.dimensions != 0 && msettings->work.local_dimensions != 0 &&
+        msettings->work.local_dimensions != msettings->work.dimensions)
+      argp_error(state, "local work size must have as many dimensions as the global one");
     break;
   case ARGP_KEY_SUCCESS:
     break;
@@ -1025,20 +2545,210 @@ static error_t Settings_parser(int key, char* arg, struct argp_state* state) {
       argp_error(state, "multiple devices specified");
     msettings->device = MaybeString_cstring(arg);
     break;
-
-  case 'D':
-    msettings->options = MVectorString_cpush(msettings->options, "-D");
-    msettings->options = MVectorString_cpush(msettings->options, arg);
+  case 'o':
+    if (MaybeString_isJust(msettings->binary))
+      argp_error(state, "multiple binary prefixes specified");
+    msettings->binary = MaybeString_cstring(arg);
     break;
-  case 'I':
-    msettings->options = MVectorString_cpush(msettings->options, "-I");
-    msettings->options = MVectorString_cpush(msettings->options, arg);
+  case Settings_KEY_SERVE:
+    if (msettings->command != Command_UNSET)
+      argp_error(state, "multiple operations specified");
+    msettings->command = Command_SERVE;
+    __attribute__((fallthrough));                   // Record socket
+  case Settings_KEY_CONNECT:
+    if (MaybeString_isJust(msettings->socket))
+      argp_error(state, "multiple sockets specified");
+    msettings->socket = MaybeString_cstring(arg);
+    break;
+  case Settings_KEY_BATCH:
+    if (msettings->command != Command_UNSET)
+      argp_error(state, "multiple operations specified");
+    msettings->command = Command_BATCH;
+    msettings->manifest = MaybeString_cstring(arg);
     break;
 
-  case 'w':
-    msettings->options = MVectorString_cpush(msettings->options, "-w");
+  case Settings_KEY_SNAPSHOT:
+    if (MaybeString_isJust(msettings->snapshot))
+      argp_error(state, "multiple snapshot files specified");
+    msettings->snapshot = MaybeString_cstring(arg);
     break;
-  case 'W':
+
+  case Settings_KEY_PROPERTY_CALLS:
+    msettings->calls = 1;
+    break;
+  case Settings_KEY_BENCH: {
+    char* end;
+    errno = 0;
+    const unsigned long runs = strtoul(arg, &end, 10);
+    if (msettings->command != Command_UNSET)
+      argp_error(state, "multiple operations specified");
+    if ( errno != 0 || *end != 0 || end == arg || runs < 1 )
+      argp_error(state, "invalid number of benchmark runs specified");
+    msettings->command = Command_BENCH;
+    msettings->bench = runs;
+    break;
+  }
+  case Settings_KEY_WATCH:
+    if (msettings->command != Command_UNSET)
+      argp_error(state, "multiple operations specified");
+    msettings->command = Command_WATCH;
+    break;
+  case Settings_KEY_BASELINE:
+    if (MaybeString_isJust(msettings->baseline))
+      argp_error(state, "multiple baseline files specified");
+    msettings->baseline = MaybeString_cstring(arg);
+    break;
+  case Settings_KEY_THRESHOLD: {
+    char* end;
+    errno = 0;
+    const double threshold = strtod(arg, &end);
+    if ( errno != 0 || *end != 0 || end == arg || threshold < 0 )
+      argp_error(state, "invalid benchmark threshold specified");
+    msettings->threshold = threshold;
+    break;
+  }
+  case Settings_KEY_TRACE:
+    if (MaybeString_isJust(msettings->trace))
+      argp_error(state, "multiple trace files specified");
+    msettings->trace = MaybeString_cstring(arg);
+    break;
+  case Settings_KEY_STATS:
+    if (!arg || strcmp(arg, "table") == 0)
+      msettings->stats = StatsFormat_TABLE;
+    else if (strcmp(arg, "json") == 0)
+      msettings->stats = StatsFormat_JSON;
+    else
+      argp_error(state, "invalid statistics format specified");
+    break;
+  case Settings_KEY_RESOURCES:
+    if (!arg || strcmp(arg, "table") == 0)
+      msettings->resources = StatsFormat_TABLE;
+    else if (strcmp(arg, "json") == 0)
+      msettings->resources = StatsFormat_JSON;
+    else
+      argp_error(state, "invalid kernel resources format specified");
+    msettings->kernels = 1;
+    break;
+  case Settings_KEY_RUN:
+  case Settings_KEY_TUNE:
+  case Settings_KEY_TUNE_MATH:
+    if (MaybeString_isJust(msettings->run))
+      argp_error(state, "multiple kernels to run specified");
+    msettings->run = MaybeString_cstring(arg);
+    msettings->tune = key == Settings_KEY_TUNE;
+    msettings->tune_math = key == Settings_KEY_TUNE_MATH;
+    break;
+  case Settings_KEY_TUNED:
+    if (MaybeString_isJust(msettings->tuned))
+      argp_error(state, "multiple tuned files specified");
+    msettings->tuned = MaybeString_cstring(arg);
+    break;
+  case Settings_KEY_GLOBAL:
+    if ( (msettings->work.dimensions = Settings_workSize(arg, msettings->work.global)) == 0 )
+      argp_error(state, "invalid global work size specified");
+    break;
+  case Settings_KEY_LOCAL:
+    if ( (msettings->work.local_dimensions = Settings_workSize(arg, msettings->work.local)) == 0 )
+      argp_error(state, "invalid local work size specified");
+    break;
+  case Settings_KEY_ARG: {
+    RunArgument argument;
+    if ( Run_argument(arg, &argument) < 0 )
+      argp_error(state, "invalid kernel argument \"%s\" specified", arg);
+    msettings->args = MVectorString_cpush(msettings->args, arg);
+    break;
+  }
+  case Settings_KEY_RUNS:
+  case Settings_KEY_WARMUP: {
+    char* end;
+    errno = 0;
+    const unsigned long runs = strtoul(arg, &end, 10);
+    if ( errno != 0 || *end != 0 || end == arg || (key == Settings_KEY_RUNS && runs < 1) )
+      argp_error(state, "invalid number of kernel runs specified");
+    if (key == Settings_KEY_RUNS)
+      msettings->runs = runs;
+    else
+      msettings->warmup = runs;
+    break;
+  }
+  case Settings_KEY_OCCUPANCY:
+    if (!arg || strcmp(arg, "table") == 0)
+      msettings->occupancy = StatsFormat_TABLE;
+    else if (strcmp(arg, "json") == 0)
+      msettings->occupancy = StatsFormat_JSON;
+    else
+      argp_error(state, "invalid occupancy format specified");
+    msettings->kernels = 1;
+    break;
+
+  case Settings_KEY_MD:
+    msettings->depend = 1;
+    break;
+  case Settings_KEY_MF:
+    if (MaybeString_isJust(msettings->depfile))
+      argp_error(state, "multiple dependency files specified");
+    msettings->depfile = MaybeString_cstring(arg);
+    break;
+  case Settings_KEY_MT:
+    if (MaybeString_isJust(msettings->target))
+      argp_error(state, "multiple dependency targets specified");
+    msettings->target = MaybeString_cstring(arg);
+    break;
+  case Settings_KEY_IF_CHANGED:
+    msettings->depend = 1;
+    msettings->changed = 1;
+    break;
+
+  case Settings_KEY_SEPARATE:
+#ifndef CL_VERSION_1_2
+    argp_error(state, "separate compilation requires OpenCL 1.2");
+#endif // CL_VERSION_1_2
+    msettings->separate = 1;
+    break;
+
+  case Settings_KEY_SHARE_CONTEXT:
+    msettings->share = 1;
+    break;
+  case Settings_KEY_ASYNC:
+    msettings->async = 1;
+    break;
+
+  case Settings_KEY_CACHE:
+    if (MaybeString_isJust(msettings->cache))
+      argp_error(state, "multiple cache directories specified");
+    msettings->cache = MaybeString_cstring(arg);
+    break;
+  case Settings_KEY_CACHE_SIZE:
+    if ( Settings_size(arg, &msettings->cache_size) < 0 )
+      argp_error(state, "invalid cache size specified");
+    break;
+  case 'j': {
+    char* end;
+    errno = 0;
+    const unsigned long jobs = strtoul(arg, &end, 10);
+    if ( errno != 0 || *end != 0 || end == arg || jobs < 1 )
+      argp_error(state, "invalid number of jobs specified");
+    msettings->jobs = jobs;
+    break;
+  }
+
+  case Settings_KEY_SPECIALIZE:
+    msettings->specialize = 1;
+    break;
+
+  case 'D':
+    msettings->options = MVectorString_cpush(msettings->options, "-D");
+    msettings->options = MVectorString_cpush(msettings->options, arg);
+    break;
+  case 'I':
+    msettings->options = MVectorString_cpush(msettings->options, "-I");
+    msettings->options = MVectorString_cpush(msettings->options, arg);
+    break;
+
+  case 'w':
+    msettings->options = MVectorString_cpush(msettings->options, "-w");
+    break;
+  case 'W':
     if ( strcmp(arg, "error") != 0 )
       argp_error(state, "invalid warning mode specified");
     msettings->options = MVectorString_cpush(msettings->options, "-Werror");
@@ -1053,8 +2763,7 @@ static error_t Settings_parser(int key, char* arg, struct argp_state* state) {
       mstring = MString_cappend(mstring, arg);
       string = MString_freeze(mstring);
     }
-    msettings->options = MVectorString_push(msettings->options, string);
-    String_free(string);
+    msettings->options = MVectorString_pushRaw(msettings->options, string);
     break;
   }
   case Settings_CL_KERNEL_ARG_INFO:
@@ -1074,7 +2783,7 @@ static error_t Settings_parser(int key, char* arg, struct argp_state* state) {
     msettings->options = MVectorString_cpush(msettings->options, "-cl-opt-disable");
     break;
   case Settings_CL_MAD_ENABLE:
-    msettings->options = MVectorString_cpush(msettings->options, "-cl-mad-disable");
+    msettings->options = MVectorString_cpush(msettings->options, "-cl-mad-enable");
     break;
   case Settings_CL_NO_SIGNED_ZEROS:
     msettings->options = MVectorString_cpush(msettings->options, "-cl-no-signed-zeros");
@@ -1098,6 +2807,57 @@ static error_t Settings_parser(int key, char* arg, struct argp_state* state) {
 }
 
 
+// Size with optional K, M, or G suffix (returns -1 if invalid)
+static int Settings_size(const char* const cstring, unsigned long long* const size) {
+  char* end;
+  errno = 0;
+  unsigned long long value = strtoull(cstring, &end, 10);
+  if ( errno != 0 || end == cstring || strchr(cstring, '-') )
+    return -1;
+  switch (*end) {                                   // Each suffix falls through to the smaller ones
+  case 'G':
+    if (value > ULLONG_MAX / 1024)
+      return -1;
+    value *= 1024;
+    __attribute__((fallthrough));
+  case 'M':
+    if (value > ULLONG_MAX / 1024)
+      return -1;
+    value *= 1024;
+    __attribute__((fallthrough));
+  case 'K':
+    if (value > ULLONG_MAX / 1024)
+      return -1;
+    value *= 1024;
+    ++end;
+  }
+  if ( *end != 0 )
+    return -1;
+  *size = value;
+  return 0;
+}
+
+// Comma separated work sizes of up to three dimensions (returns the number of dimensions or zero if invalid)
+static cl_uint Settings_workSize(const char* const cstring, size_t* const sizes) {
+  const char* cursor = cstring;
+  cl_uint dimensions = 0;
+
+  for (;;) {
+    char* end;
+    errno = 0;
+    const unsigned long long size = strtoull(cursor, &end, 10);
+    if ( errno != 0 || end == cursor || size < 1 || dimensions == 3 )
+      return 0;
+    sizes[dimensions++] = size;
+    if (*end == 0)
+      return dimensions;
+    if (*end != ',')
+      return 0;
+    cursor = end+1;
+  }
+}
+
+
 // Initialize and free settings
 static MSettings MSettings_initial() {
   MSettings msettings = {
@@ -1105,7 +2865,39 @@ static MSettings MSettings_initial() {
     MVectorString_empty(),
     MaybeString_nothing(),
     MaybeString_nothing(),
-    MVectorString_empty()
+    MVectorString_empty(),
+    1,
+    MaybeString_nothing(),
+    MaybeString_nothing(),
+    0,
+    MaybeString_nothing(),
+    0,
+    0,
+    MaybeString_nothing(),
+    MaybeString_nothing(),
+    0,
+    StatsFormat_NONE,
+    MaybeString_nothing(),
+    0,
+    MaybeString_nothing(),
+    10,
+    0,
+    MaybeString_nothing(),
+    MaybeString_nothing(),
+    0,
+    0,
+    StatsFormat_NONE,
+    StatsFormat_NONE,
+    0,
+    MaybeString_nothing(),
+    { 0, { 0, 0, 0 }, 0, { 0, 0, 0 } },
+    MVectorString_empty(),
+    10,
+    3,
+    0,
+    MaybeString_nothing(),
+    0,
+    0
   };
   return msettings;
 }
@@ -1116,7 +2908,39 @@ static Settings MSettings_freeze(MSettings msettings) {
     MVectorString_freeze(msettings.sources),
     msettings.platform,
     msettings.device,
-    MVectorString_freeze(msettings.options)
+    MVectorString_freeze(msettings.options),
+    msettings.jobs,
+    msettings.binary,
+    msettings.cache,
+    msettings.cache_size,
+    msettings.socket,
+    msettings.share,
+    msettings.async,
+    msettings.manifest,
+    msettings.snapshot,
+    msettings.calls,
+    msettings.stats,
+    msettings.trace,
+    msettings.bench,
+    msettings.baseline,
+    msettings.threshold,
+    msettings.depend,
+    msettings.depfile,
+    msettings.target,
+    msettings.changed,
+    msettings.separate,
+    msettings.resources,
+    msettings.occupancy,
+    msettings.kernels,
+    msettings.run,
+    msettings.work,
+    MVectorString_freeze(msettings.args),
+    msettings.runs,
+    msettings.warmup,
+    msettings.tune,
+    msettings.tuned,
+    msettings.tune_math,
+    msettings.specialize
   };
   return settings;
 }
@@ -1126,6 +2950,18 @@ static void Settings_free(const Settings settings) {
   MaybeString_free(settings.platform);
   MaybeString_free(settings.device);
   VectorString_free(settings.options);
+  MaybeString_free(settings.binary);
+  MaybeString_free(settings.cache);
+  MaybeString_free(settings.socket);
+  MaybeString_free(settings.manifest);
+  MaybeString_free(settings.snapshot);
+  MaybeString_free(settings.trace);
+  MaybeString_free(settings.baseline);
+  MaybeString_free(settings.depfile);
+  MaybeString_free(settings.target);
+  MaybeString_free(settings.run);
+  VectorString_free(settings.args);
+  MaybeString_free(settings.tuned);
 }
 
 
@@ -1138,7 +2974,7 @@ static VectorSize VectorSize_raw(const size_t number, const size_t* const elemen
 }
 
 static void VectorSize_free(const VectorSize vector) {
-  free((void*)vector.elements);
+  Memory_free((void*)vector.elements);
 }
 
 // VList of platforms type
@@ -1148,7 +2984,7 @@ static VectorCLPlatform VectorCLPlatform_raw(const size_t number, const cl_platf
 }
 
 static void VectorCLPlatform_free(const VectorCLPlatform vector) {
-  free((void*)vector.elements);
+  Memory_free((void*)vector.elements);
 }
 
 
@@ -1159,7 +2995,7 @@ static VectorCLDevice VectorCLDevice_raw(const size_t number, const cl_device_id
 }
 
 static void VectorCLDevice_free(const VectorCLDevice vector) {
-  free((void*)vector.elements);
+  Memory_free((void*)vector.elements);
 }
 
 
@@ -1172,7 +3008,7 @@ static VectorCLPartitionProperty VectorCLPartitionProperty_raw(size_t number,
 }
 
 static void VectorCLPartitionProperty_free(VectorCLPartitionProperty vector) {
-  free((void*)vector.elements);
+  Memory_free((void*)vector.elements);
 }
 #endif // CL_VERSION_1_2
 
@@ -1182,15 +3018,29 @@ static VectorCLPlatform CL_platformsQuery() {
   cl_uint number;
   cl_platform_id* elements;
 
+  // Platforms of the snapshot in use stand in for the driver's
+  if (Snapshot_current) {
+    number = Snapshot_current->platforms_number;
+    if ( (elements = (cl_platform_id*)Memory_allocate(sizeof *elements * number)) == 0  && number != 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for platform ids",
+                     sizeof *elements * number);
+    for (size_t iterator = 0; iterator < number; ++iterator)
+      elements[iterator] = (cl_platform_id)&Snapshot_current->platforms[iterator];
+
+    return VectorCLPlatform_raw(number, elements);
+  }
+
   {
+    const long long start = Stats_clock();
     cl_int status;
-    if ( (status = clGetPlatformIDs(0, 0, &number) != CL_SUCCESS) )
+    if ( (status = Trace_clGetPlatformIDs(0, 0, &number)) != CL_SUCCESS )
       Error_dieCL(status, EX_SOFTWARE, "Unable to get number of platform ids");
-    if ( (elements = (cl_platform_id*)malloc(sizeof *elements * number)) == 0  && number != 0 )
+    if ( (elements = (cl_platform_id*)Memory_allocate(sizeof *elements * number)) == 0  && number != 0 )
       Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for platform ids", 
                      sizeof *elements * number);
-    if ( (status = clGetPlatformIDs(number, elements, 0)) != CL_SUCCESS )
+    if ( (status = Trace_clGetPlatformIDs(number, elements, 0)) != CL_SUCCESS )
       Error_dieCL(status, EX_SOFTWARE, "Unable to get platform ids");
+    Stats_record(StatsPhase_PLATFORMS, 0, 0, start);
   }
 
   return VectorCLPlatform_raw(number, elements);
@@ -1201,13 +3051,19 @@ static String CL_platformName(const cl_platform_id platform_id) {
   size_t size_0;
   char* name;
 
+  {
+    const SnapshotPlatform* const platform = Snapshot_platform(platform_id);
+    if (platform)
+      return String_string(platform->name);
+  }
+
   {
     cl_int status;
-    if ( (status = clGetPlatformInfo(platform_id, CL_PLATFORM_NAME, 0, 0, &size_0)) != CL_SUCCESS )
+    if ( (status = Trace_clGetPlatformInfo(platform_id, CL_PLATFORM_NAME, 0, 0, &size_0)) != CL_SUCCESS )
       Error_dieCL(status, EX_SOFTWARE, "Unable to get size of name for platform");
-    if ( (name = (char*)malloc(size_0)) == 0 && size_0 != 0 )
+    if ( (name = (char*)Memory_allocate(size_0)) == 0 && size_0 != 0 )
       Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for name of platform", size_0);
-    if ( (status = clGetPlatformInfo(platform_id, CL_PLATFORM_NAME, size_0, name, 0)) != CL_SUCCESS )
+    if ( (status = Trace_clGetPlatformInfo(platform_id, CL_PLATFORM_NAME, size_0, name, 0)) != CL_SUCCESS )
       Error_dieCL(status, EX_SOFTWARE, "Unable to get name for platform");
   }
 
@@ -1220,33 +3076,93 @@ static VectorCLDevice CL_devicesQuery(const cl_platform_id platform_id) {
   cl_uint number;
   cl_device_id* elements;
 
+  // Devices of the snapshot in use stand in for the driver's
+  {
+    const SnapshotPlatform* const platform = Snapshot_platform(platform_id);
+
+    if (platform) {
+      number = platform->devices_number;
+      if ( (elements = (cl_device_id*)Memory_allocate(sizeof *elements * number)) == 0 && number != 0 )
+        Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for device ids for platform",
+                       sizeof *elements * number);
+      for (size_t iterator = 0; iterator < number; ++iterator)
+        elements[iterator] = (cl_device_id)&platform->devices[iterator];
+
+      return VectorCLDevice_raw(number, elements);
+    }
+  }
+
   {
+    const long long start = Stats_clock();
     cl_int status;
-    if ( (status = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, 0, 0, &number)) != CL_SUCCESS )
+    if ( (status = Trace_clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, 0, 0, &number)) != CL_SUCCESS )
       Error_dieCL(status, EX_SOFTWARE, "Unable to get number of devices for platform");
-    if ( (elements = (cl_device_id*)malloc(sizeof *elements * number)) == 0 && number != 0 )
+    if ( (elements = (cl_device_id*)Memory_allocate(sizeof *elements * number)) == 0 && number != 0 )
       Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for device ids for platform",
                      sizeof *elements * number);
-    if ( (status = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, number, elements, 0)) != CL_SUCCESS )
+    if ( (status = Trace_clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, number, elements, 0)) != CL_SUCCESS )
       Error_dieCL(status, EX_SOFTWARE, "Unable to get device ids for platform");
+    Stats_record(StatsPhase_DEVICES, platform_id, 0, start);
   }
 
   return VectorCLDevice_raw(number, elements);
 }
 
 
+// Device information (from the snapshot in use if it is one of its devices)
+static cl_int CL_deviceInfo(const cl_device_id device_id, const cl_device_info property,
+                            const size_t size, void* const value, size_t* const size_ret) {
+  const SnapshotDevice* const device = Snapshot_device(device_id);
+
+  if (!device) {
+    __sync_fetch_and_add(&CL_deviceInfoCalls, 1);
+    ++CL_deviceInfoThreadCalls;
+    return Trace_clGetDeviceInfo(device_id, property, size, value, size_ret);
+  }
+
+  // Platform is the snapshot one and everything else is as the driver returned it
+  const cl_platform_id platform_id = (cl_platform_id)device->platform;
+  String info = String_raw(sizeof platform_id, (const char*)&platform_id);
+
+  if (property != CL_DEVICE_PLATFORM) {
+    size_t index = 0;
+    while (index < SnapshotProperty_NUMBER && SnapshotProperty_ids[index] != property)
+      ++index;
+
+    if (index == SnapshotProperty_NUMBER)
+      return CL_INVALID_VALUE;
+    if (device->statuses[index] != CL_SUCCESS)
+      return device->statuses[index];
+    info = device->values[index];
+  }
+
+  if (size_ret)
+    *size_ret = info.number;
+  if (value) {
+    if (size < info.number)
+      return CL_INVALID_VALUE;
+    memcpy(value, info.elements, info.number);
+  }
+
+  return CL_SUCCESS;
+}
+
+
 // Device properties
+// Fixed size properties are read straight into the value in one call (saving a size query if the driver answered)
 static void CL_deviceProperty_Singleton(const cl_device_id device_id, const cl_device_info property,
                                         void* const value, const size_t value_size) {
+  const unsigned int calls = CL_deviceInfoThreadCalls;
   cl_int status;
   size_t size;
 
-  if ( (status = clGetDeviceInfo(device_id, property, 0, 0, &size)) != CL_SUCCESS )
-    Error_dieCL(status, EX_SOFTWARE, "Unable to get size of device property");
+  if ( (status = CL_deviceInfo(device_id, property, value_size, value, &size)) != CL_SUCCESS )
+    Error_dieCL(status, EX_SOFTWARE, "Unable to get device property");
   if (size != value_size)
     Error_die(EX_SOFTWARE, "Device property size %zd is not type size %zd", size, value_size);
-  if ( (status = clGetDeviceInfo(device_id, property, size, value, 0)) != CL_SUCCESS )
-    Error_dieCL(status, EX_SOFTWARE, "Unable to get device property");
+
+  if (CL_deviceInfoThreadCalls != calls)
+    __sync_fetch_and_add(&CL_deviceInfoSaved, 1);
 }
 
 static void CL_deviceProperty_Vector(const cl_device_id device_id, const cl_device_info property,
@@ -1255,14 +3171,14 @@ static void CL_deviceProperty_Vector(const cl_device_id device_id, const cl_devi
   cl_int status;
   size_t size;
 
-  if ( (status = clGetDeviceInfo(device_id, property, 0, 0, &size)) != CL_SUCCESS )
+  if ( (status = CL_deviceInfo(device_id, property, 0, 0, &size)) != CL_SUCCESS )
     Error_dieCL(status, EX_SOFTWARE, "Unable to get size of device property");
   if (size % value_size != 0)
     Error_die(EX_SOFTWARE, "Device property size %zd is not a multiple of type size %zd", size, value_size);
   *value_number = size / value_size;
-  if ( (*value = malloc(size)) == 0 )
+  if ( (*value = Memory_allocate(size)) == 0 )
     Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for property", size);
-  if ( (status = clGetDeviceInfo(device_id, property, size, *value, 0)) != CL_SUCCESS )
+  if ( (status = CL_deviceInfo(device_id, property, size, *value, 0)) != CL_SUCCESS )
     Error_dieCL(status, EX_SOFTWARE, "Unable to get device property");
 }
 
@@ -1272,14 +3188,14 @@ static void CL_deviceProperty_Vector0(const cl_device_id device_id, const cl_dev
   cl_int status;
   size_t size_0;
 
-  if ( (status = clGetDeviceInfo(device_id, property, 0, 0, &size_0)) != CL_SUCCESS )
+  if ( (status = CL_deviceInfo(device_id, property, 0, 0, &size_0)) != CL_SUCCESS )
     Error_dieCL(status, EX_SOFTWARE, "Unable to get size of device property");
   if (size_0 % value_size != 0)
     Error_die(EX_SOFTWARE, "Device property size %zd is not a multiple of type size %zd", size_0, value_size);
   *value_number = size_0 / value_size - 1;
-  if ( (*value = malloc(size_0)) == 0 )
+  if ( (*value = Memory_allocate(size_0)) == 0 )
     Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for property", size_0);
-  if ( (status = clGetDeviceInfo(device_id, property, size_0, *value, 0)) != CL_SUCCESS )
+  if ( (status = CL_deviceInfo(device_id, property, size_0, *value, 0)) != CL_SUCCESS )
     Error_dieCL(status, EX_SOFTWARE, "Unable to get device property");
 }
 
@@ -1376,17 +3292,11 @@ static VectorSize CL_deviceProperty_VectorSize(const cl_device_id device_id, int
 }
 
 static VectorString CL_deviceProperty_VectorColon(const cl_device_id device_id, int property) {
-  const String string = CL_deviceProperty_String(device_id, property);
-  const VectorString vector = String_csplit(":", string);
-  String_free(string);
-  return vector;
+  return String_csplit(":", CL_deviceProperty_String(device_id, property));
 }
 
 static VectorString CL_deviceProperty_VectorSpace(const cl_device_id device_id, int property) {
-  const String string = CL_deviceProperty_String(device_id, property);
-  const VectorString vector = String_csplit(" ", string);
-  String_free(string);
-  return vector;
+  return String_csplit(" ", CL_deviceProperty_String(device_id, property));
 }
 
 #ifdef CL_VERSION_1_2
@@ -1407,17 +3317,18 @@ static VectorCLPartitionProperty CL_deviceProperty_VectorPartitionProperty(const
 
 
 // Context
-static cl_context CL_contextCreate(const cl_platform_id platform, const cl_device_id device) {
+static cl_context CL_contextCreate(const cl_platform_id platform, const VectorCLDevice devices) {
   cl_context context;
 
   {
+    const long long start = Stats_clock();
     cl_int status;
     const cl_context_properties context_properties[] =
       { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
-    const cl_device_id devices[] = { device };
-    context = clCreateContext(context_properties, sizeof devices/sizeof *devices, devices, 0, 0, &status);
+    context = Trace_clCreateContext(context_properties, devices.number, devices.elements, 0, 0, &status);
     if (status != CL_SUCCESS)
       Error_dieCL(status, EX_SOFTWARE, "Unable to create context");
+    Stats_recordDevices(StatsPhase_CONTEXT, devices, start);
   }
 
   return context;
@@ -1425,14 +3336,19 @@ static cl_context CL_contextCreate(const cl_platform_id platform, const cl_devic
 
 static void CL_contextFree(const cl_context context) {
   cl_int status;
-  if ( (status = clReleaseContext(context)) != CL_SUCCESS )
+  if ( (status = Trace_clReleaseContext(context)) != CL_SUCCESS )
     Error_dieCL(status, EX_SOFTWARE, "Unable to release context");
 }
 
 
-// Program
-static cl_program CL_programCreate(const cl_context context, const cl_device_id device,
-                                   const VectorString codes, const VectorString options) {
+// Program (returns build status so compilation failures can be reported along with the log and builds the driver
+// refuses to start, such as for invalid options, can be reported as failures by the caller)
+//
+// If notify is given the build is started and, if the status is success, notify is called with data on completion.
+static cl_program CL_programCreate(const cl_context context, const VectorCLDevice devices,
+                                   const VectorString codes, const VectorString options,
+                                   void (CL_CALLBACK* const notify)(cl_program, void*), void* const data,
+                                   cl_int* const status) {
   cl_program program;
 
   // Load program
@@ -1447,12 +3363,14 @@ static cl_program CL_programCreate(const cl_context context, const cl_device_id
     }
 
     // Call OpenCL routine
+    const long long start = Stats_clock();
     cl_int status;
 
-    program = clCreateProgramWithSource(context, sizeof strings/sizeof *strings, strings, strings_length,
-                                        &status);
+    program = Trace_clCreateProgramWithSource(context, sizeof strings/sizeof *strings, strings, strings_length,
+                                              &status);
     if (status != CL_SUCCESS)
       Error_dieCL(status, EX_SOFTWARE, "Unable to create program");
+    Stats_recordDevices(StatsPhase_PROGRAM, devices, start);
   }
 
   // Build program
@@ -1466,34 +3384,12 @@ static cl_program CL_programCreate(const cl_context context, const cl_device_id
       String_free(option);
     }
 
-    // Build device list
-    const cl_device_id devices[] = { device };
+    // Call OpenCL routine (time of builds still in progress is recorded by whoever is notified)
+    const long long start = Stats_clock();
 
-    // Call OpenCL routine
-    cl_int status;
-
-    if ( (status = clBuildProgram(program, sizeof devices/sizeof *devices, devices,
-                                  coption, 0, 0)) != CL_SUCCESS )
-      if (status == CL_BUILD_PROGRAM_FAILURE) {
-        cl_int status;
-        size_t log_size_0;
-        char* log;
-
-        if ( (status = clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG,
-                                             0, 0, &log_size_0)) != CL_SUCCESS )
-          Error_dieCL(status, EX_SOFTWARE, "Unable to get size of program build log");
-        if ( (log = (char*)malloc(log_size_0)) == 0 )
-          Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for program build log", log_size_0);
-        if ( (status = clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG,
-                                             log_size_0, log, 0)) != CL_SUCCESS )
-          Error_dieCL(status, EX_SOFTWARE, "Unable to get program build log");
-
-        Error_die(EX_DATAERR, "Compilation failure:\n%s", log);
-        
-        free(log);
-      }
-      else
-        Error_dieCL(status, EX_SOFTWARE, "Unable to build program");
+    *status = Trace_clBuildProgram(program, devices.number, devices.elements, coption, notify, data);
+    if (!notify || *status != CL_SUCCESS)
+      Stats_recordDevices(StatsPhase_BUILD, devices, start);
 
     CString_free(coption);
   }
@@ -1501,130 +3397,5366 @@ static cl_program CL_programCreate(const cl_context context, const cl_device_id
   return program;
 }
 
-static void CL_programFree(const cl_program program) {
-  cl_int status;
-  if ( (status = clReleaseProgram(program)) != CL_SUCCESS )
-    Error_dieCL(status, EX_SOFTWARE, "Unable to release program");
+// Status of the build for one of the devices
+static cl_int CL_programStatus(const cl_program program, const cl_device_id device) {
+  cl_build_status build_status;
+
+  {
+    cl_int status;
+    if ( (status = Trace_clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_STATUS,
+                                               sizeof build_status, &build_status, 0)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get program build status");
+  }
+
+  return build_status == CL_BUILD_SUCCESS ? CL_SUCCESS : CL_BUILD_PROGRAM_FAILURE;
 }
 
+static String CL_programLog(const cl_program program, const cl_device_id device) {
+  size_t log_size_0;
+  char* log;
 
-//---------------------------------------------------------------------------------------------------------------//
-static void Print_device_DeviceId(const unsigned int indent, const cl_device_id value) {
-  printf("%lu", (unsigned long)value);
+  {
+    cl_int status;
+    if ( (status = Trace_clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG,
+                                               0, 0, &log_size_0)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get size of program build log");
+    if ( (log = (char*)Memory_allocate(log_size_0)) == 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for program build log", log_size_0);
+    if ( (status = Trace_clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG,
+                                               log_size_0, log, 0)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get program build log");
+  }
+
+  return String_raw(log_size_0-1, log);
 }
 
-static void Print_device_PlatformId(const unsigned int indent, const cl_platform_id value) {
-  printf("%lu", (unsigned long)value);
+// Devices associated with the program (all those of its context)
+static VectorCLDevice CL_programDevices(const cl_program program) {
+  size_t size;
+  cl_device_id* elements;
+
+  {
+    cl_int status;
+    if ( (status = Trace_clGetProgramInfo(program, CL_PROGRAM_DEVICES, 0, 0, &size)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get size of program devices");
+    if ( (elements = (cl_device_id*)Memory_allocate(size)) == 0 && size != 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for program devices", size);
+    if ( (status = Trace_clGetProgramInfo(program, CL_PROGRAM_DEVICES, size, elements, 0)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get program devices");
+  }
+
+  return VectorCLDevice_raw(size / sizeof *elements, elements);
 }
 
-static void Print_device_DeviceType(const unsigned int indent, const cl_device_type value) {
-  VectorString values;
+// Binaries are in the order of the program's device list
+static VectorString CL_programBinaries(const cl_program program) {
+  size_t number;
+  size_t* sizes;
+  String* elements;
+
   {
-    MVectorString mvalues = MVectorString_empty();
+    cl_int status;
+    size_t size;
+
+    if ( (status = Trace_clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, 0, 0, &size)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get size of program binary sizes");
+    number = size / sizeof *sizes;
+    if ( (sizes = (size_t*)Memory_allocate(size)) == 0 && size != 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for program binary sizes", size);
+    if ( (status = Trace_clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, size, sizes, 0)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get program binary sizes");
+  }
 
-    if (value & CL_DEVICE_TYPE_CPU)
-      mvalues = MVectorString_push(mvalues, String_cstring("CPU"));
-    if (value & CL_DEVICE_TYPE_GPU)
-      mvalues = MVectorString_push(mvalues, String_cstring("GPU"));
-    if (value & CL_DEVICE_TYPE_GPU)
-      mvalues = MVectorString_push(mvalues, String_cstring("Accelerator"));
-    if (value & CL_DEVICE_TYPE_GPU)
-      mvalues = MVectorString_push(mvalues, String_cstring("Custom"));
+  {
+    cl_int status;
+    unsigned char* binaries[number];
 
-    values = MVectorString_freeze(mvalues);
+    if ( (elements = (String*)Memory_allocate(sizeof *elements * number)) == 0 && number != 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for program binaries",
+                     sizeof *elements * number);
+    for (size_t iterator = 0; iterator < number; ++iterator)
+      if ( (binaries[iterator] = (unsigned char*)Memory_allocate(sizes[iterator])) == 0 && sizes[iterator] != 0 )
+        Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for program binary", sizes[iterator]);
+    if ( (status = Trace_clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof binaries, binaries, 0)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get program binaries");
+    for (size_t iterator = 0; iterator < number; ++iterator)
+      elements[iterator] = String_raw(sizes[iterator], (const char*)binaries[iterator]);
   }
 
-  Print_device_VectorString(indent, values);
-  VectorString_free(values);
-}
+  Memory_free(sizes);
 
-static void Print_device_FPConfig(const unsigned int indent, const cl_device_fp_config value) {
+  return VectorString_raw(number, elements);
 }
 
-static void Print_device_MemCacheType(const unsigned int indent, const cl_device_mem_cache_type value) {
-}
+// Binary for one of the program's devices (empty if it has none)
+static String CL_programBinary(const cl_program program, const cl_device_id device) {
+  const VectorCLDevice devices = CL_programDevices(program);
+  const VectorString binaries = CL_programBinaries(program);
+  String binary = String_raw(0, 0);
 
-static void Print_device_MemLocalType(const unsigned int indent, const cl_device_local_mem_type value) {
-}
+  if (binaries.number != devices.number)
+    Error_die(EX_SOFTWARE, "Expecting %zd program binaries but got %zd", devices.number, binaries.number);
+  for (size_t iterator = 0; iterator < devices.number; ++iterator)
+    if (devices.elements[iterator] == device)
+      binary = String_string(binaries.elements[iterator]);
 
-static void Print_device_ExecCapabilities(const unsigned int indent, const cl_device_exec_capabilities value) {
-}
+  VectorString_free(binaries);
+  VectorCLDevice_free(devices);
 
-static void Print_device_QueueProperties(const unsigned int indent, const cl_command_queue_properties value) {
+  return binary;
 }
 
-#ifdef CL_VERSION_1_2
-static void Print_device_PartitionProperty(const unsigned int indent, const cl_device_partition_property value) {
-}
+// Kernels of the program with the resources they take on the device (ordered by name)
+static VectorKernel CL_programKernels(const cl_program program, const cl_device_id device) {
+  cl_uint number;
+  cl_kernel* kernels;
+  Kernel* elements;
 
-static void Print_device_AffinityDomain(const unsigned int indent, const cl_device_affinity_domain value) {
-}
-#endif // CL_VERSION_1_2
+  {
+    cl_int status;
+    if ( (status = Trace_clCreateKernelsInProgram(program, 0, 0, &number)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get number of program kernels");
+    if ( (kernels = (cl_kernel*)Memory_allocate(sizeof *kernels * number)) == 0 && number != 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for program kernels", sizeof *kernels * number);
+    if ( (elements = (Kernel*)Memory_allocate(sizeof *elements * number)) == 0 && number != 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for kernel resources",
+                     sizeof *elements * number);
+    if ( number != 0 && (status = Trace_clCreateKernelsInProgram(program, number, kernels, 0)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to create program kernels");
+  }
 
-static void Print_device_Bool(const unsigned int indent, const cl_bool value) {
-  printf("%s", value ? "True" : "False");
-}
+  for (cl_uint iterator = 0; iterator < number; ++iterator) {
+    Kernel* const kernel = &elements[iterator];
+    cl_int status;
+    size_t size;
+    char* name;
+
+    if ( (status = Trace_clGetKernelInfo(kernels[iterator], CL_KERNEL_FUNCTION_NAME, 0, 0, &size)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get size of kernel name");
+    if ( (name = (char*)Memory_allocate(size)) == 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for kernel name", size);
+    if ( (status = Trace_clGetKernelInfo(kernels[iterator], CL_KERNEL_FUNCTION_NAME, size, name, 0)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get kernel name");
+    kernel->name = String_raw(size-1, name);
+
+    if ( (status = Trace_clGetKernelWorkGroupInfo(kernels[iterator], device, CL_KERNEL_WORK_GROUP_SIZE,
+                                                  sizeof kernel->work_group_size, &kernel->work_group_size, 0))
+         != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get kernel work group size");
+    kernel->work_group_multiple = 1;
+#ifdef CL_VERSION_1_1
+    if ( (status = Trace_clGetKernelWorkGroupInfo(kernels[iterator], device,
+                                                  CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+                                                  sizeof kernel->work_group_multiple,
+                                                  &kernel->work_group_multiple, 0))
+         != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get kernel preferred work group size multiple");
+#endif // CL_VERSION_1_1
+    if ( (status = Trace_clGetKernelWorkGroupInfo(kernels[iterator], device, CL_KERNEL_LOCAL_MEM_SIZE,
+                                                  sizeof kernel->local_memory, &kernel->local_memory, 0))
+         != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get kernel local memory size");
+    if ( (status = Trace_clGetKernelWorkGroupInfo(kernels[iterator], device, CL_KERNEL_PRIVATE_MEM_SIZE,
+                                                  sizeof kernel->private_memory, &kernel->private_memory, 0))
+         != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to get kernel private memory size");
+
+    if ( (status = Trace_clReleaseKernel(kernels[iterator])) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to release kernel");
+  }
 
-static void Print_device_UInt(const unsigned int indent, const cl_ulong value) {
-  printf("%lu", (unsigned long)value);
-}
+  Memory_free(kernels);
+  qsort(elements, number, sizeof *elements, Kernel_compare);
 
-static void Print_device_ULong(const unsigned int indent, const cl_uint value) {
-  printf("%lu", (unsigned long)value);
+  return VectorKernel_raw(number, elements);
 }
 
-static void Print_device_Size(const unsigned int indent, const size_t value) {
-  printf("%zu", value);
+static void CL_programFree(const cl_program program) {
+  cl_int status;
+  if ( (status = Trace_clReleaseProgram(program)) != CL_SUCCESS )
+    Error_dieCL(status, EX_SOFTWARE, "Unable to release program");
 }
 
-static void Print_device_String(const unsigned int indent, const String value) {
-  printf("%.*s", (int)value.number, value.elements);
-}
 
-static void Print_device_VectorSize(const unsigned int indent, const VectorSize value) {
-  printf("[");
-  if (value.number > 0) {
-    printf(" ");
-    Print_device_Size(indent+2, value.elements[0]);
+#ifdef CL_VERSION_1_2
+// Object compiled from the code on its own for the device (status and log are those of a build)
+static cl_program CL_programCompile(const cl_context context, const cl_device_id device,
+                                    const VectorString codes, const VectorString options) {
+  cl_program program;
 
-    for (size_t iterator = 1; iterator < value.number; ++iterator) {
-      printf(", ");
-      Print_device_Size(indent+2, value.elements[iterator]);
+  // Load program
+  {
+    const char* strings[codes.number];
+    size_t strings_length[codes.number];
+
+    for (size_t iterator = 0; iterator < codes.number; ++iterator) {
+      strings[iterator] = codes.elements[iterator].elements;
+      strings_length[iterator] = codes.elements[iterator].number;
     }
-    printf(" ");
+
+    const long long start = Stats_clock();
+    cl_int status;
+
+    program = Trace_clCreateProgramWithSource(context, sizeof strings/sizeof *strings, strings, strings_length,
+                                              &status);
+    if (status != CL_SUCCESS)
+      Error_dieCL(status, EX_SOFTWARE, "Unable to create program");
+    Stats_recordDevices(StatsPhase_PROGRAM, VectorCLDevice_raw(1, &device), start);
   }
-  printf("]");
-}
 
-static void Print_device_VectorString(const unsigned int indent, const VectorString value) {
-  printf("[");
-  if (value.number > 0) {
-    printf(" ");
-    Print_device_String(indent+2, value.elements[0]);
+  // Compile program
+  {
+    const char* coption;
 
-    for (size_t iterator = 1; iterator < value.number; ++iterator) {
-      printf(", ");
-      Print_device_String(indent+2, value.elements[iterator]);
+    {
+      String option = String_cintercalate(" ", options);
+      coption = CString_string(option);
+      String_free(option);
     }
-    printf(" ");
+
+    const long long start = Stats_clock();
+    cl_int status;
+
+    if ( (status = Trace_clCompileProgram(program, 1, &device, coption, 0, 0, 0, 0, 0)) != CL_SUCCESS &&
+         status != CL_COMPILE_PROGRAM_FAILURE )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to compile program");
+    Stats_recordDevices(StatsPhase_BUILD, VectorCLDevice_raw(1, &device), start);
+
+    CString_free(coption);
   }
-  printf("]");
-}
 
-static void Print_device_VectorColon(const unsigned int indent, const VectorString value) {
-  Print_device_VectorString(indent, value);
+  return program;
 }
 
-static void Print_device_VectorSpace(const unsigned int indent, const VectorString value) {
-  Print_device_VectorString(indent, value);
-}
+// Object from a binary of one compiled before
+static cl_program CL_programObject(const cl_context context, const cl_device_id device, const String binary) {
+  const unsigned char* binaries[] = { (const unsigned char*)binary.elements };
+  cl_int binary_status;
+  cl_int status;
 
-#ifdef CL_VERSION_1_2
-static void Print_device_VectorPartitionProperty(const unsigned int indent, const VectorCLPartitionProperty value) {
-  printf("[");
-  if (value.number > 0) {
-    printf(" ");
-    Print_device_PartitionProperty(indent+2, value.elements[0]);
+  const cl_program program = Trace_clCreateProgramWithBinary(context, 1, &device, &binary.number, binaries,
+                                                             &binary_status, &status);
+  if (status != CL_SUCCESS)
+    Error_dieCL(status, EX_SOFTWARE, "Unable to create program from object");
+
+  return program;
+}
+
+// Program linked from the objects for the device (zero if the link failed without leaving a program with a log)
+//
+// Only the math options apply to linking so the rest of the options are left to the compiles.
+static cl_program CL_programLink(const cl_context context, const cl_device_id device, const VectorString options,
+                                 const cl_program* const objects, const size_t objects_number,
+                                 cl_int* const status) {
+  static const char* const link_options[] = {
+    "-cl-denorms-are-zero", "-cl-no-signed-zeros", "-cl-unsafe-math-optimizations",
+    "-cl-finite-math-only", "-cl-fast-relaxed-math"
+  };
+  const char* coption;
+
+  {
+    MVectorString mlinks = MVectorString_empty();
+    for (size_t iterator = 0; iterator < options.number; ++iterator)
+      for (size_t links_iterator = 0; links_iterator < sizeof link_options/sizeof *link_options; ++links_iterator)
+        if (String_ccompare(options.elements[iterator], link_options[links_iterator]) == 0)
+          mlinks = MVectorString_pushRaw(mlinks, options.elements[iterator]);
+
+    const VectorString links = MVectorString_freeze(mlinks);
+    String option = String_cintercalate(" ", links);
+    coption = CString_string(option);
+    String_free(option);
+    VectorString_freeViews(links);
+  }
+
+  const long long start = Stats_clock();
+  const cl_program program = Trace_clLinkProgram(context, 1, &device, coption, objects_number, objects, 0, 0,
+                                                 status);
+  if (*status != CL_SUCCESS && *status != CL_LINK_PROGRAM_FAILURE)
+    Error_dieCL(*status, EX_SOFTWARE, "Unable to link program");
+  Stats_recordDevices(StatsPhase_BUILD, VectorCLDevice_raw(1, &device), start);
+
+  CString_free(coption);
+
+  return program;
+}
+#endif // CL_VERSION_1_2
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Device information (memoized properties are owned by it and must not be freed by the caller)
+
+// Information for device (created empty if not asked about before and called holding the mutex)
+static DeviceInfo* DeviceInfo_get(const cl_device_id device_id) {
+  DeviceInfo* info = DeviceInfo_list;
+
+  while (info && info->device_id != device_id)
+    info = info->next;
+
+  if (!info) {
+    if ( (info = (DeviceInfo*)Memory_allocate(sizeof *info)) == 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for device information", sizeof *info);
+    memset(info, 0, sizeof *info);
+    info->device_id = device_id;
+    info->next = DeviceInfo_list;
+    DeviceInfo_list = info;
+  }
+
+  return info;
+}
+
+
+// Release all the device information
+static void DeviceInfo_releaseScalar(const void* const value) {
+  (void)value;
+}
+
+static void DeviceInfo_releaseString(const String* const value) {
+  String_free(*value);
+}
+
+static void DeviceInfo_releaseVectorSize(const VectorSize* const value) {
+  VectorSize_free(*value);
+}
+
+// Split values are views into the property string which starts with the first one
+static void DeviceInfo_releaseVectorSplit(const VectorString* const value) {
+  String_free(String_raw(0, value->elements[0].elements));
+  VectorString_freeViews(*value);
+}
+
+#ifdef CL_VERSION_1_2
+static void DeviceInfo_releaseVectorPartitionProperty(const VectorCLPartitionProperty* const value) {
+  VectorCLPartitionProperty_free(*value);
+}
+#endif // CL_VERSION_1_2
+
+#define DeviceInfo_releaseDeviceId         DeviceInfo_releaseScalar
+#define DeviceInfo_releasePlatformId       DeviceInfo_releaseScalar
+#define DeviceInfo_releaseDeviceType       DeviceInfo_releaseScalar
+#define DeviceInfo_releaseFPConfig         DeviceInfo_releaseScalar
+#define DeviceInfo_releaseMemCacheType     DeviceInfo_releaseScalar
+#define DeviceInfo_releaseMemLocalType     DeviceInfo_releaseScalar
+#define DeviceInfo_releaseExecCapabilities DeviceInfo_releaseScalar
+#define DeviceInfo_releaseQueueProperties  DeviceInfo_releaseScalar
+#define DeviceInfo_releaseAffinityDomain   DeviceInfo_releaseScalar
+#define DeviceInfo_releaseBool             DeviceInfo_releaseScalar
+#define DeviceInfo_releaseUInt             DeviceInfo_releaseScalar
+#define DeviceInfo_releaseULong            DeviceInfo_releaseScalar
+#define DeviceInfo_releaseSize             DeviceInfo_releaseScalar
+#define DeviceInfo_releaseVectorColon      DeviceInfo_releaseVectorSplit
+#define DeviceInfo_releaseVectorSpace      DeviceInfo_releaseVectorSplit
+
+static void DeviceInfo_free() {
+  pthread_mutex_lock(&DeviceInfo_mutex);
+
+  while (DeviceInfo_list) {
+    DeviceInfo* const info = DeviceInfo_list;
+    DeviceInfo_list = info->next;
+
+#define CL_DEVICE_PROPERTY(ID, IDENT, TYPE, GROUP, DESC) \
+    if (info->known##IDENT)                             \
+      DeviceInfo_release##GROUP(&info->IDENT);
+#include "cldeviceprop.h"
+#undef CL_DEVICE_PROPERTY
+
+    Memory_free(info);
+  }
+
+  pthread_mutex_unlock(&DeviceInfo_mutex);
+}
+
+
+// Property of device (a repeat costs no driver calls and counts those it took the first time as saved)
+//
+// The driver is queried without the lock so threads asking about other properties don't wait on it; if two threads
+// fill in the same one the first is kept.  Information is kept for the life of the program so it is never allocated
+// from the current arena.
+#define CL_DEVICE_PROPERTY(ID, IDENT, TYPE, GROUP, DESC)                 \
+  static TYPE DeviceInfo##IDENT(const cl_device_id device_id) {         \
+    pthread_mutex_lock(&DeviceInfo_mutex);                              \
+    DeviceInfo* const info = DeviceInfo_get(device_id);                 \
+    const int known = info->known##IDENT;                               \
+    const unsigned int saved = info->calls##IDENT;                      \
+    TYPE value = info->IDENT;                                           \
+    pthread_mutex_unlock(&DeviceInfo_mutex);                            \
+                                                                        \
+    if (known) {                                                        \
+      if (saved)                                                        \
+        __sync_fetch_and_add(&CL_deviceInfoSaved, saved);               \
+      return value;                                                     \
+    }                                                                   \
+                                                                        \
+    Arena* const arena = Arena_use(0);                                  \
+    const unsigned int calls = CL_deviceInfoThreadCalls;                \
+    value = CL_deviceProperty##IDENT(device_id);                        \
+                                                                        \
+    pthread_mutex_lock(&DeviceInfo_mutex);                              \
+    if (info->known##IDENT) {                                           \
+      DeviceInfo_release##GROUP(&value);                                \
+      value = info->IDENT;                                              \
+    }                                                                   \
+    else {                                                              \
+      info->known##IDENT = 1;                                           \
+      info->calls##IDENT = CL_deviceInfoThreadCalls - calls;            \
+      info->IDENT = value;                                              \
+    }                                                                   \
+    pthread_mutex_unlock(&DeviceInfo_mutex);                            \
+    Arena_use(arena);                                                   \
+    return value;                                                       \
+  }
+#include "cldeviceprop.h"
+#undef CL_DEVICE_PROPERTY
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Build
+
+// Construct/destruct build (takes ownership of the names)
+static Build Build_raw(const cl_platform_id platform_id, const String platform_name,
+                       const cl_device_id device_id, const String device_name) {
+  const Build build = { platform_id, device_id, 0, platform_name, device_name, CL_SUCCESS,
+                        String_raw(0, 0), String_raw(0, 0), VectorKernel_raw(0, 0),
+                        { 0, 0, 0, 0, 0, { 0, { 0, 0, 0 }, 0, { 0, 0, 0 } } }, VectorRunVariant_raw(0, 0) };
+  return build;
+}
+
+static void Build_free(const Build build) {
+  String_free(build.platform_name);
+  String_free(build.device_name);
+  String_free(build.log);
+  String_free(build.binary);
+  VectorKernel_free(build.kernels);
+  VectorRunVariant_free(build.variants);
+}
+
+
+// Source codes are the files prefixed with #line directives so messages refer to them
+static VectorString Build_codes(const VectorString sources) {
+  MVectorString mcodes = MVectorString_empty();
+
+  for (size_t iterator = 0; iterator < sources.number; ++iterator) {
+    mcodes = MVectorString_cpush(mcodes, "#line 1 \"");
+    mcodes = MVectorString_push(mcodes, sources.elements[iterator]);
+    mcodes = MVectorString_cpush(mcodes, "\"\n");
+    mcodes = MVectorString_pushRaw(mcodes, String_map(sources.elements[iterator]));
+  }
+
+  return MVectorString_freeze(mcodes);
+}
+
+// Release codes (every fourth one is a mapped source file)
+static void Build_codesFree(const VectorString codes) {
+  for (size_t iterator = 0; iterator < codes.number; ++iterator)
+    if (iterator % 4 == 3)
+      String_unmap(codes.elements[iterator]);
+    else
+      String_free(codes.elements[iterator]);
+  Memory_free((void*)codes.elements);
+}
+
+
+// Builds for all devices of all platforms that match the selections
+static MVectorBuild Build_select(const MaybeString platform, const MaybeString device) {
+  MVectorBuild mbuilds = MVectorBuild_empty();
+
+  const VectorCLPlatform platforms = CL_platformsQuery();
+
+  for (size_t platforms_iterator = 0; platforms_iterator < platforms.number; ++platforms_iterator) {
+    const cl_platform_id platform_id = platforms.elements[platforms_iterator];
+
+    // If platform selected, filter out ones that don't match
+    const String platform_name = CL_platformName(platform_id);
+    if (MaybeString_isNothing(platform) ||
+        String_compare(MaybeString_assert(platform), platform_name) == 0) {
+
+      // For all the devices
+      const VectorCLDevice devices = CL_devicesQuery(platform_id);
+
+      for (size_t devices_iterator = 0; devices_iterator < devices.number; ++devices_iterator) {
+        const cl_device_id device_id = devices.elements[devices_iterator];
+
+        // If device selected, filter out ones that don't match
+        const String device_name = DeviceInfoName(device_id);
+
+        if (MaybeString_isNothing(device) ||
+            String_compare(MaybeString_assert(device), device_name) == 0)
+          mbuilds = MVectorBuild_push(mbuilds, Build_raw(platform_id, String_string(platform_name),
+                                                         device_id, String_string(device_name)));
+      }
+
+      VectorCLDevice_free(devices);
+    }
+
+    String_free(platform_name);
+  }
+
+  VectorCLPlatform_free(platforms);
+
+  // Builds need the driver's ids (selecting nothing never loads it) and a snapshot that turns out not to match the
+  // driver is dropped with everything selected again from the driver itself
+  if (Snapshot_current && mbuilds.number > 0 && Snapshot_resolve(mbuilds) < 0) {
+    Snapshot_invalidate();
+    VectorBuild_free(MVectorBuild_freeze(mbuilds));
+    return Build_select(platform, device);
+  }
+
+  return mbuilds;
+}
+
+
+// Builds for the targets that match the selections (sharing their contexts)
+static MVectorBuild Build_filter(const VectorBuild targets, const MaybeString platform, const MaybeString device) {
+  MVectorBuild mbuilds = MVectorBuild_empty();
+
+  for (size_t iterator = 0; iterator < targets.number; ++iterator) {
+    const Build target = targets.elements[iterator];
+
+    if ( (MaybeString_isNothing(platform) ||
+          String_compare(MaybeString_assert(platform), target.platform_name) == 0) &&
+         (MaybeString_isNothing(device) ||
+          String_compare(MaybeString_assert(device), target.device_name) == 0) ) {
+      Build build = Build_raw(target.platform_id, String_string(target.platform_name),
+                              target.device_id, String_string(target.device_name));
+      build.context = target.context;
+      mbuilds = MVectorBuild_push(mbuilds, build);
+    }
+  }
+
+  return mbuilds;
+}
+
+// Selected devices with a long lived context each (or one per platform if sharing) for filtering builds from
+static VectorBuild Build_targets(const MaybeString platform, const MaybeString device, const int share) {
+  MVectorBuild mtargets = Build_select(platform, device);
+
+  for (size_t start = 0, end; start < mtargets.number; start = end) {
+    end = start+1;
+    if (share)
+      while (end < mtargets.number && mtargets.elements[end].platform_id == mtargets.elements[start].platform_id)
+        ++end;
+
+    cl_device_id devices[end-start];
+    for (size_t iterator = start; iterator < end; ++iterator)
+      devices[iterator-start] = mtargets.elements[iterator].device_id;
+
+    const cl_context context =
+      CL_contextCreate(mtargets.elements[start].platform_id, VectorCLDevice_raw(end-start, devices));
+    for (size_t iterator = start; iterator < end; ++iterator)
+      mtargets.elements[iterator].context = context;
+  }
+
+  return MVectorBuild_freeze(mtargets);
+}
+
+static void Build_targetsFree(const VectorBuild targets) {
+  // Shared contexts are on consecutive targets
+  for (size_t iterator = 0; iterator < targets.number; ++iterator)
+    if (iterator == 0 || targets.elements[iterator].context != targets.elements[iterator-1].context)
+      CL_contextFree(targets.elements[iterator].context);
+
+  VectorBuild_free(targets);
+}
+
+
+// Print logs and save binaries in device order for builds start to end (returns number of failures)
+static size_t Build_report(const VectorBuild builds, const size_t start, const size_t end, const MaybeString binary) {
+  size_t failures = 0;
+
+  for (size_t builds_iterator = start; builds_iterator < end; ++builds_iterator) {
+    const Build build = builds.elements[builds_iterator];
+
+    if (build.status != CL_SUCCESS)
+      ++failures;
+
+    if (build.status != CL_SUCCESS || !String_blank(build.log))
+      fprintf(stderr, "Compilation %s (platform \"%.*s\", device \"%.*s\"):\n%.*s%s",
+              build.status == CL_SUCCESS ? "warnings" : "failure",
+              (int)build.platform_name.number, build.platform_name.elements,
+              (int)build.device_name.number, build.device_name.elements,
+              (int)build.log.number, build.log.elements,
+              build.log.number > 0 && build.log.elements[build.log.number-1] == '\n' ? "" : "\n");
+
+    if (build.status == CL_SUCCESS && MaybeString_isJust(binary))
+      Build_save(builds, builds_iterator, MaybeString_assert(binary));
+  }
+
+  return failures;
+}
+
+
+// Write binary of build at index to file named by prefix
+static void Build_save(const VectorBuild builds, const size_t index, const String prefix) {
+  const String name = Build_binaryName(builds, index, prefix);
+  String_fileWrite(name, builds.elements[index].binary);
+  String_free(name);
+}
+
+
+// Binary file name is prefix (as a directory if it is one) followed by platform and device names (and, if other
+// builds have the same names, the device's position among them as identical devices are always selected together)
+static String Build_binaryName(const VectorBuild builds, const size_t index, const String prefix) {
+  const Build build = builds.elements[index];
+  MString mname = MString_string(prefix);
+
+  {
+    const char* cprefix = CString_string(prefix);
+    struct stat prefix_stat;
+
+    if (prefix.number > 0 && prefix.elements[prefix.number-1] != '/' &&
+        stat(cprefix, &prefix_stat) == 0 && S_ISDIR(prefix_stat.st_mode))
+      mname = MString_push(mname, '/');
+
+    CString_free(cprefix);
+  }
+
+  // Names are reduced to characters that are safe in a file name
+  const String names[] = { build.platform_name, build.device_name };
+
+  for (size_t names_iterator = 0; names_iterator < sizeof names/sizeof *names; ++names_iterator) {
+    if (names_iterator > 0)
+      mname = MString_push(mname, '-');
+    for (size_t iterator = 0; iterator < names[names_iterator].number; ++iterator) {
+      const char element = names[names_iterator].elements[iterator];
+      mname = MString_push(mname, isalnum((unsigned char)element) || element == '.' || element == '_' ?
+                           element : '_');
+    }
+  }
+
+  // Identical devices are told apart by their position
+  size_t position = 0;
+  int same = 0;
+
+  for (size_t iterator = 0; iterator < builds.number; ++iterator)
+    if (iterator != index &&
+        String_compare(builds.elements[iterator].platform_name, build.platform_name) == 0 &&
+        String_compare(builds.elements[iterator].device_name, build.device_name) == 0) {
+      same = 1;
+      if (iterator < index)
+        ++position;
+    }
+
+  if (same) {
+    char csame[32];
+    snprintf(csame, sizeof csame, "-%zu", position);
+    mname = MString_cappend(mname, csame);
+  }
+
+  mname = MString_cappend(mname, ".bin");
+
+  return MString_freeze(mname);
+}
+
+
+// Mutable vector of builds
+static MVectorBuild MVectorBuild_empty() {
+  const MVectorBuild mvector = { 0, 0 };
+  return mvector;
+}
+
+static VectorBuild MVectorBuild_freeze(MVectorBuild mvector) {
+  // Spare capacity stays with the allocation (shrinking it would just be another copy)
+  return *(VectorBuild*)&mvector;
+}
+
+
+// Allocation held for number elements (doubling keeps repeated extension amortized constant)
+static size_t MVectorBuild_capacity(const size_t number) {
+  if (number == 0)
+    return 0;
+  if (number <= MVectorBuild_BLOCK)
+    return MVectorBuild_BLOCK;
+
+  // Next power of two (the block size is one) without looping as this is checked on every extension
+  return (size_t)1 << (sizeof(unsigned long long)*8 - __builtin_clzll(number-1));
+}
+
+
+// Ensure room for number elements
+static MVectorBuild MVectorBuild_reserve(MVectorBuild mvector, const size_t number) {
+  const size_t capacity = MVectorBuild_capacity(number);
+
+  if (MVectorBuild_capacity(mvector.number) < capacity)
+    if ( (mvector.elements = (Build*)Memory_reallocate(mvector.elements, sizeof *mvector.elements * capacity)) == 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to expand MVectorBuild allocation to %zd bytes",
+                     sizeof *mvector.elements * capacity);
+
+  return mvector;
+}
+
+
+static MVectorBuild MVectorBuild_push(MVectorBuild mvector, const Build build) {
+  // Allocation is full exactly when number is zero or a power of two past the block size
+  if ( mvector.number == 0 ||
+       (mvector.number >= MVectorBuild_BLOCK && (mvector.number & (mvector.number-1)) == 0) )
+    mvector = MVectorBuild_reserve(mvector, mvector.number+1);
+
+  // Append element
+  mvector.elements[mvector.number] = build;
+  ++mvector.number;
+
+  return mvector;
+}
+
+
+// Vector of builds
+static void VectorBuild_free(const VectorBuild vector) {
+  for (size_t iterator = 0; iterator < vector.number; ++iterator)
+    Build_free(vector.elements[iterator]);
+  Memory_free((void*)vector.elements);
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Kernels (resources each kernel of a successful build takes per device)
+
+// Vector of kernels
+static VectorKernel VectorKernel_raw(const size_t number, Kernel* const elements) {
+  const VectorKernel vector = { number, elements };
+  return vector;
+}
+
+static void VectorKernel_free(const VectorKernel vector) {
+  for (size_t iterator = 0; iterator < vector.number; ++iterator)
+    String_free(vector.elements[iterator].name);
+  Memory_free(vector.elements);
+}
+
+
+// Kernels are ordered by name (drivers give them in any order)
+static int Kernel_compare(const void* const kernel0, const void* const kernel1) {
+  return String_compare(((const Kernel*)kernel0)->name, ((const Kernel*)kernel1)->name);
+}
+
+
+// Print the kernels of the successful builds to stdout
+static void Kernel_report(const VectorBuild builds, const StatsFormat format) {
+  if (format == StatsFormat_JSON) {
+    MString mreport = MString_cstring("{\"kernels\":[");
+    int first = 1;
+
+    for (size_t builds_iterator = 0; builds_iterator < builds.number; ++builds_iterator) {
+      const Build build = builds.elements[builds_iterator];
+
+      for (size_t iterator = 0; iterator < build.kernels.number; ++iterator) {
+        const Kernel* const kernel = &build.kernels.elements[iterator];
+        char numbers[256];
+
+        mreport = MString_cappend(mreport, first ? "{\"platform\":" : ",{\"platform\":");
+        mreport = MString_appendJSON(mreport, build.platform_name);
+        mreport = MString_cappend(mreport, ",\"device\":");
+        mreport = MString_appendJSON(mreport, build.device_name);
+        mreport = MString_cappend(mreport, ",\"kernel\":");
+        mreport = MString_appendJSON(mreport, kernel->name);
+        snprintf(numbers, sizeof numbers, ",\"work_group_size\":%zu,\"preferred_work_group_size_multiple\":%zu,"
+                 "\"local_mem_size\":%llu,\"private_mem_size\":%llu}",
+                 kernel->work_group_size, kernel->work_group_multiple,
+                 (unsigned long long)kernel->local_memory, (unsigned long long)kernel->private_memory);
+        mreport = MString_cappend(mreport, numbers);
+        first = 0;
+      }
+    }
+    mreport = MString_cappend(mreport, "]}\n");
+
+    const String report = MString_freeze(mreport);
+    fwrite(report.elements, 1, report.number, stdout);
+    String_free(report);
+    return;
+  }
+
+  // Table sized to fit the names (nothing if there are no kernels at all)
+  int platform_width = strlen("Platform");
+  int device_width = strlen("Device");
+  int kernel_width = strlen("Kernel");
+  size_t kernels_number = 0;
+
+  for (size_t builds_iterator = 0; builds_iterator < builds.number; ++builds_iterator) {
+    const Build build = builds.elements[builds_iterator];
+
+    if (build.kernels.number == 0)
+      continue;
+    kernels_number += build.kernels.number;
+    if ((int)build.platform_name.number > platform_width)
+      platform_width = build.platform_name.number;
+    if ((int)build.device_name.number > device_width)
+      device_width = build.device_name.number;
+    for (size_t iterator = 0; iterator < build.kernels.number; ++iterator)
+      if ((int)build.kernels.elements[iterator].name.number > kernel_width)
+        kernel_width = build.kernels.elements[iterator].name.number;
+  }
+  if (kernels_number == 0)
+    return;
+
+  printf("%-*s  %-*s  %-*s  %10s  %8s  %11s  %13s\n", platform_width, "Platform", device_width, "Device",
+         kernel_width, "Kernel", "Work group", "Multiple", "Local bytes", "Private bytes");
+  for (size_t builds_iterator = 0; builds_iterator < builds.number; ++builds_iterator) {
+    const Build build = builds.elements[builds_iterator];
+
+    for (size_t iterator = 0; iterator < build.kernels.number; ++iterator) {
+      const Kernel* const kernel = &build.kernels.elements[iterator];
+
+      printf("%-*.*s  %-*.*s  %-*.*s  %10zu  %8zu  %11llu  %13llu\n",
+             platform_width, (int)build.platform_name.number, build.platform_name.elements,
+             device_width, (int)build.device_name.number, build.device_name.elements,
+             kernel_width, (int)kernel->name.number, kernel->name.elements,
+             kernel->work_group_size, kernel->work_group_multiple,
+             (unsigned long long)kernel->local_memory, (unsigned long long)kernel->private_memory);
+    }
+  }
+}
+
+
+// Estimate for groups of the local work size (the largest group the kernel can be run with if none) with the work
+// items a compute unit holds taken to be the device's largest work group or the kernel's limit if lower
+static KernelOccupancy Kernel_occupancy(const cl_device_id device_id, const Kernel* const kernel,
+                                        const WorkSize work) {
+  KernelOccupancy occupancy = { 1, 0, 0, 0 };
+
+  // Work items a compute unit holds (fewer for this kernel if the driver lowered its limit for its registers)
+  const size_t device_items = DeviceInfoMaxWorkGroupSize(device_id);
+  const size_t items = kernel->work_group_size > 0 && kernel->work_group_size < device_items ?
+    kernel->work_group_size : device_items;
+
+  // Group of this kernel (local work sizes the device or kernel can't run fit no groups)
+  {
+    const VectorSize sizes = DeviceInfoMaxWorkItemSizes(device_id);
+
+    occupancy.group = work.local_dimensions > 0 ? 1 : kernel->work_group_size;
+    for (cl_uint dimension = 0; dimension < work.local_dimensions; ++dimension) {
+      occupancy.group *= work.local[dimension];
+      if (dimension < sizes.number && work.local[dimension] > sizes.elements[dimension])
+        occupancy.limit = "work item sizes";
+    }
+    if (occupancy.group == 0)
+      occupancy.group = 1;
+    if (!occupancy.limit && occupancy.group > items)
+      occupancy.limit = "work group size";
+    if (occupancy.limit)
+      return occupancy;
+  }
+
+  // Groups are those that fit in both the work items and the local memory
+  const size_t item_groups = items / occupancy.group;
+  const cl_ulong local_size = DeviceInfoLocalMemSize(device_id);
+  const size_t local_groups = kernel->local_memory == 0 ? item_groups :
+    local_size / kernel->local_memory < item_groups ? local_size / kernel->local_memory : item_groups;
+
+  occupancy.groups = local_groups;
+  if (device_items > 0)
+    occupancy.occupancy = (double)(occupancy.groups * occupancy.group) / device_items;
+
+  // Blame the first bound that cost groups: local memory, then registers, then groups not dividing the work items
+  if (local_groups < item_groups)
+    occupancy.limit = "local memory";
+  else if (item_groups < device_items / occupancy.group)
+    occupancy.limit = "registers";
+  else if (occupancy.occupancy < 1)
+    occupancy.limit = "group size";
+
+  return occupancy;
+}
+
+
+// Print the occupancy estimates of the kernels of the successful builds to stdout and flag low ones on stderr
+static void Kernel_reportOccupancy(const VectorBuild builds, const StatsFormat format, const WorkSize work) {
+  MString mreport = MString_cstring(format == StatsFormat_JSON ? "{\"kernels\":[" : "");
+  int platform_width = strlen("Platform");
+  int device_width = strlen("Device");
+  int kernel_width = strlen("Kernel");
+  size_t kernels_number = 0;
+
+  // Table sized to fit the names
+  for (size_t builds_iterator = 0; builds_iterator < builds.number; ++builds_iterator) {
+    const Build build = builds.elements[builds_iterator];
+
+    if (build.kernels.number == 0)
+      continue;
+    kernels_number += build.kernels.number;
+    if ((int)build.platform_name.number > platform_width)
+      platform_width = build.platform_name.number;
+    if ((int)build.device_name.number > device_width)
+      device_width = build.device_name.number;
+    for (size_t iterator = 0; iterator < build.kernels.number; ++iterator)
+      if ((int)build.kernels.elements[iterator].name.number > kernel_width)
+        kernel_width = build.kernels.elements[iterator].name.number;
+  }
+
+  if (format == StatsFormat_TABLE && kernels_number > 0) {
+    char header[512];
+    snprintf(header, sizeof header, "%-*s  %-*s  %-*s  %6s  %9s  %8s  %9s  %s\n", platform_width, "Platform",
+             device_width, "Device", kernel_width, "Kernel", "Group", "Groups/CU", "Groups", "Occupancy", "Limit");
+    mreport = MString_cappend(mreport, header);
+  }
+
+  int first = 1;
+
+  for (size_t builds_iterator = 0; builds_iterator < builds.number; ++builds_iterator) {
+    const Build build = builds.elements[builds_iterator];
+    const cl_uint units = build.kernels.number > 0 ? DeviceInfoMaxComputeUnits(build.device_id) : 0;
+
+    for (size_t iterator = 0; iterator < build.kernels.number; ++iterator) {
+      const Kernel* const kernel = &build.kernels.elements[iterator];
+      const KernelOccupancy occupancy = Kernel_occupancy(build.device_id, kernel, work);
+      char numbers[512];
+
+      if (format == StatsFormat_JSON) {
+        mreport = MString_cappend(mreport, first ? "{\"platform\":" : ",{\"platform\":");
+        mreport = MString_appendJSON(mreport, build.platform_name);
+        mreport = MString_cappend(mreport, ",\"device\":");
+        mreport = MString_appendJSON(mreport, build.device_name);
+        mreport = MString_cappend(mreport, ",\"kernel\":");
+        mreport = MString_appendJSON(mreport, kernel->name);
+        snprintf(numbers, sizeof numbers,
+                 ",\"work_group_size\":%zu,\"groups_per_compute_unit\":%zu,\"compute_units\":%u,"
+                 "\"occupancy\":%.4f,\"limit\":", occupancy.group, occupancy.groups, (unsigned int)units,
+                 occupancy.occupancy);
+        mreport = MString_cappend(mreport, numbers);
+        if (occupancy.limit)
+          mreport = MString_appendJSON(mreport, String_raw(strlen(occupancy.limit), occupancy.limit));
+        else
+          mreport = MString_cappend(mreport, "null");
+        snprintf(numbers, sizeof numbers,
+                 ",\"device_limits\":{\"local_mem_size\":%llu,\"max_work_group_size\":%zu,"
+                 "\"max_constant_buffer_size\":%llu,\"max_parameter_size\":%zu}}",
+                 (unsigned long long)DeviceInfoLocalMemSize(build.device_id),
+                 DeviceInfoMaxWorkGroupSize(build.device_id),
+                 (unsigned long long)DeviceInfoMaxConstantBufferSize(build.device_id),
+                 DeviceInfoMaxParameterSize(build.device_id));
+        mreport = MString_cappend(mreport, numbers);
+      }
+      else {
+        snprintf(numbers, sizeof numbers, "%-*.*s  %-*.*s  %-*.*s  %6zu  %9zu  %8zu  %8.0f%%  %s\n",
+                 platform_width, (int)build.platform_name.number, build.platform_name.elements,
+                 device_width, (int)build.device_name.number, build.device_name.elements,
+                 kernel_width, (int)kernel->name.number, kernel->name.elements,
+                 occupancy.group, occupancy.groups, occupancy.groups * units, occupancy.occupancy * 100,
+                 occupancy.limit ? occupancy.limit : "-");
+        mreport = MString_cappend(mreport, numbers);
+      }
+
+      if (occupancy.limit && occupancy.groups == 0)
+        fprintf(stderr, "Kernel \"%.*s\" (platform \"%.*s\", device \"%.*s\") can't be run with work groups of "
+                "%zu (over the %s limit)\n",
+                (int)kernel->name.number, kernel->name.elements,
+                (int)build.platform_name.number, build.platform_name.elements,
+                (int)build.device_name.number, build.device_name.elements, occupancy.group, occupancy.limit);
+      else if (occupancy.limit && occupancy.occupancy < KernelOccupancy_LOW)
+        fprintf(stderr, "Kernel \"%.*s\" (platform \"%.*s\", device \"%.*s\") is held back by %s to %zu work "
+                "groups of %zu per compute unit (%.0f%% occupancy)\n",
+                (int)kernel->name.number, kernel->name.elements,
+                (int)build.platform_name.number, build.platform_name.elements,
+                (int)build.device_name.number, build.device_name.elements,
+                occupancy.limit, occupancy.groups, occupancy.group, occupancy.occupancy * 100);
+      first = 0;
+    }
+  }
+
+  if (format == StatsFormat_JSON)
+    mreport = MString_cappend(mreport, "]}\n");
+
+  const String report = MString_freeze(mreport);
+  fwrite(report.elements, 1, report.number, stdout);
+  String_free(report);
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Runs (the kernel given run on the context of the build with synthetic arguments and timed by profiling events)
+
+// Kernel argument from its type:value description (returns -1 if invalid)
+static int Run_argument(const char* const cstring, RunArgument* const argument) {
+  const char* const colon = strchr(cstring, ':');
+  if (!colon)
+    return -1;
+
+  const String type = String_raw(colon - cstring, cstring);
+  const char* const value = colon+1;
+  char* end;
+
+  argument->fill = 0;
+  memset(argument->value, 0, sizeof argument->value);
+  errno = 0;
+
+  // Buffer or local memory of size bytes (buffers optionally followed by the value to fill them with)
+  if (String_ccompare(type, "buffer") == 0 || String_ccompare(type, "local") == 0) {
+    const char* const fill = strchr(value, ':');
+    const size_t size_length = fill ? (size_t)(fill - value) : strlen(value);
+    char csize[32];
+    unsigned long long size;
+
+    if (size_length >= sizeof csize)
+      return -1;
+    memcpy(csize, value, size_length);
+    csize[size_length] = 0;
+    if (Settings_size(csize, &size) < 0 || size < 1)
+      return -1;
+
+    argument->type = String_ccompare(type, "buffer") == 0 ? RunArgumentType_BUFFER : RunArgumentType_LOCAL;
+    argument->size = size;
+
+    if (fill) {
+      if (argument->type != RunArgumentType_BUFFER)
+        return -1;
+
+      // Fill value is an integer (any base, so 0xE0 stays one) unless it only parses whole as a float
+      const long long element = strtoll(fill+1, &end, 0);
+      if (end != fill+1 && *end == 0) {
+        const int32_t element32 = element;
+        if (errno != 0 || element < INT32_MIN || element > UINT32_MAX)
+          return -1;
+        memcpy(argument->value, &element32, sizeof element32);
+      }
+      else {
+        errno = 0;
+        const float element = strtof(fill+1, &end);
+        if (errno != 0 || *end != 0 || end == fill+1)
+          return -1;
+        memcpy(argument->value, &element, sizeof element);
+      }
+      argument->fill = 1;
+    }
+
+    return 0;
+  }
+
+  // Scalar of the given type
+  argument->type = RunArgumentType_SCALAR;
+
+  if (String_ccompare(type, "int") == 0) {
+    const long long element = strtoll(value, &end, 0);
+    const cl_int element32 = element;
+    if (element < INT32_MIN || element > INT32_MAX)
+      return -1;
+    argument->size = sizeof element32;
+    memcpy(argument->value, &element32, sizeof element32);
+  }
+  else if (String_ccompare(type, "uint") == 0) {
+    const unsigned long long element = strtoull(value, &end, 0);
+    const cl_uint element32 = element;
+    if (element > UINT32_MAX || strchr(value, '-'))
+      return -1;
+    argument->size = sizeof element32;
+    memcpy(argument->value, &element32, sizeof element32);
+  }
+  else if (String_ccompare(type, "long") == 0) {
+    const cl_long element = strtoll(value, &end, 0);
+    argument->size = sizeof element;
+    memcpy(argument->value, &element, sizeof element);
+  }
+  else if (String_ccompare(type, "ulong") == 0) {
+    const cl_ulong element = strtoull(value, &end, 0);
+    if (strchr(value, '-'))
+      return -1;
+    argument->size = sizeof element;
+    memcpy(argument->value, &element, sizeof element);
+  }
+  else if (String_ccompare(type, "float") == 0) {
+    const cl_float element = strtof(value, &end);
+    argument->size = sizeof element;
+    memcpy(argument->value, &element, sizeof element);
+  }
+  else if (String_ccompare(type, "double") == 0) {
+    const cl_double element = strtod(value, &end);
+    argument->size = sizeof element;
+    memcpy(argument->value, &element, sizeof element);
+  }
+  else
+    return -1;
+
+  return errno != 0 || *end != 0 || end == value ? -1 : 0;
+}
+
+
+// Run the kernel on the device warming up first and time the runs after (random data is the same every time)
+//
+// If tuning, work sizes the kernel can't be enqueued with give no runs instead of being an error. If outputs is
+// given it is set to the contents of the buffers after the first run one after the other.
+static Run Run_kernel(const cl_context context, const cl_program program, const cl_device_id device,
+                      const Settings* const settings, const WorkSize work, String* const outputs) {
+  const long long start = Stats_clock();
+  const String name = MaybeString_assert(settings->run);
+  Run run = { settings->runs, 0, 0, 0, 0, work };
+  cl_int status;
+
+  // Queue and kernel
+  const cl_command_queue queue = Trace_clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &status);
+  if (status != CL_SUCCESS)
+    Error_dieCL(status, EX_SOFTWARE, "Unable to create command queue");
+
+  cl_kernel kernel;
+  {
+    const char* cname = CString_string(name);
+    kernel = Trace_clCreateKernel(program, cname, &status);
+    CString_free(cname);
+  }
+  if (status == CL_INVALID_KERNEL_NAME)
+    Error_die(EX_USAGE, "No kernel \"%.*s\" in program to run", (int)name.number, name.elements);
+  if (status != CL_SUCCESS)
+    Error_dieCL(status, EX_SOFTWARE, "Unable to create kernel \"%.*s\"", (int)name.number, name.elements);
+
+  // Arguments
+  cl_mem buffers[settings->args.number > 0 ? settings->args.number : 1];
+  size_t buffers_size[settings->args.number > 0 ? settings->args.number : 1];
+  size_t buffers_number = 0;
+
+  for (size_t iterator = 0; iterator < settings->args.number; ++iterator) {
+    RunArgument argument;
+    {
+      const char* cargument = CString_string(settings->args.elements[iterator]);
+      if (Run_argument(cargument, &argument) < 0)
+        Error_die(EX_SOFTWARE, "Invalid kernel argument \"%s\"", cargument);
+      CString_free(cargument);
+    }
+
+    if (argument.type == RunArgumentType_BUFFER) {
+      unsigned char* data;
+      uint32_t random = 2463534242u + iterator;     // Xorshift state (never zero)
+
+      if ( (data = (unsigned char*)Memory_allocate(argument.size)) == 0 )
+        Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for kernel argument", argument.size);
+      for (size_t data_iterator = 0; data_iterator < argument.size; ++data_iterator) {
+        if (!argument.fill && data_iterator % 4 == 0) {
+          random ^= random << 13;
+          random ^= random >> 17;
+          random ^= random << 5;
+          memcpy(argument.value, &random, sizeof random);
+        }
+        data[data_iterator] = argument.value[data_iterator % 4];
+      }
+
+      buffers[buffers_number] = Trace_clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                                                     argument.size, data, &status);
+      Memory_free(data);
+      if (status != CL_SUCCESS)
+        Error_dieCL(status, EX_SOFTWARE, "Unable to create %zd byte buffer for kernel argument %zd",
+                    argument.size, iterator);
+      status = Trace_clSetKernelArg(kernel, iterator, sizeof buffers[buffers_number], &buffers[buffers_number]);
+      buffers_size[buffers_number++] = argument.size;
+    }
+    else
+      status = Trace_clSetKernelArg(kernel, iterator, argument.size,
+                                    argument.type == RunArgumentType_LOCAL ? 0 : argument.value);
+
+    if (status != CL_SUCCESS)
+      Error_dieCL(status, EX_USAGE, "Unable to set kernel argument %zd to \"%.*s\"", iterator,
+                  (int)settings->args.elements[iterator].number, settings->args.elements[iterator].elements);
+  }
+
+  // Runs (warm ups are only waited for)
+  const size_t* const local = work.local_dimensions ? work.local : 0;
+  long long* const times = (long long*)Memory_allocate(settings->runs > SIZE_MAX/sizeof(long long) ? SIZE_MAX :
+                                                       sizeof(long long) * settings->runs);
+  MString moutputs = MString_empty();
+
+  if (!times)
+    Error_dieErrno(errno, EX_OSERR, "Unable to allocate times for %zu kernel runs", settings->runs);
+
+  for (size_t iterator = 0; iterator < settings->warmup + settings->runs && run.runs > 0; ++iterator) {
+    const long long enqueue_start = Stats_clock();
+    cl_event event;
+
+    if ( (status = Trace_clEnqueueNDRangeKernel(queue, kernel, work.dimensions, work.global,
+                                                local, &event)) != CL_SUCCESS ) {
+      if ((settings->tune || settings->tune_math) &&
+          (status == CL_INVALID_WORK_GROUP_SIZE || status == CL_INVALID_WORK_ITEM_SIZE ||
+           status == CL_OUT_OF_RESOURCES)) {
+        run.runs = 0;
+        continue;
+      }
+      Error_dieCL(status, EX_USAGE, "Unable to enqueue kernel \"%.*s\"", (int)name.number, name.elements);
+    }
+    const long long enqueue_end = Stats_clock();
+
+    if ( (status = Trace_clWaitForEvents(1, &event)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to wait for kernel \"%.*s\"", (int)name.number, name.elements);
+
+    for (size_t buffers_iterator = 0; outputs && iterator == 0 && buffers_iterator < buffers_number;
+         ++buffers_iterator) {
+      const size_t size = buffers_size[buffers_iterator];
+      char* const data = (char*)Memory_allocate(size);
+
+      if (!data)
+        Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for kernel output", size);
+      if ( (status = Trace_clEnqueueReadBuffer(queue, buffers[buffers_iterator], CL_TRUE, 0, size, data))
+           != CL_SUCCESS )
+        Error_dieCL(status, EX_SOFTWARE, "Unable to read %zd byte buffer of kernel \"%.*s\"", size,
+                    (int)name.number, name.elements);
+      moutputs = MString_append(moutputs, String_raw(size, data));
+      Memory_free(data);
+    }
+
+    if (iterator >= settings->warmup) {
+      cl_ulong started;
+      cl_ulong ended;
+
+      if ( (status = Trace_clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof started, &started, 0))
+           != CL_SUCCESS ||
+           (status = Trace_clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof ended, &ended, 0))
+           != CL_SUCCESS )
+        Error_dieCL(status, EX_SOFTWARE, "Unable to get kernel profiling information");
+
+      times[iterator - settings->warmup] = ended - started;
+      run.enqueue += enqueue_end - enqueue_start;
+    }
+
+    if ( (status = Trace_clReleaseEvent(event)) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to release event");
+  }
+
+  // Times (the median of an even number of runs is the mean of the middle two)
+  if (run.runs > 0) {
+    qsort(times, run.runs, sizeof *times, Bench_compare);
+    run.minimum = times[0];
+    run.median = (times[(run.runs-1)/2] + times[run.runs/2])/2;
+    run.maximum = times[run.runs-1];
+    run.enqueue /= run.runs;
+  }
+
+  // Release
+  for (size_t iterator = 0; iterator < buffers_number; ++iterator)
+    if ( (status = Trace_clReleaseMemObject(buffers[iterator])) != CL_SUCCESS )
+      Error_dieCL(status, EX_SOFTWARE, "Unable to release buffer");
+  if ( (status = Trace_clReleaseKernel(kernel)) != CL_SUCCESS )
+    Error_dieCL(status, EX_SOFTWARE, "Unable to release kernel");
+  if ( (status = Trace_clReleaseCommandQueue(queue)) != CL_SUCCESS )
+    Error_dieCL(status, EX_SOFTWARE, "Unable to release command queue");
+  Memory_free(times);
+
+  Stats_recordDevices(StatsPhase_RUN, VectorCLDevice_raw(1, &device), start);
+
+  const String contents = MString_freeze(moutputs);
+  if (outputs)
+    *outputs = contents;
+  else
+    String_free(contents);
+
+  return run;
+}
+
+
+// Print the run times of the successful builds to stdout
+static void Run_report(const VectorBuild builds) {
+  int platform_width = strlen("Platform");
+  int device_width = strlen("Device");
+  size_t runs_number = 0;
+
+  for (size_t iterator = 0; iterator < builds.number; ++iterator) {
+    const Build build = builds.elements[iterator];
+
+    if (build.run.runs == 0)
+      continue;
+    ++runs_number;
+    if ((int)build.platform_name.number > platform_width)
+      platform_width = build.platform_name.number;
+    if ((int)build.device_name.number > device_width)
+      device_width = build.device_name.number;
+  }
+  if (runs_number == 0)
+    return;
+
+  printf("%-*s  %-*s  %-14s  %6s  %12s  %12s  %12s  %12s\n", platform_width, "Platform", device_width, "Device",
+         "Local", "Runs", "Min us", "Median us", "Max us", "Enqueue us");
+  for (size_t iterator = 0; iterator < builds.number; ++iterator) {
+    const Build build = builds.elements[iterator];
+
+    if (build.run.runs == 0)
+      continue;
+
+    const String local = MString_freeze(Run_appendLocal(MString_empty(), build.run.work, ","));
+    printf("%-*.*s  %-*.*s  %-14.*s  %6zu  %12.3f  %12.3f  %12.3f  %12.3f\n",
+           platform_width, (int)build.platform_name.number, build.platform_name.elements,
+           device_width, (int)build.device_name.number, build.device_name.elements,
+           (int)local.number, local.elements,
+           build.run.runs, build.run.minimum/1e3, build.run.median/1e3, build.run.maximum/1e3,
+           build.run.enqueue/1e3);
+    String_free(local);
+  }
+}
+
+
+// Local work size of the run as separated numbers ("driver" if it was left to the driver)
+static MString Run_appendLocal(MString mstring, const WorkSize work, const char* const separator) {
+  if (work.local_dimensions == 0)
+    return MString_cappend(mstring, "driver");
+
+  for (cl_uint iterator = 0; iterator < work.local_dimensions; ++iterator) {
+    char number[32];
+    snprintf(number, sizeof number, "%s%zu", iterator > 0 ? separator : "", work.local[iterator]);
+    mstring = MString_cappend(mstring, number);
+  }
+  return mstring;
+}
+
+
+// Run the kernel with every candidate local work size and keep the run with the lowest median
+//
+// Candidates are powers of two dividing the global size in each dimension within the device's work item sizes,
+// whose product is within the kernel's largest work group and a multiple of its preferred multiple (any product if
+// none is).
+static Run Run_tune(const cl_context context, const cl_program program, const cl_device_id device,
+                    const Settings* const settings) {
+  const String name = MaybeString_assert(settings->run);
+  size_t limit = DeviceInfoMaxWorkGroupSize(device);
+  size_t multiple = 1;
+
+  // Limits of the kernel
+  {
+    const VectorKernel kernels = CL_programKernels(program, device);
+    int found = 0;
+
+    for (size_t iterator = 0; iterator < kernels.number; ++iterator)
+      if (String_compare(kernels.elements[iterator].name, name) == 0) {
+        if (kernels.elements[iterator].work_group_size < limit)
+          limit = kernels.elements[iterator].work_group_size;
+        multiple = kernels.elements[iterator].work_group_multiple > 0 ?
+          kernels.elements[iterator].work_group_multiple : 1;
+        found = 1;
+      }
+
+    VectorKernel_free(kernels);
+    if (!found)
+      Error_die(EX_USAGE, "No kernel \"%.*s\" in program to tune", (int)name.number, name.elements);
+  }
+
+  // Candidates of each dimension
+  const cl_uint dimensions = settings->work.dimensions;
+  size_t candidates[3][Run_CANDIDATES];
+  size_t candidates_number[3] = { 0, 0, 0 };
+
+  {
+    const VectorSize sizes = DeviceInfoMaxWorkItemSizes(device);
+
+    for (cl_uint dimension = 0; dimension < dimensions; ++dimension)
+      for (size_t size = 1; size <= limit && candidates_number[dimension] < Run_CANDIDATES; size *= 2)
+        if ((dimension >= sizes.number || size <= sizes.elements[dimension]) &&
+            settings->work.global[dimension] % size == 0)
+          candidates[dimension][candidates_number[dimension]++] = size;
+  }
+
+  // Sweep combinations of them (second pass without the multiple only if nothing was a multiple of it)
+  Run best = { 0, 0, 0, 0, 0, settings->work };
+  size_t tried = 0;
+
+  for (int pass = 0; pass < 2 && tried == 0; ++pass) {
+    size_t indices[3] = { 0, 0, 0 };
+
+    for (;;) {
+      WorkSize work = settings->work;
+      size_t total = 1;
+
+      work.local_dimensions = dimensions;
+      for (cl_uint dimension = 0; dimension < dimensions; ++dimension) {
+        work.local[dimension] = candidates[dimension][indices[dimension]];
+        total *= work.local[dimension];
+      }
+
+      if (total <= limit && (pass == 1 || total % multiple == 0)) {
+        const Run run = Run_kernel(context, program, device, settings, work, 0);
+
+        ++tried;
+        if (run.runs > 0 && (best.runs == 0 || run.median < best.median))
+          best = run;
+      }
+
+      // Next combination
+      cl_uint dimension = 0;
+      while (dimension < dimensions && ++indices[dimension] == candidates_number[dimension])
+        indices[dimension++] = 0;
+      if (dimension == dimensions)
+        break;
+    }
+  }
+
+  return best;
+}
+
+
+// Save the local work size of the fastest runs per device and driver version as a C header or JSON
+static void Run_writeTuned(const VectorBuild builds, const Settings* const settings) {
+  const String kernel = MaybeString_assert(settings->run);
+  const String name = MaybeString_isJust(settings->tuned) ? String_string(MaybeString_assert(settings->tuned)) :
+    String_cappend(String_string(kernel), ".tuned.h");
+  const int json = name.number >= 5 && memcmp(&name.elements[name.number-5], ".json", 5) == 0;
+  MString mcontents = MString_empty();
+
+  if (json) {
+    mcontents = MString_cappend(mcontents, "{\"kernel\":");
+    mcontents = MString_appendJSON(mcontents, kernel);
+    mcontents = MString_cappend(mcontents, ",\"global\":[");
+    for (cl_uint iterator = 0; iterator < settings->work.dimensions; ++iterator) {
+      char number[32];
+      snprintf(number, sizeof number, "%s%zu", iterator > 0 ? "," : "", settings->work.global[iterator]);
+      mcontents = MString_cappend(mcontents, number);
+    }
+    mcontents = MString_cappend(mcontents, "],\"devices\":[");
+  }
+  else {
+    mcontents = MString_cappend(mcontents, "// Local work sizes of kernel ");
+    mcontents = MString_append(mcontents, kernel);
+    mcontents = MString_cappend(mcontents, " tuned by clcc per device and driver version (median time in us)\n"
+                                "//\n// Generated file, do not edit.\n\n#ifndef CLCC_TUNED_");
+    mcontents = MString_append(mcontents, kernel);
+    mcontents = MString_cappend(mcontents, "_H\n#define CLCC_TUNED_");
+    mcontents = MString_append(mcontents, kernel);
+    mcontents = MString_cappend(mcontents, "_H\n\n#include <stddef.h>\n\nstatic const struct {\n"
+                                "  const char* device;\n  const char* driver;\n  unsigned int dimensions;\n"
+                                "  size_t local[3];\n  double median;\n} clcc_tuned_");
+    mcontents = MString_append(mcontents, kernel);
+    mcontents = MString_cappend(mcontents, "[] = {\n");
+  }
+
+  int first = 1;
+
+  for (size_t builds_iterator = 0; builds_iterator < builds.number; ++builds_iterator) {
+    const Build build = builds.elements[builds_iterator];
+    char numbers[128];
+
+    if (build.run.runs == 0)
+      continue;
+
+    const String driver = DeviceInfoDriverVersion(build.device_id);
+
+    if (json) {
+      mcontents = MString_cappend(mcontents, first ? "{\"platform\":" : ",{\"platform\":");
+      mcontents = MString_appendJSON(mcontents, build.platform_name);
+      mcontents = MString_cappend(mcontents, ",\"device\":");
+      mcontents = MString_appendJSON(mcontents, build.device_name);
+      mcontents = MString_cappend(mcontents, ",\"driver\":");
+      mcontents = MString_appendJSON(mcontents, driver);
+      mcontents = MString_cappend(mcontents, ",\"local\":[");
+      mcontents = Run_appendLocal(mcontents, build.run.work, ",");
+      snprintf(numbers, sizeof numbers, "],\"median_us\":%.3f}", build.run.median/1e3);
+      mcontents = MString_cappend(mcontents, numbers);
+    }
+    else {
+      // Names go in string literals the same way as JSON strings
+      mcontents = MString_cappend(mcontents, "  { ");
+      mcontents = MString_appendJSON(mcontents, build.device_name);
+      mcontents = MString_cappend(mcontents, ", ");
+      mcontents = MString_appendJSON(mcontents, driver);
+      snprintf(numbers, sizeof numbers, ", %u, { ", (unsigned int)build.run.work.local_dimensions);
+      mcontents = MString_cappend(mcontents, numbers);
+      mcontents = Run_appendLocal(mcontents, build.run.work, ", ");
+      snprintf(numbers, sizeof numbers, " }, %.3f },\n", build.run.median/1e3);
+      mcontents = MString_cappend(mcontents, numbers);
+    }
+    first = 0;
+  }
+
+  mcontents = MString_cappend(mcontents, json ? "]}\n" : "};\n\n#endif\n");
+
+  const String contents = MString_freeze(mcontents);
+  String_fileWrite(name, contents);
+  String_free(contents);
+  String_free(name);
+}
+
+// Vector of math option variants
+static VectorRunVariant VectorRunVariant_raw(const size_t number, RunVariant* const elements) {
+  const VectorRunVariant vector = { number, elements };
+  return vector;
+}
+
+static void VectorRunVariant_free(const VectorRunVariant vector) {
+  for (size_t iterator = 0; iterator < vector.number; ++iterator)
+    String_free(vector.elements[iterator].options);
+  Memory_free(vector.elements);
+}
+
+
+// Build the program for the device with every combination of math options and run the kernel with each (the first
+// variant is the strict build the errors are against)
+//
+// Combinations with an option another one in them implies are left out as they build the same. The builds are all
+// started before waiting for any so drivers that build asynchronously can do them in parallel.
+static VectorRunVariant Run_tuneMath(const cl_context context, const cl_platform_id platform_id,
+                                     const cl_device_id device, const VectorString codes,
+                                     const VectorString build_options, const Settings* const settings) {
+  static const char* const math_options[] = {
+    "-cl-mad-enable", "-cl-no-signed-zeros", "-cl-finite-math-only", "-cl-denorms-are-zero",
+    "-cl-unsafe-math-optimizations", "-cl-fast-relaxed-math"
+  };
+  static const unsigned int math_implied[] = { 0, 0, 0, 0, 0x3, 0x17 };
+  const size_t math_number = sizeof math_options/sizeof *math_options;
+
+  // Options other than the math ones apply to all the variants
+  MVectorString mbase = MVectorString_empty();
+  for (size_t iterator = 0; iterator < build_options.number; ++iterator) {
+    int math = 0;
+    for (size_t math_iterator = 0; math_iterator < math_number; ++math_iterator)
+      math = math || String_ccompare(build_options.elements[iterator], math_options[math_iterator]) == 0;
+    if (!math)
+      mbase = MVectorString_pushRaw(mbase, build_options.elements[iterator]);
+  }
+  const VectorString base = MVectorString_freeze(mbase);
+
+  // Start the builds
+  RunVariant* variants;
+  cl_program programs[1 << math_number];
+  size_t variants_number = 0;
+  RunBuilds builds = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, platform_id, device, Stats_clock() };
+
+  if ( (variants = (RunVariant*)Memory_allocate(sizeof *variants << math_number)) == 0 )
+    Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for math option variants",
+                   sizeof *variants << math_number);
+
+  for (unsigned int combination = 0; combination < 1u << math_number; ++combination) {
+    int implied = 0;
+    for (size_t math_iterator = 0; math_iterator < math_number; ++math_iterator)
+      implied = implied || (combination & 1u << math_iterator && combination & math_implied[math_iterator]);
+    if (implied)
+      continue;
+
+    MVectorString mmath = MVectorString_empty();
+    for (size_t math_iterator = 0; math_iterator < math_number; ++math_iterator)
+      if (combination & 1u << math_iterator)
+        mmath = MVectorString_pushRaw(mmath, String_raw(strlen(math_options[math_iterator]),
+                                                         math_options[math_iterator]));
+    const VectorString math = MVectorString_freeze(mmath);
+
+    MVectorString moptions = MVectorString_empty();
+    for (size_t iterator = 0; iterator < base.number; ++iterator)
+      moptions = MVectorString_pushRaw(moptions, base.elements[iterator]);
+    for (size_t iterator = 0; iterator < math.number; ++iterator)
+      moptions = MVectorString_pushRaw(moptions, math.elements[iterator]);
+    const VectorString options = MVectorString_freeze(moptions);
+
+    RunVariant* const variant = &variants[variants_number];
+    variant->options = String_cintercalate(" ", math);
+    variant->ulp = NAN;
+    variant->relative = NAN;
+
+    // Pending first as the driver may notify before returning
+    pthread_mutex_lock(&builds.mutex);
+    ++builds.pending;
+    pthread_mutex_unlock(&builds.mutex);
+
+    programs[variants_number++] = CL_programCreate(context, VectorCLDevice_raw(1, &device), codes, options,
+                                                   Run_notify, &builds, &variant->status);
+    if (variant->status != CL_SUCCESS) {
+      pthread_mutex_lock(&builds.mutex);
+      --builds.pending;
+      pthread_mutex_unlock(&builds.mutex);
+    }
+
+    VectorString_freeViews(options);
+    VectorString_freeViews(math);
+  }
+
+  VectorString_freeViews(base);
+
+  pthread_mutex_lock(&builds.mutex);
+  while (builds.pending > 0)
+    pthread_cond_wait(&builds.built, &builds.mutex);
+  pthread_mutex_unlock(&builds.mutex);
+
+  // Run them one at a time so they are timed on their own
+  String reference = String_raw(0, 0);
+
+  for (size_t iterator = 0; iterator < variants_number; ++iterator) {
+    RunVariant* const variant = &variants[iterator];
+    const Run none = { 0, 0, 0, 0, 0, settings->work };
+    String outputs;
+
+    if (variant->status == CL_SUCCESS)
+      variant->status = CL_programStatus(programs[iterator], device);
+    variant->run = none;
+
+    if (variant->status == CL_SUCCESS) {
+      variant->run = Run_kernel(context, programs[iterator], device, settings, settings->work, &outputs);
+
+      if (iterator == 0)
+        reference = outputs;
+      else {
+        if (reference.number > 0 && variant->run.runs > 0)
+          Run_errors(reference, outputs, &variant->ulp, &variant->relative);
+        String_free(outputs);
+      }
+    }
+    CL_programFree(programs[iterator]);
+  }
+
+  // Errors are only known if the kernel has buffers
+  if (reference.number > 0) {
+    variants[0].ulp = 0;
+    variants[0].relative = 0;
+  }
+  String_free(reference);
+
+  return VectorRunVariant_raw(variants_number, variants);
+}
+
+// Record the build of a variant as completed
+static void CL_CALLBACK Run_notify(const cl_program program, void* const data) {
+  RunBuilds* const builds = (RunBuilds*)data;
+  (void)program;
+
+  Stats_record(StatsPhase_BUILD, builds->platform_id, builds->device_id, builds->started);
+
+  pthread_mutex_lock(&builds->mutex);
+  --builds->pending;
+  pthread_cond_signal(&builds->built);
+  pthread_mutex_unlock(&builds->mutex);
+}
+
+
+// Largest errors of the buffers of outputs taken as floats against those of reference
+//
+// Floats that are not finite in the reference are skipped as options like -cl-finite-math-only leave them undefined.
+static void Run_errors(const String reference, const String outputs, double* const ulp, double* const relative) {
+  const size_t number = (reference.number < outputs.number ? reference.number : outputs.number) / sizeof(float);
+
+  *ulp = 0;
+  *relative = 0;
+
+  for (size_t iterator = 0; iterator < number; ++iterator) {
+    float expected;
+    float actual;
+    memcpy(&expected, &reference.elements[iterator * sizeof expected], sizeof expected);
+    memcpy(&actual, &outputs.elements[iterator * sizeof actual], sizeof actual);
+
+    if (!isfinite(expected))
+      continue;
+    if (!isfinite(actual)) {
+      *ulp = INFINITY;
+      *relative = INFINITY;
+      continue;
+    }
+
+    // Floats are in order as sign and magnitude integers (negative ones are counted down from zero)
+    int32_t expected_bits;
+    int32_t actual_bits;
+    memcpy(&expected_bits, &expected, sizeof expected_bits);
+    memcpy(&actual_bits, &actual, sizeof actual_bits);
+
+    const long long expected_order = expected_bits < 0 ? (long long)INT32_MIN - expected_bits : expected_bits;
+    const long long actual_order = actual_bits < 0 ? (long long)INT32_MIN - actual_bits : actual_bits;
+    const double ulps = llabs(expected_order - actual_order);
+    const double error = fabs((double)actual - expected) / (expected != 0 ? fabs(expected) : 1);
+
+    if (ulps > *ulp)
+      *ulp = ulps;
+    if (error > *relative)
+      *relative = error;
+  }
+}
+
+
+// Print the runs of the math option variants of the successful builds to stdout (speed ups are against the strict
+// build and numbers that are not known are dashes)
+static void Run_reportMath(const VectorBuild builds) {
+  int platform_width = strlen("Platform");
+  int device_width = strlen("Device");
+  int options_width = strlen("Options");
+  size_t variants_number = 0;
+
+  for (size_t iterator = 0; iterator < builds.number; ++iterator) {
+    const Build build = builds.elements[iterator];
+
+    if (build.variants.number == 0)
+      continue;
+    if ((int)build.platform_name.number > platform_width)
+      platform_width = build.platform_name.number;
+    if ((int)build.device_name.number > device_width)
+      device_width = build.device_name.number;
+    for (size_t variants_iterator = 0; variants_iterator < build.variants.number; ++variants_iterator)
+      if ((int)build.variants.elements[variants_iterator].options.number > options_width)
+        options_width = build.variants.elements[variants_iterator].options.number;
+    variants_number += build.variants.number;
+  }
+
+  if (variants_number == 0)
+    return;
+
+  printf("%-*s  %-*s  %-*s  %12s  %8s  %10s  %13s\n", platform_width, "Platform", device_width, "Device",
+         options_width, "Options", "Median us", "Speed up", "Max ULP", "Max rel error");
+  for (size_t iterator = 0; iterator < builds.number; ++iterator) {
+    const Build build = builds.elements[iterator];
+
+    for (size_t variants_iterator = 0; variants_iterator < build.variants.number; ++variants_iterator) {
+      const RunVariant variant = build.variants.elements[variants_iterator];
+      const Run strict = build.variants.elements[0].run;
+      const String options = variant.options.number > 0 ? variant.options : String_raw(8, "(strict)");
+      char median[32] = "-";
+      char speedup[32] = "-";
+      char ulp[32] = "-";
+      char relative[32] = "-";
+
+      if (variant.status != CL_SUCCESS)
+        snprintf(median, sizeof median, "build failed");
+      else if (variant.run.runs > 0) {
+        snprintf(median, sizeof median, "%.3f", variant.run.median/1e3);
+        if (strict.runs > 0 && variant.run.median > 0)
+          snprintf(speedup, sizeof speedup, "%.2fx", (double)strict.median / variant.run.median);
+      }
+      if (!isnan(variant.ulp))
+        snprintf(ulp, sizeof ulp, "%.0f", variant.ulp);
+      if (!isnan(variant.relative))
+        snprintf(relative, sizeof relative, "%.3g", variant.relative);
+
+      printf("%-*.*s  %-*.*s  %-*.*s  %12s  %8s  %10s  %13s\n",
+             platform_width, (int)build.platform_name.number, build.platform_name.elements,
+             device_width, (int)build.device_name.number, build.device_name.elements,
+             options_width, (int)options.number, options.elements, median, speedup, ulp, relative);
+    }
+  }
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Specialization (definitions of the properties of the device a build is for so code can be tuned to it)
+
+// Options with -D definitions of CLCC_ and the name of each property (without CL_DEVICE_) for the numbers that
+// describe the device's hardware and CLCC_HAS_ and the name of each of its extensions (returns copies)
+static VectorString Specialize_options(const VectorString options, const cl_device_id device_id) {
+  MVectorString moptions = MVectorString_empty();
+  moptions = MVectorString_append(moptions, options);
+
+  // Numbers are the scalar properties but the excluded ones
+#define Specialize_number(ID, NAME, IDENT)                                                                \
+  if (!Specialize_excluded(ID))                                                                         \
+    moptions = Specialize_appendNumber(moptions, NAME + strlen("CL_DEVICE_"), DeviceInfo##IDENT(device_id));
+#define Specialize_none(ID, NAME, IDENT)
+
+#define Specialize_DeviceId                Specialize_none
+#define Specialize_PlatformId              Specialize_none
+#define Specialize_DeviceType              Specialize_none
+#define Specialize_FPConfig                Specialize_none
+#define Specialize_MemCacheType            Specialize_none
+#define Specialize_MemLocalType            Specialize_none
+#define Specialize_ExecCapabilities        Specialize_none
+#define Specialize_QueueProperties         Specialize_none
+#define Specialize_AffinityDomain          Specialize_none
+#define Specialize_Bool                    Specialize_number
+#define Specialize_UInt                    Specialize_number
+#define Specialize_ULong                   Specialize_number
+#define Specialize_Size                    Specialize_number
+#define Specialize_String                  Specialize_none
+#define Specialize_VectorSize              Specialize_none
+#define Specialize_VectorColon             Specialize_none
+#define Specialize_VectorSpace             Specialize_none
+#define Specialize_VectorPartitionProperty Specialize_none
+
+#define CL_DEVICE_PROPERTY(ID, IDENT, TYPE, GROUP, DESC) \
+  Specialize_##GROUP(ID, #ID, IDENT)
+#include "cldeviceprop.h"
+#undef CL_DEVICE_PROPERTY
+
+#undef Specialize_number
+#undef Specialize_none
+
+  // Extensions (characters that can't be in a macro name are underscores)
+  const VectorString extensions = DeviceInfoExtensions(device_id);
+
+  for (size_t iterator = 0; iterator < extensions.number; ++iterator) {
+    const String extension = extensions.elements[iterator];
+    MString mdefine = MString_cappend(MString_empty(), "CLCC_HAS_");
+
+    if (extension.number == 0)
+      continue;
+    mdefine = MString_append(mdefine, extension);
+    for (size_t define_iterator = strlen("CLCC_HAS_"); define_iterator < mdefine.number; ++define_iterator)
+      if (!isalnum((unsigned char)mdefine.elements[define_iterator]))
+        mdefine.elements[define_iterator] = '_';
+    mdefine = MString_cappend(mdefine, "=1");
+
+    moptions = MVectorString_cpush(moptions, "-D");
+    moptions = MVectorString_pushRaw(moptions, MString_freeze(mdefine));
+  }
+
+  return MVectorString_freeze(moptions);
+}
+
+// Whether the property is left out of the definitions
+static int Specialize_excluded(const cl_device_info property) {
+  for (size_t iterator = 0; iterator < sizeof Specialize_exclusions / sizeof *Specialize_exclusions; ++iterator)
+    if (Specialize_exclusions[iterator] == property)
+      return 1;
+  return 0;
+}
+
+// Append definition of CLCC_ and name as value
+static MVectorString Specialize_appendNumber(MVectorString moptions, const char* const name,
+                                             const unsigned long long value) {
+  char define[128];
+  snprintf(define, sizeof define, "CLCC_%s=%llu", name, value);
+
+  moptions = MVectorString_cpush(moptions, "-D");
+  return MVectorString_cpush(moptions, define);
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Jobs
+
+// Construct job for consecutive builds
+static Job Job_raw(Build* const builds, const size_t builds_number, Workers* const workers) {
+  const Job job = { builds, builds_number, 0, 0, 0, 0, JobState_WAITING, workers, 0, VectorString_raw(0, 0),
+                    VectorString_raw(0, 0) };
+  return job;
+}
+
+
+// Fill in cached builds and start building the rest for all of them at once (returns true if notify will be called)
+static int Job_begin(Job* const job, const VectorString codes, const Settings* const settings,
+                     void (CL_CALLBACK* const notify)(cl_program, void*)) {
+  // Use cached results where this exact build has been done before
+  cl_device_id pending_devices[job->builds_number];
+  size_t pending_number = 0;
+
+  job->codes = codes;
+  job->options = settings->specialize ? Specialize_options(settings->options, job->builds[0].device_id) :
+    settings->options;
+
+  if ( (job->keys = (String*)Memory_allocate(sizeof *job->keys * job->builds_number)) == 0 &&
+       job->builds_number != 0 )
+    Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for cache keys",
+                   sizeof *job->keys * job->builds_number);
+  if ( (job->cached = (int*)Memory_allocate(sizeof *job->cached * job->builds_number)) == 0 &&
+       job->builds_number != 0 )
+    Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for cache flags",
+                   sizeof *job->cached * job->builds_number);
+
+  for (size_t iterator = 0; iterator < job->builds_number; ++iterator) {
+    job->keys[iterator] = String_raw(0, 0);
+    job->cached[iterator] = 0;
+
+    if (MaybeString_isJust(settings->cache) && !settings->separate) {
+      job->keys[iterator] = Cache_key(codes, job->options, job->builds[iterator]);
+
+      // Kernels are only inspected or run with a program so they never take results from the cache
+      if (!settings->kernels && MaybeString_isNothing(settings->run) &&
+          (job->cached[iterator] = Cache_load(MaybeString_assert(settings->cache), job->keys[iterator],
+                                              &job->builds[iterator])) )
+        continue;
+    }
+
+    pending_devices[pending_number++] = job->builds[iterator].device_id;
+  }
+
+#ifdef CL_VERSION_1_2
+  // Link objects of the sources compiled on their own instead (these are cached rather than the whole builds)
+  if (settings->separate) {
+    Job_separate(job, codes, settings);
+    return 0;
+  }
+#endif // CL_VERSION_1_2
+
+  if (pending_number == 0)
+    return 0;
+
+  // Build for the rest all at once
+  const VectorCLDevice devices = VectorCLDevice_raw(pending_number, pending_devices);
+  job->context = job->builds[0].context ? job->builds[0].context :
+    CL_contextCreate(job->builds[0].platform_id, devices);
+
+  cl_int status;
+  job->started = Stats_clock();
+  job->program = CL_programCreate(job->context, devices, codes, job->options, notify, job, &status);
+
+  // Builds the driver refuses to start fail with the reason as their log (so one bad request to a server or job of
+  // a batch does not end the rest) and are marked complete so they are not cached
+  if (status != CL_SUCCESS && status != CL_BUILD_PROGRAM_FAILURE) {
+    for (size_t iterator = 0; iterator < job->builds_number; ++iterator)
+      if (!job->cached[iterator]) {
+        MString mlog = MString_cappend(MString_empty(), "Unable to build program: ");
+        mlog = MString_cappend(mlog, Error_stringCL(status));
+        job->builds[iterator].status = status;
+        job->builds[iterator].log = MString_freeze(MString_push(mlog, '\n'));
+        job->cached[iterator] = 1;
+      }
+
+    CL_programFree(job->program);
+    if (!job->builds[0].context)
+      CL_contextFree(job->context);
+    job->program = 0;
+    job->context = 0;
+    return 0;
+  }
+
+  return notify && status == CL_SUCCESS;
+}
+
+
+// Record status, log, and (if requested or caching) binary of the finished build and release it
+static void Job_end(Job* const job, const Settings* const settings) {
+  const int binary = MaybeString_isJust(settings->binary) || MaybeString_isJust(settings->cache);
+
+  if (job->program) {
+    // Binaries are in the order of the program's devices (possibly more than were built)
+    VectorCLDevice program_devices = VectorCLDevice_raw(0, 0);
+    VectorString binaries = VectorString_raw(0, 0);
+
+    for (size_t builds_iterator = 0; builds_iterator < job->builds_number; ++builds_iterator) {
+      Build* const build = &job->builds[builds_iterator];
+
+      if (job->cached[builds_iterator])
+        continue;
+
+      build->status = CL_programStatus(job->program, build->device_id);
+      build->log = CL_programLog(job->program, build->device_id);
+      if (build->status == CL_SUCCESS && settings->kernels)
+        build->kernels = CL_programKernels(job->program, build->device_id);
+      if (build->status == CL_SUCCESS && settings->tune_math)
+        build->variants = Run_tuneMath(job->context, build->platform_id, build->device_id, job->codes,
+                                       job->options, settings);
+      else if (build->status == CL_SUCCESS && MaybeString_isJust(settings->run))
+        build->run = settings->tune ? Run_tune(job->context, job->program, build->device_id, settings) :
+          Run_kernel(job->context, job->program, build->device_id, settings, settings->work, 0);
+
+      if (build->status == CL_SUCCESS && binary) {
+        if (program_devices.number == 0) {
+          program_devices = CL_programDevices(job->program);
+          binaries = CL_programBinaries(job->program);
+          if (binaries.number != program_devices.number)
+            Error_die(EX_SOFTWARE, "Expecting %zd program binaries but got %zd",
+                      program_devices.number, binaries.number);
+        }
+        for (size_t iterator = 0; iterator < program_devices.number; ++iterator)
+          if (program_devices.elements[iterator] == build->device_id)
+            build->binary = String_string(binaries.elements[iterator]);
+      }
+    }
+
+    VectorString_free(binaries);
+    VectorCLDevice_free(program_devices);
+
+    CL_programFree(job->program);
+    if (!job->builds[0].context)
+      CL_contextFree(job->context);
+  }
+
+  // Remember new results
+  for (size_t iterator = 0; iterator < job->builds_number; ++iterator) {
+    if (MaybeString_isJust(settings->cache) && !job->cached[iterator])
+      Cache_store(MaybeString_assert(settings->cache), job->keys[iterator], job->builds[iterator]);
+    String_free(job->keys[iterator]);
+  }
+
+  if (settings->specialize)
+    VectorString_free(job->options);
+
+  Memory_free(job->keys);
+  Memory_free(job->cached);
+  job->options = VectorString_raw(0, 0);
+  job->program = 0;
+  job->context = 0;
+  job->keys = 0;
+  job->cached = 0;
+}
+
+
+#ifdef CL_VERSION_1_2
+// Fill in the builds by compiling each source on its own (unless an object of it is kept from before) and linking
+// the objects (builds are all marked cached as they are complete and their objects are what is kept)
+static void Job_separate(Job* const job, const VectorString codes, const Settings* const settings) {
+  const int binary = MaybeString_isJust(settings->binary) || MaybeString_isJust(settings->cache);
+  // Build_codes gives a line directive in three parts per source (other codes are taken as a single source)
+  const size_t source_parts = codes.number % 4 == 0 ? 4 : codes.number;
+  const size_t sources_number = source_parts > 0 ? codes.number / source_parts : 0;
+
+  cl_device_id devices[job->builds_number];
+  for (size_t iterator = 0; iterator < job->builds_number; ++iterator)
+    devices[iterator] = job->builds[iterator].device_id;
+
+  const cl_context context = job->builds[0].context ? job->builds[0].context :
+    CL_contextCreate(job->builds[0].platform_id, VectorCLDevice_raw(job->builds_number, devices));
+
+  job->started = Stats_clock();
+
+  for (size_t builds_iterator = 0; builds_iterator < job->builds_number; ++builds_iterator) {
+    Build* const build = &job->builds[builds_iterator];
+    cl_program objects[sources_number];
+    size_t objects_number = 0;
+    MString mlog = MString_empty();
+
+    // Objects (only sources that changed are compiled)
+    build->status = CL_SUCCESS;
+
+    for (size_t sources_iterator = 0; sources_iterator < sources_number; ++sources_iterator) {
+      const VectorString code = VectorString_raw(source_parts, &codes.elements[source_parts*sources_iterator]);
+      const String key = Object_key(code, job->options, *build);
+      const String slot = Object_slot(code, job->options, *build);
+      Build object = Build_raw(build->platform_id, String_raw(0, 0), build->device_id, String_raw(0, 0));
+
+      if (!Object_load(settings, slot, key, &object)) {
+        const cl_program program = CL_programCompile(context, build->device_id, code, job->options);
+
+        object.status = CL_programStatus(program, build->device_id);
+        object.log = CL_programLog(program, build->device_id);
+        if (object.status == CL_SUCCESS)
+          object.binary = CL_programBinary(program, build->device_id);
+        CL_programFree(program);
+
+        Object_store(settings, slot, key, object);
+      }
+
+      mlog = MString_append(mlog, object.log);
+      if (object.status != CL_SUCCESS)
+        build->status = CL_BUILD_PROGRAM_FAILURE;
+      else if (build->status == CL_SUCCESS)
+        objects[objects_number++] = CL_programObject(context, build->device_id, object.binary);
+
+      Build_free(object);
+      String_free(slot);
+      String_free(key);
+    }
+
+    // Program
+    if (build->status == CL_SUCCESS) {
+      cl_int status;
+      const cl_program program = CL_programLink(context, build->device_id, job->options,
+                                                objects, objects_number, &status);
+
+      if (program) {
+        const String log = CL_programLog(program, build->device_id);
+
+        build->status = CL_programStatus(program, build->device_id);
+        mlog = MString_append(mlog, log);
+        if (build->status == CL_SUCCESS && binary)
+          build->binary = CL_programBinary(program, build->device_id);
+        if (build->status == CL_SUCCESS && settings->kernels)
+          build->kernels = CL_programKernels(program, build->device_id);
+        if (build->status == CL_SUCCESS && settings->tune_math)
+          build->variants = Run_tuneMath(context, build->platform_id, build->device_id, codes, job->options,
+                                         settings);
+        else if (build->status == CL_SUCCESS && MaybeString_isJust(settings->run))
+          build->run = settings->tune ? Run_tune(context, program, build->device_id, settings) :
+            Run_kernel(context, program, build->device_id, settings, settings->work, 0);
+
+        String_free(log);
+        CL_programFree(program);
+      }
+      else
+        build->status = CL_BUILD_PROGRAM_FAILURE;
+    }
+
+    for (size_t iterator = 0; iterator < objects_number; ++iterator)
+      CL_programFree(objects[iterator]);
+
+    build->log = MString_freeze(mlog);
+    job->cached[builds_iterator] = 1;
+  }
+
+  if (!job->builds[0].context)
+    CL_contextFree(context);
+}
+#endif // CL_VERSION_1_2
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Workers
+
+// Run builds using up to jobs threads (the calling thread does it all if only one) or, if asynchronous, with up to
+// jobs builds in progress from the calling thread (returns number of failures if reporting)
+//
+// Builds are run in groups of consecutive builds for the same platform if sharing contexts and individually otherwise
+// (or if specializing as the options are then different for each device).
+// Reporting is done in device order as soon as all the earlier groups are done so it overlaps with later builds.
+static size_t Workers_run(const MVectorBuild builds, const VectorString codes, const Settings* const settings,
+                          const int report) {
+  Job jobs[builds.number > 0 ? builds.number : 1];
+  Workers workers = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0, jobs, report, 0, codes, settings };
+
+  for (size_t start = 0, end; start < builds.number; start = end) {
+    end = start+1;
+    if (settings->share && !settings->specialize)
+      while (end < builds.number && builds.elements[end].platform_id == builds.elements[start].platform_id)
+        ++end;
+
+    jobs[workers.jobs_number++] = Job_raw(&builds.elements[start], end-start, &workers);
+  }
+
+  const size_t threads_number = settings->jobs < workers.jobs_number ? settings->jobs : workers.jobs_number;
+
+  if (settings->async)
+    Workers_async(&workers);
+  else if (threads_number <= 1)
+    Workers_thread(&workers);
+  else {
+    pthread_t threads[threads_number];
+
+    for (size_t iterator = 0; iterator < threads_number; ++iterator) {
+      int status;
+      if ( (status = pthread_create(&threads[iterator], 0, Workers_thread, &workers)) != 0 )
+        Error_dieErrno(status, EX_OSERR, "Unable to create worker thread");
+    }
+
+    for (size_t iterator = 0; iterator < threads_number; ++iterator) {
+      int status;
+      if ( (status = pthread_join(threads[iterator], 0)) != 0 )
+        Error_dieErrno(status, EX_OSERR, "Unable to join worker thread");
+    }
+  }
+
+  pthread_cond_destroy(&workers.built);
+  pthread_mutex_destroy(&workers.mutex);
+
+  return workers.failures;
+}
+
+
+// Take jobs from the shared pool and run them to completion until there are none left
+static void* Workers_thread(void* const data) {
+  Workers* const workers = (Workers*)data;
+
+  for (;;) {
+    size_t index;
+
+    pthread_mutex_lock(&workers->mutex);
+    index = workers->next++;
+    pthread_mutex_unlock(&workers->mutex);
+
+    if (index >= workers->jobs_number)
+      break;
+
+    Job* const job = &workers->jobs[index];
+
+    Job_begin(job, workers->codes, workers->settings, 0);
+    Job_end(job, workers->settings);
+
+    pthread_mutex_lock(&workers->mutex);
+    job->state = JobState_DONE;
+    Workers_report(workers);
+    pthread_mutex_unlock(&workers->mutex);
+  }
+
+  return 0;
+}
+
+
+// Event loop starting jobs while fewer than jobs are in progress and finishing them as the driver completes them
+static void Workers_async(Workers* const workers) {
+  size_t running = 0;
+
+  pthread_mutex_lock(&workers->mutex);
+
+  while (workers->reported < workers->jobs_number) {
+    // Start another job if there is room (the driver may complete it before Job_begin returns)
+    if (workers->next < workers->jobs_number && running < workers->settings->jobs) {
+      Job* const job = &workers->jobs[workers->next++];
+
+      job->state = JobState_BUILDING;
+      ++running;
+
+      pthread_mutex_unlock(&workers->mutex);
+      const int pending = Job_begin(job, workers->codes, workers->settings, Workers_notify);
+      pthread_mutex_lock(&workers->mutex);
+
+      if (!pending)
+        job->state = JobState_BUILT;
+      continue;
+    }
+
+    // Finish a completed job
+    Job* job = 0;
+
+    for (size_t iterator = workers->reported; iterator < workers->next && !job; ++iterator)
+      if (workers->jobs[iterator].state == JobState_BUILT)
+        job = &workers->jobs[iterator];
+
+    if (job) {
+      pthread_mutex_unlock(&workers->mutex);
+      Job_end(job, workers->settings);
+      pthread_mutex_lock(&workers->mutex);
+
+      job->state = JobState_DONE;
+      --running;
+      Workers_report(workers);
+      continue;
+    }
+
+    // Wait on the driver
+    int status;
+    if ( (status = pthread_cond_wait(&workers->built, &workers->mutex)) != 0 )
+      Error_dieErrno(status, EX_OSERR, "Unable to wait on builds");
+  }
+
+  pthread_mutex_unlock(&workers->mutex);
+}
+
+
+// Build completion callback (called by the driver, possibly from its own thread, so only records it)
+static void CL_CALLBACK Workers_notify(const cl_program program, void* const data) {
+  Job* const job = (Job*)data;
+  Workers* const workers = job->workers;
+  (void)program;
+
+  Stats_record(StatsPhase_BUILD, job->builds[0].platform_id,
+               job->builds_number == 1 ? job->builds[0].device_id : 0, job->started);
+
+  // Span of the whole build as the clBuildProgram event only covers starting it
+  if (Trace_current) {
+    cl_device_id devices[job->builds_number];
+    cl_uint devices_number = 0;
+    for (size_t iterator = 0; iterator < job->builds_number; ++iterator)
+      if (!job->cached[iterator])
+        devices[devices_number++] = job->builds[iterator].device_id;
+
+    Trace_event("Build completed", job->started, Stats_clock(),
+                Trace_argDevices(MString_empty(), devices_number, devices));
+  }
+
+  pthread_mutex_lock(&workers->mutex);
+  job->state = JobState_BUILT;
+  pthread_cond_signal(&workers->built);
+  pthread_mutex_unlock(&workers->mutex);
+}
+
+
+// Report jobs in order as far as they are done (called holding the mutex)
+static void Workers_report(Workers* const workers) {
+  while (workers->reported < workers->jobs_number &&
+         workers->jobs[workers->reported].state == JobState_DONE) {
+    const Job job = workers->jobs[workers->reported];
+
+    // Binary names depend on all the builds (the jobs' builds are consecutive)
+    if (workers->report) {
+      const Job last = workers->jobs[workers->jobs_number-1];
+      const VectorBuild builds = { last.builds + last.builds_number - workers->jobs[0].builds,
+                                   workers->jobs[0].builds };
+      const size_t start = job.builds - builds.elements;
+      workers->failures += Build_report(builds, start, start + job.builds_number, workers->settings->binary);
+    }
+
+    ++workers->reported;
+  }
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Cache (one file per build named by the hash of everything that goes into it)
+//
+//   "clcc-cache 1 <status> <log size> <binary size>\n" <log> <binary>
+//
+
+// Key covers the source codes (including #line directives), options, and driver identity
+static String Cache_key(const VectorString codes, const VectorString options, const Build build) {
+  Hash hash = Hash_initial();
+
+  hash = Hash_cappend(hash, "clcc-cache 1");
+
+  {
+    char number[32];
+    snprintf(number, sizeof number, "%zu", codes.number);
+    hash = Hash_field(hash, String_raw(strlen(number), number));
+  }
+  for (size_t iterator = 0; iterator < codes.number; ++iterator)
+    hash = Hash_field(hash, codes.elements[iterator]);
+
+  {
+    const String option = String_cintercalate(" ", options);
+    hash = Hash_field(hash, option);
+    String_free(option);
+  }
+
+  // Headers the codes include so editing one misses the entries built with it
+  {
+    const VectorString includes = Dependency_includes(codes, options);
+
+    for (size_t iterator = 0; iterator < includes.number; ++iterator) {
+      const String contents = String_map(includes.elements[iterator]);
+      hash = Hash_field(hash, includes.elements[iterator]);
+      hash = Hash_field(hash, contents);
+      String_unmap(contents);
+    }
+
+    VectorString_free(includes);
+  }
+
+  hash = Hash_field(hash, build.platform_name);
+  {
+    String (*const properties[])(cl_device_id) = {
+      DeviceInfoName, DeviceInfoVendor, DeviceInfoDriverVersion,
+      DeviceInfoVersion, DeviceInfoOpenCLCVersion
+    };
+
+    for (size_t iterator = 0; iterator < sizeof properties/sizeof *properties; ++iterator)
+      hash = Hash_field(hash, properties[iterator](build.device_id));
+  }
+
+  return Hash_final(hash);
+}
+
+
+static String Cache_name(const String directory, const String key) {
+  MString mname = MString_string(directory);
+  mname = MString_push(mname, '/');
+  mname = MString_append(mname, key);
+  mname = MString_cappend(mname, ".clcc");
+  return MString_freeze(mname);
+}
+
+
+static void Cache_create(const String directory) {
+  const char* cdirectory = CString_string(directory);
+
+  if (mkdir(cdirectory, 0777) < 0 && errno != EEXIST)
+    Error_dieErrno(errno, EX_CANTCREAT, "Unable to create cache directory \"%.*s\"",
+                   (int)directory.number, directory.elements);
+
+  CString_free(cdirectory);
+}
+
+
+// Fill in build from cache entry (returns if found and marks it as recently used)
+static int Cache_load(const String directory, const String key, Build* const build) {
+  const String name = Cache_name(directory, key);
+  const char* cname = CString_string(name);
+  struct stat entry_stat;
+  int found = 0;
+
+  if (stat(cname, &entry_stat) == 0) {
+    const String entry = String_file(name);
+    const char* const newline = (const char*)memchr(entry.elements, '\n', entry.number);
+
+    if (newline) {
+      const size_t header_size = newline - entry.elements + 1;
+      const char* cheader = CString_string(String_raw(header_size-1, entry.elements));
+      int status;
+      size_t log_size;
+      size_t binary_size;
+
+      if (sscanf(cheader, "clcc-cache 1 %d %zu %zu", &status, &log_size, &binary_size) == 3 &&
+          header_size + log_size + binary_size == entry.number) {
+        build->status = status;
+        build->log = String_string(String_raw(log_size, &entry.elements[header_size]));
+        build->binary = String_string(String_raw(binary_size, &entry.elements[header_size+log_size]));
+        found = 1;
+
+        utimensat(AT_FDCWD, cname, 0, 0);
+      }
+
+      CString_free(cheader);
+    }
+
+    String_free(entry);
+  }
+
+  CString_free(cname);
+  String_free(name);
+
+  return found;
+}
+
+
+// Write cache entry (via a temporary so concurrent readers never see a partial one)
+static void Cache_store(const String directory, const String key, const Build build) {
+  const String name = Cache_name(directory, key);
+
+  String entry;
+  {
+    char header[128];
+    snprintf(header, sizeof header, "clcc-cache 1 %d %zu %zu\n",
+             (int)build.status, build.log.number, build.binary.number);
+
+    MString mentry = MString_cstring(header);
+    mentry = MString_append(mentry, build.log);
+    mentry = MString_append(mentry, build.binary);
+    entry = MString_freeze(mentry);
+  }
+
+  String temporary;
+  {
+    char suffix[64];
+    snprintf(suffix, sizeof suffix, ".%ld.%lu", (long)getpid(), (unsigned long)pthread_self());
+    temporary = String_cappend(name, suffix);
+  }
+
+  String_fileWrite(temporary, entry);
+
+  {
+    const char* cname = CString_string(name);
+    const char* ctemporary = CString_string(temporary);
+
+    if (rename(ctemporary, cname) < 0)
+      Error_dieErrno(errno, EX_CANTCREAT, "Unable to move cache entry into place as \"%s\"", cname);
+
+    CString_free(ctemporary);
+    CString_free(cname);
+  }
+
+  String_free(temporary);
+  String_free(entry);
+  String_free(name);
+}
+
+
+// Remove least recently used entries until the cache is no bigger than size
+static void Cache_trim(const String directory, const unsigned long long size) {
+  CacheEntry* entries = 0;
+  size_t entries_number = 0;
+  unsigned long long total = 0;
+
+  // Gather entries
+  {
+    const char* cdirectory = CString_string(directory);
+    DIR* handle;
+
+    if ( (handle = opendir(cdirectory)) == 0 )
+      Error_dieErrno(errno, EX_NOINPUT, "Unable to open cache directory \"%s\"", cdirectory);
+
+    const struct dirent* dirent;
+    while ( (dirent = readdir(handle)) != 0 ) {
+      const String file = String_raw(strlen(dirent->d_name), dirent->d_name);
+
+      if (file.number < 5 || String_ccompare(String_raw(5, &file.elements[file.number-5]), ".clcc") != 0)
+        continue;
+
+      String name;
+      {
+        MString mname = MString_string(directory);
+        mname = MString_push(mname, '/');
+        mname = MString_append(mname, file);
+        name = MString_freeze(mname);
+      }
+      const char* cname = CString_string(name);
+      struct stat entry_stat;
+
+      if (stat(cname, &entry_stat) == 0) {
+        // Doubled when full (exactly when the number is zero or a power of two past the block size)
+        if (entries_number == 0 || (entries_number >= Vector_BLOCK && (entries_number & (entries_number-1)) == 0)) {
+          const size_t capacity = entries_number < Vector_BLOCK ? Vector_BLOCK : 2*entries_number;
+          if ( (entries = (CacheEntry*)Memory_reallocate(entries, sizeof *entries * capacity)) == 0 )
+            Error_dieErrno(errno, EX_OSERR, "Unable to expand cache entry list to %zd bytes",
+                           sizeof *entries * capacity);
+        }
+
+        const CacheEntry entry = { name, entry_stat.st_mtim, entry_stat.st_size };
+        entries[entries_number++] = entry;
+        total += entry_stat.st_size;
+      }
+      else
+        String_free(name);
+
+      CString_free(cname);
+    }
+
+    closedir(handle);
+    CString_free(cdirectory);
+  }
+
+  // Remove oldest first
+  qsort(entries, entries_number, sizeof *entries, Cache_compare);
+
+  for (size_t iterator = 0; iterator < entries_number; ++iterator) {
+    if (total > size) {
+      const char* cname = CString_string(entries[iterator].name);
+      if (unlink(cname) == 0 || errno == ENOENT)
+        total -= entries[iterator].size;
+      CString_free(cname);
+    }
+    String_free(entries[iterator].name);
+  }
+
+  Memory_free(entries);
+}
+
+
+static int Cache_compare(const void* const entry0, const void* const entry1) {
+  const struct timespec time0 = ((const CacheEntry*)entry0)->time;
+  const struct timespec time1 = ((const CacheEntry*)entry1)->time;
+
+  if (time0.tv_sec != time1.tv_sec)
+    return time0.tv_sec < time1.tv_sec ? -1 : 1;
+  if (time0.tv_nsec != time1.tv_nsec)
+    return time0.tv_nsec < time1.tv_nsec ? -1 : 1;
+  return 0;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Objects (each source compiled on its own for a device, kept in memory and, if caching, in the cache directory)
+
+#ifdef CL_VERSION_1_2
+// Key of the object compiled from the code of a single source (never that of a whole build of the same code)
+//
+// It covers the headers the source includes through Cache_key so a memoized object is not reused after one of them
+// is edited while watching, serving, or running a batch.
+static String Object_key(const VectorString code, const VectorString options, const Build build) {
+  const String program = Cache_key(code, options, build);
+  const String key = Hash_final(Hash_field(Hash_cappend(Hash_initial(), "clcc-object 1"), program));
+  String_free(program);
+  return key;
+}
+
+// Slot of the object (key of just the line directive and name leading the code so it ignores the contents)
+static String Object_slot(const VectorString code, const VectorString options, const Build build) {
+  return Object_key(VectorString_raw(code.number < 2 ? code.number : 2, code.elements), options, build);
+}
+
+
+// Fill in status, log, and binary of the object if kept in memory or cached (returns true if found)
+static int Object_load(const Settings* const settings, const String slot, const String key, Build* const object) {
+  int found = 0;
+
+  pthread_mutex_lock(&Object_mutex);
+  for (const Object* entry = Object_list; entry && !found; entry = entry->next)
+    if (String_compare(entry->key, key) == 0) {
+      object->status = entry->status;
+      object->log = String_string(entry->log);
+      object->binary = String_string(entry->binary);
+      found = 1;
+    }
+  pthread_mutex_unlock(&Object_mutex);
+
+  if (!found && MaybeString_isJust(settings->cache) &&
+      (found = Cache_load(MaybeString_assert(settings->cache), key, object)) )
+    Object_keep(slot, key, *object);
+
+  return found;
+}
+
+// Keep the object in memory and, if caching, in the cache
+static void Object_store(const Settings* const settings, const String slot, const String key, const Build object) {
+  Object_keep(slot, key, object);
+  if (MaybeString_isJust(settings->cache))
+    Cache_store(MaybeString_assert(settings->cache), key, object);
+}
+
+// Keep the object in memory in place of any other in the same slot
+//
+// Objects are kept for the life of the program so they are never allocated from the current arena.
+static void Object_keep(const String slot, const String key, const Build object) {
+  pthread_mutex_lock(&Object_mutex);
+  Arena* const arena = Arena_use(0);
+
+  Object* entry = Object_list;
+  while (entry && String_compare(entry->slot, slot) != 0)
+    entry = entry->next;
+
+  if (entry) {
+    String_free(entry->key);
+    String_free(entry->log);
+    String_free(entry->binary);
+  }
+  else {
+    if ( (entry = (Object*)Memory_allocate(sizeof *entry)) == 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for object", sizeof *entry);
+    entry->slot = String_string(slot);
+    entry->next = Object_list;
+    Object_list = entry;
+  }
+
+  entry->key = String_string(key);
+  entry->status = object.status;
+  entry->log = String_string(object.log);
+  entry->binary = String_string(object.binary);
+
+  Arena_use(arena);
+  pthread_mutex_unlock(&Object_mutex);
+}
+#endif // CL_VERSION_1_2
+
+
+static void Object_free() {
+  pthread_mutex_lock(&Object_mutex);
+
+  while (Object_list) {
+    Object* const entry = Object_list;
+    Object_list = entry->next;
+
+    String_free(entry->slot);
+    String_free(entry->key);
+    String_free(entry->log);
+    String_free(entry->binary);
+    Memory_free(entry);
+  }
+
+  pthread_mutex_unlock(&Object_mutex);
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Snapshot (regenerated when the fingerprint of the installed drivers changes)
+//
+//   "clcc-snapshot 1 <fingerprint>\n" <platforms number>
+//     (<platform name> <devices number> (<property status> <property value>)*)*
+//
+// with each field an 8 byte little endian length followed by that many bytes (numbers are in decimal).
+
+// Answer platform and device queries from the snapshot in the file (regenerating it from the driver if stale)
+static Snapshot* Snapshot_use(const String name) {
+  const String fingerprint = Snapshot_fingerprint();
+  Snapshot* snapshot = Snapshot_load(name, fingerprint);
+
+  if (!snapshot) {
+    snapshot = Snapshot_query();
+    Snapshot_store(name, fingerprint, snapshot);
+  }
+
+  String_free(fingerprint);
+
+  snapshot->name = String_string(name);
+  Snapshot_current = snapshot;
+  return snapshot;
+}
+
+static void Snapshot_free(Snapshot* const snapshot) {
+  if (!snapshot)
+    return;
+
+  if (Snapshot_current == snapshot)
+    Snapshot_current = 0;
+
+  for (size_t platforms_iterator = 0; platforms_iterator < snapshot->platforms_number; ++platforms_iterator) {
+    const SnapshotPlatform platform = snapshot->platforms[platforms_iterator];
+
+    for (size_t devices_iterator = 0; devices_iterator < platform.devices_number; ++devices_iterator)
+      for (size_t iterator = 0; iterator < SnapshotProperty_NUMBER; ++iterator)
+        String_free(platform.devices[devices_iterator].values[iterator]);
+
+    Memory_free(platform.devices);
+    String_free(platform.name);
+  }
+
+  Memory_free(snapshot->platforms);
+  String_free(snapshot->name);
+  Memory_free(snapshot);
+}
+
+
+// Fingerprint of the installed drivers (the ICD files and the libraries they name as the loader would find them)
+//
+// Libraries are only recognized as changed if they are named by absolute path (stat of anything else is the loader's
+// search path which is not reproduced here).
+static String Snapshot_fingerprint() {
+  Hash hash = Hash_cappend(Hash_initial(), "clcc-snapshot 1");
+
+  // Properties recorded
+  for (size_t iterator = 0; iterator < SnapshotProperty_NUMBER; ++iterator) {
+    char cid[32];
+    snprintf(cid, sizeof cid, "%lu", (unsigned long)SnapshotProperty_ids[iterator]);
+    hash = Hash_field(hash, String_raw(strlen(cid), cid));
+  }
+
+  // Loader environment (vendors is a directory or a single ICD file and filenames a colon separated library list)
+  const char* cvendors = getenv("OCL_ICD_VENDORS");
+  const char* const cfilenames = getenv("OCL_ICD_FILENAMES");
+
+  hash = Hash_field(hash, cvendors ? String_raw(strlen(cvendors), cvendors) : String_raw(0, 0));
+  hash = Hash_field(hash, cfilenames ? String_raw(strlen(cfilenames), cfilenames) : String_raw(0, 0));
+
+  if (!cvendors)
+    cvendors = "/etc/OpenCL/vendors";
+
+  // ICD files (sorted as directory order is arbitrary)
+  VectorString icds;
+  {
+    MVectorString micds = MVectorString_empty();
+    DIR* const directory = opendir(cvendors);
+
+    if (directory) {
+      const struct dirent* entry;
+
+      while ( (entry = readdir(directory)) ) {
+        const size_t length = strlen(entry->d_name);
+
+        if (length > 4 && strcmp(&entry->d_name[length-4], ".icd") == 0) {
+          MString mname = MString_cstring(cvendors);
+          mname = MString_push(mname, '/');
+          mname = MString_cappend(mname, entry->d_name);
+
+          micds = MVectorString_pushRaw(micds, MString_freeze(mname));
+        }
+      }
+
+      closedir(directory);
+    }
+    else if (errno == ENOTDIR)
+      micds = MVectorString_cpush(micds, cvendors);
+
+    icds = MVectorString_freeze(micds);
+  }
+
+  qsort((void*)icds.elements, icds.number, sizeof *icds.elements, Snapshot_compare);
+
+  for (size_t iterator = 0; iterator < icds.number; ++iterator) {
+    hash = Snapshot_hashFile(hash, icds.elements[iterator]);
+
+    // Library named by the file (stripped of surrounding whitespace)
+    const String contents = String_file(icds.elements[iterator]);
+    size_t start = 0;
+    size_t end = contents.number;
+
+    while (start < end && isspace((unsigned char)contents.elements[start]))
+      ++start;
+    while (end > start && isspace((unsigned char)contents.elements[end-1]))
+      --end;
+
+    hash = Snapshot_hashFile(hash, String_raw(end-start, &contents.elements[start]));
+
+    String_free(contents);
+  }
+
+  VectorString_free(icds);
+
+  // Libraries given directly
+  if (cfilenames) {
+    const VectorString libraries = String_csplit(":", String_raw(strlen(cfilenames), cfilenames));
+
+    for (size_t iterator = 0; iterator < libraries.number; ++iterator)
+      hash = Snapshot_hashFile(hash, libraries.elements[iterator]);
+
+    VectorString_freeViews(libraries);
+  }
+
+  return Hash_final(hash);
+}
+
+// Hash name and identity of file (name only if it does not exist)
+static Hash Snapshot_hashFile(Hash hash, const String name) {
+  const char* const cname = CString_string(name);
+  struct stat file_stat;
+  char cidentity[128] = "-";
+
+  if (stat(cname, &file_stat) == 0)
+    snprintf(cidentity, sizeof cidentity, "%llu %llu %lld %lld.%09ld",
+             (unsigned long long)file_stat.st_dev, (unsigned long long)file_stat.st_ino,
+             (long long)file_stat.st_size, (long long)file_stat.st_mtim.tv_sec, (long)file_stat.st_mtim.tv_nsec);
+
+  hash = Hash_field(hash, name);
+  hash = Hash_field(hash, String_raw(strlen(cidentity), cidentity));
+
+  CString_free(cname);
+
+  return hash;
+}
+
+
+// Snapshot of the driver's platforms and devices
+static Snapshot* Snapshot_query() {
+  Snapshot* snapshot;
+
+  if ( (snapshot = (Snapshot*)Memory_allocate(sizeof *snapshot)) == 0 )
+    Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for snapshot", sizeof *snapshot);
+
+  const VectorCLPlatform platforms = CL_platformsQuery();
+
+  snapshot->name = String_raw(0, 0);
+  snapshot->platforms_number = platforms.number;
+  if ( (snapshot->platforms = (SnapshotPlatform*)Memory_allocate(sizeof *snapshot->platforms *
+                                                                  platforms.number)) == 0 &&
+       platforms.number != 0 )
+    Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for snapshot platforms",
+                   sizeof *snapshot->platforms * platforms.number);
+
+  for (size_t platforms_iterator = 0; platforms_iterator < platforms.number; ++platforms_iterator) {
+    SnapshotPlatform* const platform = &snapshot->platforms[platforms_iterator];
+    const cl_platform_id platform_id = platforms.elements[platforms_iterator];
+    const VectorCLDevice devices = CL_devicesQuery(platform_id);
+
+    platform->name = CL_platformName(platform_id);
+    platform->devices_number = devices.number;
+    if ( (platform->devices = (SnapshotDevice*)Memory_allocate(sizeof *platform->devices * devices.number)) == 0 &&
+         devices.number != 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for snapshot devices",
+                     sizeof *platform->devices * devices.number);
+
+    for (size_t devices_iterator = 0; devices_iterator < devices.number; ++devices_iterator) {
+      SnapshotDevice* const device = &platform->devices[devices_iterator];
+      const cl_device_id device_id = devices.elements[devices_iterator];
+
+      device->platform = platform;
+
+      // Record everything as the driver returns it (including failures)
+      for (size_t iterator = 0; iterator < SnapshotProperty_NUMBER; ++iterator)
+        device->statuses[iterator] = Snapshot_queryProperty(device_id, iterator, &device->values[iterator]);
+    }
+
+    VectorCLDevice_free(devices);
+  }
+
+  VectorCLPlatform_free(platforms);
+
+  return snapshot;
+}
+
+// Raw value of property as the driver returns it (empty if it fails)
+static cl_int Snapshot_queryProperty(const cl_device_id device_id, const size_t property, String* const value) {
+  size_t size;
+  char* elements = 0;
+  cl_int status = Trace_clGetDeviceInfo(device_id, SnapshotProperty_ids[property], 0, 0, &size);
+
+  if (status == CL_SUCCESS) {
+    if ( (elements = (char*)Memory_allocate(size)) == 0 && size != 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for property", size);
+    status = Trace_clGetDeviceInfo(device_id, SnapshotProperty_ids[property], size, elements, 0);
+  }
+
+  if (status != CL_SUCCESS) {
+    Memory_free(elements);
+    elements = 0;
+    size = 0;
+  }
+
+  *value = String_raw(size, elements);
+  return status;
+}
+
+
+// Snapshot in file if it is there and for the given fingerprint
+static Snapshot* Snapshot_load(const String name, const String fingerprint) {
+  {
+    const char* const cname = CString_string(name);
+    struct stat file_stat;
+    const int exists = stat(cname, &file_stat) == 0;
+
+    CString_free(cname);
+    if (!exists)
+      return 0;
+  }
+
+  const String file = String_file(name);
+  Snapshot* snapshot = 0;
+
+  // Header
+  size_t offset;
+  {
+    MString mheader = MString_cstring("clcc-snapshot 1 ");
+    mheader = MString_append(mheader, fingerprint);
+    mheader = MString_push(mheader, '\n');
+    const String header = MString_freeze(mheader);
+
+    offset = header.number;
+    const int current = file.number >= header.number && memcmp(file.elements, header.elements, header.number) == 0;
+
+    String_free(header);
+
+    if (!current) {
+      String_free(file);
+      return 0;
+    }
+  }
+
+  // Contents (built up so what has been read can always be freed)
+  long long platforms_number;
+
+  if (Snapshot_readNumber(file, &offset, &platforms_number) == 0 && platforms_number >= 0) {
+    if ( (snapshot = (Snapshot*)Memory_allocate(sizeof *snapshot)) == 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for snapshot", sizeof *snapshot);
+    snapshot->name = String_raw(0, 0);
+    snapshot->platforms_number = 0;
+    if ( (snapshot->platforms = (SnapshotPlatform*)Memory_allocate(sizeof *snapshot->platforms *
+                                                                    platforms_number)) == 0 &&
+         platforms_number != 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for snapshot platforms",
+                     sizeof *snapshot->platforms * (size_t)platforms_number);
+
+    int failed = 0;
+
+    while (!failed && snapshot->platforms_number < (size_t)platforms_number) {
+      SnapshotPlatform* const platform = &snapshot->platforms[snapshot->platforms_number];
+      String platform_name;
+      long long devices_number;
+
+      if (Snapshot_read(file, &offset, &platform_name) < 0 ||
+          Snapshot_readNumber(file, &offset, &devices_number) < 0 || devices_number < 0) {
+        failed = 1;
+        break;
+      }
+
+      platform->name = String_string(platform_name);
+      platform->devices_number = 0;
+      if ( (platform->devices = (SnapshotDevice*)Memory_allocate(sizeof *platform->devices * devices_number)) == 0 &&
+           devices_number != 0 )
+        Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for snapshot devices",
+                       sizeof *platform->devices * (size_t)devices_number);
+      ++snapshot->platforms_number;
+
+      while (!failed && platform->devices_number < (size_t)devices_number) {
+        SnapshotDevice* const device = &platform->devices[platform->devices_number];
+        size_t iterator = 0;
+
+        device->platform = platform;
+
+        for ( ; iterator < SnapshotProperty_NUMBER; ++iterator) {
+          long long status;
+          String value;
+
+          if (Snapshot_readNumber(file, &offset, &status) < 0 || Snapshot_read(file, &offset, &value) < 0)
+            break;
+
+          device->statuses[iterator] = status;
+          device->values[iterator] = String_string(value);
+        }
+
+        if (iterator < SnapshotProperty_NUMBER) {
+          while (iterator > 0)
+            String_free(device->values[--iterator]);
+          failed = 1;
+        }
+        else
+          ++platform->devices_number;
+      }
+    }
+
+    if (failed || offset != file.number) {
+      Snapshot_free(snapshot);
+      snapshot = 0;
+    }
+  }
+
+  String_free(file);
+
+  return snapshot;
+}
+
+// Write snapshot to file (into place so concurrent readers never see part of one)
+static void Snapshot_store(const String name, const String fingerprint, const Snapshot* const snapshot) {
+  String file;
+  {
+    char cnumber[32];
+    MString mfile = MString_cstring("clcc-snapshot 1 ");
+    mfile = MString_append(mfile, fingerprint);
+    mfile = MString_push(mfile, '\n');
+
+    snprintf(cnumber, sizeof cnumber, "%zu", snapshot->platforms_number);
+    mfile = Snapshot_write(mfile, String_raw(strlen(cnumber), cnumber));
+
+    for (size_t platforms_iterator = 0; platforms_iterator < snapshot->platforms_number; ++platforms_iterator) {
+      const SnapshotPlatform platform = snapshot->platforms[platforms_iterator];
+
+      mfile = Snapshot_write(mfile, platform.name);
+      snprintf(cnumber, sizeof cnumber, "%zu", platform.devices_number);
+      mfile = Snapshot_write(mfile, String_raw(strlen(cnumber), cnumber));
+
+      for (size_t devices_iterator = 0; devices_iterator < platform.devices_number; ++devices_iterator) {
+        const SnapshotDevice* const device = &platform.devices[devices_iterator];
+
+        for (size_t iterator = 0; iterator < SnapshotProperty_NUMBER; ++iterator) {
+          snprintf(cnumber, sizeof cnumber, "%d", (int)device->statuses[iterator]);
+          mfile = Snapshot_write(mfile, String_raw(strlen(cnumber), cnumber));
+          mfile = Snapshot_write(mfile, device->values[iterator]);
+        }
+      }
+    }
+
+    file = MString_freeze(mfile);
+  }
+
+  String temporary;
+  {
+    char suffix[64];
+    snprintf(suffix, sizeof suffix, ".%ld", (long)getpid());
+    temporary = String_cappend(name, suffix);
+  }
+
+  String_fileWrite(temporary, file);
+
+  {
+    const char* cname = CString_string(name);
+    const char* ctemporary = CString_string(temporary);
+
+    if (rename(ctemporary, cname) < 0)
+      Error_dieErrno(errno, EX_CANTCREAT, "Unable to move snapshot into place as \"%s\"", cname);
+
+    CString_free(ctemporary);
+    CString_free(cname);
+  }
+
+  String_free(temporary);
+  String_free(file);
+}
+
+
+// Fields (reading returns a view into the file and -1 if it is too short)
+static MString Snapshot_write(MString mfile, const String field) {
+  for (size_t iterator = 0; iterator < 8; ++iterator)
+    mfile = MString_push(mfile, (char)((uint64_t)field.number >> 8*iterator));
+  return MString_append(mfile, field);
+}
+
+static int Snapshot_read(const String file, size_t* const offset, String* const field) {
+  uint64_t number = 0;
+
+  if (file.number - *offset < 8)
+    return -1;
+  for (size_t iterator = 0; iterator < 8; ++iterator)
+    number |= (uint64_t)(unsigned char)file.elements[*offset+iterator] << 8*iterator;
+  *offset += 8;
+
+  if (file.number - *offset < number)
+    return -1;
+  *field = String_raw(number, &file.elements[*offset]);
+  *offset += number;
+
+  return 0;
+}
+
+static int Snapshot_readNumber(const String file, size_t* const offset, long long* const number) {
+  String field;
+
+  if (Snapshot_read(file, offset, &field) < 0 || field.number == 0 || field.number >= 32)
+    return -1;
+
+  char cfield[32];
+  char* end;
+
+  memcpy(cfield, field.elements, field.number);
+  cfield[field.number] = 0;
+
+  errno = 0;
+  *number = strtoll(cfield, &end, 10);
+
+  return errno != 0 || *end != 0 ? -1 : 0;
+}
+
+static int Snapshot_compare(const void* const string0, const void* const string1) {
+  return String_compare(*(const String*)string0, *(const String*)string1);
+}
+
+
+// Snapshot platform or device the id stands for (zero if not one of the snapshot in use)
+static const SnapshotPlatform* Snapshot_platform(const cl_platform_id platform_id) {
+  if (!Snapshot_current)
+    return 0;
+
+  const uintptr_t address = (uintptr_t)platform_id;
+  const uintptr_t start = (uintptr_t)Snapshot_current->platforms;
+
+  if (address < start || address >= start + sizeof *Snapshot_current->platforms * Snapshot_current->platforms_number)
+    return 0;
+
+  return (const SnapshotPlatform*)platform_id;
+}
+
+static const SnapshotDevice* Snapshot_device(const cl_device_id device_id) {
+  if (!Snapshot_current)
+    return 0;
+
+  const uintptr_t address = (uintptr_t)device_id;
+
+  for (size_t iterator = 0; iterator < Snapshot_current->platforms_number; ++iterator) {
+    const SnapshotPlatform platform = Snapshot_current->platforms[iterator];
+    const uintptr_t start = (uintptr_t)platform.devices;
+
+    if (address >= start && address < start + sizeof *platform.devices * platform.devices_number)
+      return (const SnapshotDevice*)device_id;
+  }
+
+  return 0;
+}
+
+
+// Replace the snapshot's ids in the builds by the driver's (which enumerates them in the same order) checking that
+// they are the same platforms and devices (returns -1 if they are not as the fingerprint missed a driver change)
+static int Snapshot_resolve(const MVectorBuild builds) {
+  const Snapshot* const snapshot = Snapshot_current;
+  int matches = 1;
+
+  Snapshot_current = 0;
+
+  const VectorCLPlatform platforms = CL_platformsQuery();
+  VectorCLDevice devices = VectorCLDevice_raw(0, 0);
+  const SnapshotPlatform* devices_platform = 0;
+
+  if (platforms.number != snapshot->platforms_number)
+    matches = 0;
+
+  for (size_t iterator = 0; matches && iterator < builds.number; ++iterator) {
+    Build* const build = &builds.elements[iterator];
+    const SnapshotDevice* const device = (const SnapshotDevice*)build->device_id;
+    const SnapshotPlatform* const platform = device->platform;
+    const cl_platform_id platform_id = platforms.elements[platform - snapshot->platforms];
+
+    if (platform != devices_platform) {
+      VectorCLDevice_free(devices);
+      devices = CL_devicesQuery(platform_id);
+      devices_platform = platform;
+
+      const String platform_name = CL_platformName(platform_id);
+      matches = devices.number == platform->devices_number && String_compare(platform_name, platform->name) == 0;
+      String_free(platform_name);
+
+      if (!matches)
+        break;
+    }
+
+    const cl_device_id device_id = devices.elements[device - platform->devices];
+
+    // Devices in the same position are told apart by what they are (and their driver version as that is what the
+    // snapshot's other properties depend on)
+    const size_t properties[] = { SnapshotPropertyName, SnapshotPropertyDriverVersion };
+
+    for (size_t properties_iterator = 0; matches && properties_iterator < sizeof properties/sizeof *properties;
+         ++properties_iterator) {
+      const size_t property = properties[properties_iterator];
+      String value;
+      const cl_int status = Snapshot_queryProperty(device_id, property, &value);
+
+      matches = status == device->statuses[property] && String_compare(value, device->values[property]) == 0;
+      String_free(value);
+    }
+
+    build->platform_id = platform_id;
+    build->device_id = device_id;
+  }
+
+  VectorCLDevice_free(devices);
+  VectorCLPlatform_free(platforms);
+
+  Snapshot_current = snapshot;
+
+  return matches ? 0 : -1;
+}
+
+// Stop answering from the snapshot in use and remove its file so it is regenerated next time
+static void Snapshot_invalidate() {
+  const char* const cname = CString_string(Snapshot_current->name);
+
+  if (unlink(cname) < 0 && errno != ENOENT)
+    Error_dieErrno(errno, EX_CANTCREAT, "Unable to remove stale snapshot \"%s\"", cname);
+
+  CString_free(cname);
+  Snapshot_current = 0;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Statistics (reported on exit so runs that fail are covered too)
+
+// Gather statistics from here on
+static Stats* Stats_use(const StatsFormat format) {
+  Stats* stats;
+
+  if ( (stats = (Stats*)Memory_allocate(sizeof *stats)) == 0 )
+    Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for statistics", sizeof *stats);
+
+  pthread_mutex_init(&stats->mutex, 0);
+  stats->format = format;
+  stats->start = Stats_clock();
+  stats->loaded = 0;
+  stats->entries_number = 0;
+  stats->entries = 0;
+
+  Stats_current = stats;
+  if (atexit(Stats_exit) != 0)
+    Error_die(EX_OSERR, "Unable to arrange for statistics to be reported on exit");
+
+  return stats;
+}
+
+static void Stats_exit() {
+  Stats* const stats = Stats_current;
+
+  Stats_current = 0;
+  Stats_report(stats);
+  Stats_free(stats);
+}
+
+static void Stats_free(Stats* const stats) {
+  for (size_t iterator = 0; iterator < stats->entries_number; ++iterator) {
+    String_free(stats->entries[iterator].platform_name);
+    String_free(stats->entries[iterator].device_name);
+  }
+  Memory_free(stats->entries);
+  pthread_mutex_destroy(&stats->mutex);
+  Memory_free(stats);
+}
+
+
+// Monotonic clock in nanoseconds
+static long long Stats_clock() {
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (long long)time.tv_sec*1000000000 + time.tv_nsec;
+}
+
+
+// Add time since start to phase for platform and device (nothing if not gathering statistics)
+static void Stats_record(StatsPhase phase, const cl_platform_id platform_id, const cl_device_id device_id,
+                         const long long start) {
+  Stats* const stats = Stats_current;
+  if (!stats)
+    return;
+
+  const long long time = Stats_clock() - start;
+
+  // Statistics are kept until exit so they are never allocated from the current arena
+  Arena* const arena = Arena_use(0);
+  pthread_mutex_lock(&stats->mutex);
+
+  if (phase == StatsPhase_PLATFORMS && !stats->loaded) {
+    phase = StatsPhase_LOAD;
+    stats->loaded = 1;
+  }
+
+  // Find the entry (named when first created so the names are there whenever it is reported)
+  size_t index = 0;
+
+  while (index < stats->entries_number &&
+         (stats->entries[index].phase != phase || stats->entries[index].platform_id != platform_id ||
+          stats->entries[index].device_id != device_id))
+    ++index;
+
+  if (index == stats->entries_number) {
+    // Doubled when full (exactly when the number is zero or a power of two past the block size)
+    const size_t number = stats->entries_number;
+    if (number == 0 || (number >= Stats_BLOCK && (number & (number-1)) == 0)) {
+      const size_t capacity = number < Stats_BLOCK ? Stats_BLOCK : 2*number;
+      if ( (stats->entries = (StatsEntry*)Memory_reallocate(stats->entries, sizeof *stats->entries * capacity)) == 0 )
+        Error_dieErrno(errno, EX_OSERR, "Unable to expand statistics to %zd bytes",
+                       sizeof *stats->entries * capacity);
+    }
+
+    StatsEntry* const entry = &stats->entries[stats->entries_number++];
+
+    entry->phase = phase;
+    entry->platform_id = platform_id;
+    entry->device_id = device_id;
+    entry->platform_name = platform_id ? CL_platformName(platform_id) : String_raw(0, 0);
+    entry->device_name = device_id ? String_string(DeviceInfoName(device_id)) :
+      platform_id ? String_cstring("(all)") : String_raw(0, 0);
+    entry->count = 0;
+    entry->total = 0;
+    entry->max = 0;
+  }
+
+  StatsEntry* const entry = &stats->entries[index];
+
+  ++entry->count;
+  entry->total += time;
+  if (time > entry->max)
+    entry->max = time;
+
+  pthread_mutex_unlock(&stats->mutex);
+  Arena_use(arena);
+}
+
+// Devices are all for the same platform and are recorded under it as a whole if there are several
+static void Stats_recordDevices(const StatsPhase phase, const VectorCLDevice devices, const long long start) {
+  if (!Stats_current || devices.number == 0)
+    return;
+
+  Stats_record(phase, DeviceInfoPlatform(devices.elements[0]),
+               devices.number == 1 ? devices.elements[0] : 0, start);
+}
+
+
+// Print statistics to stderr
+static void Stats_report(const Stats* const stats) {
+  const double wall = (Stats_clock() - stats->start)/1e9;
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    Error_dieErrno(errno, EX_OSERR, "Unable to get resource usage");
+
+  const double user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec/1e6;
+  const double system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec/1e6;
+  const long long rss = (long long)usage.ru_maxrss*1024;
+
+  if (stats->format == StatsFormat_JSON) {
+    MString mreport = MString_cstring("{\"phases\":[");
+
+    for (size_t iterator = 0; iterator < stats->entries_number; ++iterator) {
+      const StatsEntry* const entry = &stats->entries[iterator];
+      char numbers[128];
+
+      mreport = MString_cappend(mreport, iterator == 0 ? "{\"phase\":" : ",{\"phase\":");
+      mreport = MString_appendJSON(mreport, String_raw(strlen(StatsPhase_names[entry->phase]),
+                                                      StatsPhase_names[entry->phase]));
+      mreport = MString_cappend(mreport, ",\"platform\":");
+      mreport = MString_appendJSON(mreport, entry->platform_name);
+      mreport = MString_cappend(mreport, ",\"device\":");
+      mreport = MString_appendJSON(mreport, entry->device_name);
+      snprintf(numbers, sizeof numbers, ",\"count\":%llu,\"total\":%.6f,\"max\":%.6f}",
+               entry->count, entry->total/1e9, entry->max/1e9);
+      mreport = MString_cappend(mreport, numbers);
+    }
+
+    char totals[512];
+    snprintf(totals, sizeof totals,
+             "],\"wall\":%.6f,\"user\":%.6f,\"system\":%.6f,\"peak_rss\":%lld,"
+             "\"property_calls\":{\"made\":%llu,\"saved\":%llu},"
+             "\"allocations\":{\"heap\":%llu,\"heap_bytes\":%llu,\"arena\":%llu,\"arena_bytes\":%llu,"
+             "\"arena_blocks\":%llu,\"arena_resets\":%llu}}\n",
+             wall, user, system, rss, CL_deviceInfoCalls, CL_deviceInfoSaved,
+             Memory_heapAllocations, Memory_heapBytes, Memory_arenaAllocations, Memory_arenaBytes,
+             Memory_arenaBlocks, Memory_arenaResets);
+    mreport = MString_cappend(mreport, totals);
+
+    const String report = MString_freeze(mreport);
+    fwrite(report.elements, 1, report.number, stderr);
+    String_free(report);
+    return;
+  }
+
+  // Table sized to fit the names
+  int platform_width = strlen("Platform");
+  int device_width = strlen("Device");
+
+  for (size_t iterator = 0; iterator < stats->entries_number; ++iterator) {
+    if ((int)stats->entries[iterator].platform_name.number > platform_width)
+      platform_width = stats->entries[iterator].platform_name.number;
+    if ((int)stats->entries[iterator].device_name.number > device_width)
+      device_width = stats->entries[iterator].device_name.number;
+  }
+
+  fprintf(stderr, "%-14s  %-*s  %-*s  %6s  %12s  %12s\n", "Phase", platform_width, "Platform",
+          device_width, "Device", "Count", "Total ms", "Max ms");
+  for (size_t iterator = 0; iterator < stats->entries_number; ++iterator) {
+    const StatsEntry* const entry = &stats->entries[iterator];
+
+    fprintf(stderr, "%-14s  %-*.*s  %-*.*s  %6llu  %12.3f  %12.3f\n", StatsPhase_names[entry->phase],
+            platform_width, (int)entry->platform_name.number, entry->platform_name.elements,
+            device_width, (int)entry->device_name.number, entry->device_name.elements,
+            entry->count, entry->total/1e6, entry->max/1e6);
+  }
+  fprintf(stderr, "Wall time %.3f s, CPU time %.3f s user %.3f s system, peak RSS %lld KiB\n",
+          wall, user, system, rss/1024);
+  fprintf(stderr, "Device property driver calls: %llu made, %llu saved\n", CL_deviceInfoCalls, CL_deviceInfoSaved);
+  fprintf(stderr, "Allocations: %llu heap (%llu bytes), %llu arena (%llu bytes in %llu blocks over %llu resets)\n",
+          Memory_heapAllocations, Memory_heapBytes, Memory_arenaAllocations, Memory_arenaBytes,
+          Memory_arenaBlocks, Memory_arenaResets);
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Trace (complete events with the thread, start, duration, and arguments of every OpenCL call clcc makes)
+//
+// Device names are not given for clGetDeviceInfo as they are themselves looked up with it.
+
+// Record trace from here on
+static Trace* Trace_use(const String name) {
+  Trace* trace;
+
+  if ( (trace = (Trace*)Memory_allocate(sizeof *trace)) == 0 )
+    Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for trace", sizeof *trace);
+
+  pthread_mutex_init(&trace->mutex, 0);
+  trace->name = String_string(name);
+  trace->start = Stats_clock();
+  trace->mevents = MString_cstring("[\n");
+
+  Trace_current = trace;
+  if (atexit(Trace_exit) != 0)
+    Error_die(EX_OSERR, "Unable to arrange for trace to be written on exit");
+
+  return trace;
+}
+
+static void Trace_exit() {
+  Trace* const trace = Trace_current;
+  char cevent[128];
+
+  Trace_current = 0;
+
+  snprintf(cevent, sizeof cevent,
+           "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"args\":{\"name\":\"clcc\"}}\n]\n",
+           (long)getpid());
+  trace->mevents = MString_cappend(trace->mevents, cevent);
+
+  const String events = MString_freeze(trace->mevents);
+  String_fileWrite(trace->name, events);
+  String_free(events);
+
+  trace->mevents = MString_empty();
+  Trace_free(trace);
+}
+
+static void Trace_free(Trace* const trace) {
+  Memory_free(trace->mevents.elements);
+  String_free(trace->name);
+  pthread_mutex_destroy(&trace->mutex);
+  Memory_free(trace);
+}
+
+
+// Add event for call between start and end on the calling thread (takes the arguments)
+static void Trace_event(const char* const name, const long long start, const long long end, const MString margs) {
+  Trace* const trace = Trace_current;
+  const String args = MString_freeze(margs);
+  char cevent[256];
+
+  snprintf(cevent, sizeof cevent,
+           "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+           name, (long)getpid(), (long)syscall(SYS_gettid), (start - trace->start)/1e3, (end - start)/1e3);
+
+  pthread_mutex_lock(&trace->mutex);
+  trace->mevents = MString_cappend(trace->mevents, cevent);
+  trace->mevents = MString_append(trace->mevents, args);
+  trace->mevents = MString_cappend(trace->mevents, "}},\n");
+  pthread_mutex_unlock(&trace->mutex);
+
+  String_free(args);
+}
+
+// Arguments (comma separated members of the args object)
+static MString Trace_arg(MString margs, const char* const key, const String value) {
+  if (margs.number > 0)
+    margs = MString_push(margs, ',');
+  margs = MString_appendJSON(margs, String_raw(strlen(key), key));
+  margs = MString_push(margs, ':');
+  margs = MString_appendJSON(margs, value);
+  return margs;
+}
+
+static MString Trace_argNumber(MString margs, const char* const key, const long long value) {
+  char cnumber[32];
+
+  if (margs.number > 0)
+    margs = MString_push(margs, ',');
+  margs = MString_appendJSON(margs, String_raw(strlen(key), key));
+  snprintf(cnumber, sizeof cnumber, ":%lld", value);
+  margs = MString_cappend(margs, cnumber);
+  return margs;
+}
+
+static MString Trace_argDevices(MString margs, const cl_uint number, const cl_device_id* const devices) {
+  if (margs.number > 0)
+    margs = MString_push(margs, ',');
+  margs = MString_cappend(margs, "\"devices\":[");
+  for (cl_uint iterator = 0; iterator < number; ++iterator) {
+    if (iterator > 0)
+      margs = MString_push(margs, ',');
+    margs = MString_appendJSON(margs, DeviceInfoName(devices[iterator]));
+  }
+  margs = MString_push(margs, ']');
+  return margs;
+}
+
+static MString Trace_argSizes(MString margs, const char* const key, const cl_uint number, const size_t* const sizes) {
+  char csize[32];
+
+  if (margs.number > 0)
+    margs = MString_push(margs, ',');
+  margs = MString_appendJSON(margs, String_raw(strlen(key), key));
+  if (!sizes)
+    return MString_cappend(margs, ":null");
+  margs = MString_cappend(margs, ":[");
+  for (cl_uint iterator = 0; iterator < number; ++iterator) {
+    snprintf(csize, sizeof csize, "%s%zu", iterator > 0 ? "," : "", sizes[iterator]);
+    margs = MString_cappend(margs, csize);
+  }
+  margs = MString_push(margs, ']');
+  return margs;
+}
+
+
+// OpenCL calls (straight through if not tracing)
+static cl_int Trace_clGetPlatformIDs(const cl_uint number, cl_platform_id* const platforms,
+                                     cl_uint* const number_ret) {
+  if (!Trace_current)
+    return clGetPlatformIDs(number, platforms, number_ret);
+
+  const long long start = Stats_clock();
+  const cl_int status = clGetPlatformIDs(number, platforms, number_ret);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "num_entries", number);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clGetPlatformIDs", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clGetPlatformInfo(const cl_platform_id platform, const cl_platform_info property,
+                                      const size_t size, void* const value, size_t* const size_ret) {
+  if (!Trace_current)
+    return clGetPlatformInfo(platform, property, size, value, size_ret);
+
+  const long long start = Stats_clock();
+  const cl_int status = clGetPlatformInfo(platform, property, size, value, size_ret);
+  const long long end = Stats_clock();
+
+  char cplatform[32];
+  char cproperty[32];
+  snprintf(cplatform, sizeof cplatform, "%p", (void*)platform);
+  snprintf(cproperty, sizeof cproperty, "0x%04x", (unsigned int)property);
+
+  MString margs = MString_empty();
+  margs = Trace_arg(margs, "platform", String_raw(strlen(cplatform), cplatform));
+  margs = Trace_arg(margs, "param_name", String_raw(strlen(cproperty), cproperty));
+  margs = Trace_argNumber(margs, "param_value_size", size);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clGetPlatformInfo", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clGetDeviceIDs(const cl_platform_id platform, const cl_device_type type, const cl_uint number,
+                                   cl_device_id* const devices, cl_uint* const number_ret) {
+  if (!Trace_current)
+    return clGetDeviceIDs(platform, type, number, devices, number_ret);
+
+  const long long start = Stats_clock();
+  const cl_int status = clGetDeviceIDs(platform, type, number, devices, number_ret);
+  const long long end = Stats_clock();
+
+  const String platform_name = CL_platformName(platform);
+  MString margs = MString_empty();
+  margs = Trace_arg(margs, "platform", platform_name);
+  margs = Trace_argNumber(margs, "num_entries", number);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clGetDeviceIDs", start, end, margs);
+  String_free(platform_name);
+
+  return status;
+}
+
+static cl_int Trace_clGetDeviceInfo(const cl_device_id device, const cl_device_info property, const size_t size,
+                                    void* const value, size_t* const size_ret) {
+  if (!Trace_current)
+    return clGetDeviceInfo(device, property, size, value, size_ret);
+
+  const long long start = Stats_clock();
+  const cl_int status = clGetDeviceInfo(device, property, size, value, size_ret);
+  const long long end = Stats_clock();
+
+  char cdevice[32];
+  char cproperty[32];
+  snprintf(cdevice, sizeof cdevice, "%p", (void*)device);
+  snprintf(cproperty, sizeof cproperty, "0x%04x", (unsigned int)property);
+
+  MString margs = MString_empty();
+  margs = Trace_arg(margs, "device", String_raw(strlen(cdevice), cdevice));
+  margs = Trace_arg(margs, "param_name", String_raw(strlen(cproperty), cproperty));
+  margs = Trace_argNumber(margs, "param_value_size", size);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clGetDeviceInfo", start, end, margs);
+
+  return status;
+}
+
+static cl_context Trace_clCreateContext(const cl_context_properties* const properties, const cl_uint number,
+                                        const cl_device_id* const devices,
+                                        void (CL_CALLBACK* const notify)(const char*, const void*, size_t, void*),
+                                        void* const data, cl_int* const status) {
+  if (!Trace_current)
+    return clCreateContext(properties, number, devices, notify, data, status);
+
+  const long long start = Stats_clock();
+  const cl_context context = clCreateContext(properties, number, devices, notify, data, status);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argDevices(margs, number, devices);
+  margs = Trace_argNumber(margs, "status", *status);
+  Trace_event("clCreateContext", start, end, margs);
+
+  return context;
+}
+
+static cl_int Trace_clReleaseContext(const cl_context context) {
+  if (!Trace_current)
+    return clReleaseContext(context);
+
+  const long long start = Stats_clock();
+  const cl_int status = clReleaseContext(context);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clReleaseContext", start, end, margs);
+
+  return status;
+}
+
+static cl_program Trace_clCreateProgramWithSource(const cl_context context, const cl_uint number,
+                                                  const char** const strings, const size_t* const lengths,
+                                                  cl_int* const status) {
+  if (!Trace_current)
+    return clCreateProgramWithSource(context, number, strings, lengths, status);
+
+  const long long start = Stats_clock();
+  const cl_program program = clCreateProgramWithSource(context, number, strings, lengths, status);
+  const long long end = Stats_clock();
+
+  size_t bytes = 0;
+  for (cl_uint iterator = 0; iterator < number; ++iterator)
+    bytes += lengths ? lengths[iterator] : strlen(strings[iterator]);
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "count", number);
+  margs = Trace_argNumber(margs, "bytes", bytes);
+  margs = Trace_argNumber(margs, "status", *status);
+  Trace_event("clCreateProgramWithSource", start, end, margs);
+
+  return program;
+}
+
+static cl_int Trace_clBuildProgram(const cl_program program, const cl_uint number, const cl_device_id* const devices,
+                                   const char* const options, void (CL_CALLBACK* const notify)(cl_program, void*),
+                                   void* const data) {
+  if (!Trace_current)
+    return clBuildProgram(program, number, devices, options, notify, data);
+
+  const long long start = Stats_clock();
+  const cl_int status = clBuildProgram(program, number, devices, options, notify, data);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argDevices(margs, number, devices);
+  margs = Trace_arg(margs, "options", options ? String_raw(strlen(options), options) : String_raw(0, 0));
+  margs = Trace_argNumber(margs, "asynchronous", notify != 0);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clBuildProgram", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clGetProgramBuildInfo(const cl_program program, const cl_device_id device,
+                                          const cl_program_build_info property, const size_t size, void* const value,
+                                          size_t* const size_ret) {
+  if (!Trace_current)
+    return clGetProgramBuildInfo(program, device, property, size, value, size_ret);
+
+  const long long start = Stats_clock();
+  const cl_int status = clGetProgramBuildInfo(program, device, property, size, value, size_ret);
+  const long long end = Stats_clock();
+
+  char cproperty[32];
+  snprintf(cproperty, sizeof cproperty, "0x%04x", (unsigned int)property);
+
+  MString margs = MString_empty();
+  margs = Trace_argDevices(margs, 1, &device);
+  margs = Trace_arg(margs, "param_name", String_raw(strlen(cproperty), cproperty));
+  margs = Trace_argNumber(margs, "param_value_size", size);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clGetProgramBuildInfo", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clGetProgramInfo(const cl_program program, const cl_program_info property, const size_t size,
+                                     void* const value, size_t* const size_ret) {
+  if (!Trace_current)
+    return clGetProgramInfo(program, property, size, value, size_ret);
+
+  const long long start = Stats_clock();
+  const cl_int status = clGetProgramInfo(program, property, size, value, size_ret);
+  const long long end = Stats_clock();
+
+  char cproperty[32];
+  snprintf(cproperty, sizeof cproperty, "0x%04x", (unsigned int)property);
+
+  MString margs = MString_empty();
+  margs = Trace_arg(margs, "param_name", String_raw(strlen(cproperty), cproperty));
+  margs = Trace_argNumber(margs, "param_value_size", size);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clGetProgramInfo", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clReleaseProgram(const cl_program program) {
+  if (!Trace_current)
+    return clReleaseProgram(program);
+
+  const long long start = Stats_clock();
+  const cl_int status = clReleaseProgram(program);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clReleaseProgram", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clCreateKernelsInProgram(const cl_program program, const cl_uint number, cl_kernel* const kernels,
+                                             cl_uint* const number_ret) {
+  if (!Trace_current)
+    return clCreateKernelsInProgram(program, number, kernels, number_ret);
+
+  const long long start = Stats_clock();
+  const cl_int status = clCreateKernelsInProgram(program, number, kernels, number_ret);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "num_kernels", number);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clCreateKernelsInProgram", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clGetKernelInfo(const cl_kernel kernel, const cl_kernel_info property, const size_t size,
+                                    void* const value, size_t* const size_ret) {
+  if (!Trace_current)
+    return clGetKernelInfo(kernel, property, size, value, size_ret);
+
+  const long long start = Stats_clock();
+  const cl_int status = clGetKernelInfo(kernel, property, size, value, size_ret);
+  const long long end = Stats_clock();
+
+  char cproperty[32];
+  snprintf(cproperty, sizeof cproperty, "0x%04x", (unsigned int)property);
+
+  MString margs = MString_empty();
+  margs = Trace_arg(margs, "param_name", String_raw(strlen(cproperty), cproperty));
+  margs = Trace_argNumber(margs, "param_value_size", size);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clGetKernelInfo", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clGetKernelWorkGroupInfo(const cl_kernel kernel, const cl_device_id device,
+                                             const cl_kernel_work_group_info property, const size_t size,
+                                             void* const value, size_t* const size_ret) {
+  if (!Trace_current)
+    return clGetKernelWorkGroupInfo(kernel, device, property, size, value, size_ret);
+
+  const long long start = Stats_clock();
+  const cl_int status = clGetKernelWorkGroupInfo(kernel, device, property, size, value, size_ret);
+  const long long end = Stats_clock();
+
+  char cproperty[32];
+  snprintf(cproperty, sizeof cproperty, "0x%04x", (unsigned int)property);
+
+  MString margs = MString_empty();
+  margs = Trace_argDevices(margs, 1, &device);
+  margs = Trace_arg(margs, "param_name", String_raw(strlen(cproperty), cproperty));
+  margs = Trace_argNumber(margs, "param_value_size", size);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clGetKernelWorkGroupInfo", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clReleaseKernel(const cl_kernel kernel) {
+  if (!Trace_current)
+    return clReleaseKernel(kernel);
+
+  const long long start = Stats_clock();
+  const cl_int status = clReleaseKernel(kernel);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clReleaseKernel", start, end, margs);
+
+  return status;
+}
+
+static cl_kernel Trace_clCreateKernel(const cl_program program, const char* const name, cl_int* const status) {
+  if (!Trace_current)
+    return clCreateKernel(program, name, status);
+
+  const long long start = Stats_clock();
+  const cl_kernel kernel = clCreateKernel(program, name, status);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_arg(margs, "kernel_name", String_raw(strlen(name), name));
+  margs = Trace_argNumber(margs, "status", *status);
+  Trace_event("clCreateKernel", start, end, margs);
+
+  return kernel;
+}
+
+static cl_int Trace_clSetKernelArg(const cl_kernel kernel, const cl_uint index, const size_t size,
+                                   const void* const value) {
+  if (!Trace_current)
+    return clSetKernelArg(kernel, index, size, value);
+
+  const long long start = Stats_clock();
+  const cl_int status = clSetKernelArg(kernel, index, size, value);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "arg_index", index);
+  margs = Trace_argNumber(margs, "arg_size", size);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clSetKernelArg", start, end, margs);
+
+  return status;
+}
+
+static cl_mem Trace_clCreateBuffer(const cl_context context, const cl_mem_flags flags, const size_t size,
+                                   void* const host, cl_int* const status) {
+  if (!Trace_current)
+    return clCreateBuffer(context, flags, size, host, status);
+
+  const long long start = Stats_clock();
+  const cl_mem buffer = clCreateBuffer(context, flags, size, host, status);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "flags", flags);
+  margs = Trace_argNumber(margs, "size", size);
+  margs = Trace_argNumber(margs, "status", *status);
+  Trace_event("clCreateBuffer", start, end, margs);
+
+  return buffer;
+}
+
+static cl_int Trace_clReleaseMemObject(const cl_mem buffer) {
+  if (!Trace_current)
+    return clReleaseMemObject(buffer);
+
+  const long long start = Stats_clock();
+  const cl_int status = clReleaseMemObject(buffer);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clReleaseMemObject", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clReleaseCommandQueue(const cl_command_queue queue) {
+  if (!Trace_current)
+    return clReleaseCommandQueue(queue);
+
+  const long long start = Stats_clock();
+  const cl_int status = clReleaseCommandQueue(queue);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clReleaseCommandQueue", start, end, margs);
+
+  return status;
+}
+
+static cl_command_queue Trace_clCreateCommandQueue(const cl_context context, const cl_device_id device,
+                                                   const cl_command_queue_properties properties,
+                                                   cl_int* const status) {
+  if (!Trace_current)
+    return clCreateCommandQueue(context, device, properties, status);
+
+  const long long start = Stats_clock();
+  const cl_command_queue queue = clCreateCommandQueue(context, device, properties, status);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argDevices(margs, 1, &device);
+  margs = Trace_argNumber(margs, "properties", properties);
+  margs = Trace_argNumber(margs, "status", *status);
+  Trace_event("clCreateCommandQueue", start, end, margs);
+
+  return queue;
+}
+
+static cl_int Trace_clEnqueueNDRangeKernel(const cl_command_queue queue, const cl_kernel kernel,
+                                           const cl_uint dimensions, const size_t* const global,
+                                           const size_t* const local, cl_event* const event) {
+  if (!Trace_current)
+    return clEnqueueNDRangeKernel(queue, kernel, dimensions, 0, global, local, 0, 0, event);
+
+  const long long start = Stats_clock();
+  const cl_int status = clEnqueueNDRangeKernel(queue, kernel, dimensions, 0, global, local, 0, 0, event);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "work_dim", dimensions);
+  margs = Trace_argSizes(margs, "global_work_size", dimensions, global);
+  margs = Trace_argSizes(margs, "local_work_size", dimensions, local);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clEnqueueNDRangeKernel", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clEnqueueReadBuffer(const cl_command_queue queue, const cl_mem buffer, const cl_bool blocking,
+                                        const size_t offset, const size_t size, void* const data) {
+  if (!Trace_current)
+    return clEnqueueReadBuffer(queue, buffer, blocking, offset, size, data, 0, 0, 0);
+
+  const long long start = Stats_clock();
+  const cl_int status = clEnqueueReadBuffer(queue, buffer, blocking, offset, size, data, 0, 0, 0);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "blocking_read", blocking);
+  margs = Trace_argNumber(margs, "offset", offset);
+  margs = Trace_argNumber(margs, "size", size);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clEnqueueReadBuffer", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clWaitForEvents(const cl_uint number, const cl_event* const events) {
+  if (!Trace_current)
+    return clWaitForEvents(number, events);
+
+  const long long start = Stats_clock();
+  const cl_int status = clWaitForEvents(number, events);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "num_events", number);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clWaitForEvents", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clGetEventProfilingInfo(const cl_event event, const cl_profiling_info property,
+                                            const size_t size, void* const value, size_t* const size_ret) {
+  if (!Trace_current)
+    return clGetEventProfilingInfo(event, property, size, value, size_ret);
+
+  const long long start = Stats_clock();
+  const cl_int status = clGetEventProfilingInfo(event, property, size, value, size_ret);
+  const long long end = Stats_clock();
+
+  char cproperty[32];
+  snprintf(cproperty, sizeof cproperty, "0x%04x", (unsigned int)property);
+
+  MString margs = MString_empty();
+  margs = Trace_arg(margs, "param_name", String_raw(strlen(cproperty), cproperty));
+  margs = Trace_argNumber(margs, "param_value_size", size);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clGetEventProfilingInfo", start, end, margs);
+
+  return status;
+}
+
+static cl_int Trace_clReleaseEvent(const cl_event event) {
+  if (!Trace_current)
+    return clReleaseEvent(event);
+
+  const long long start = Stats_clock();
+  const cl_int status = clReleaseEvent(event);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clReleaseEvent", start, end, margs);
+
+  return status;
+}
+
+#ifdef CL_VERSION_1_2
+static cl_program Trace_clCreateProgramWithBinary(const cl_context context, const cl_uint number,
+                                                  const cl_device_id* const devices, const size_t* const lengths,
+                                                  const unsigned char** const binaries, cl_int* const binary_status,
+                                                  cl_int* const status) {
+  if (!Trace_current)
+    return clCreateProgramWithBinary(context, number, devices, lengths, binaries, binary_status, status);
+
+  const long long start = Stats_clock();
+  const cl_program program = clCreateProgramWithBinary(context, number, devices, lengths, binaries, binary_status,
+                                                       status);
+  const long long end = Stats_clock();
+
+  size_t bytes = 0;
+  for (cl_uint iterator = 0; iterator < number; ++iterator)
+    bytes += lengths[iterator];
+
+  MString margs = MString_empty();
+  margs = Trace_argDevices(margs, number, devices);
+  margs = Trace_argNumber(margs, "bytes", bytes);
+  margs = Trace_argNumber(margs, "status", *status);
+  Trace_event("clCreateProgramWithBinary", start, end, margs);
+
+  return program;
+}
+
+static cl_int Trace_clCompileProgram(const cl_program program, const cl_uint number,
+                                     const cl_device_id* const devices, const char* const options,
+                                     const cl_uint headers_number, const cl_program* const headers,
+                                     const char** const header_names,
+                                     void (CL_CALLBACK* const notify)(cl_program, void*), void* const data) {
+  if (!Trace_current)
+    return clCompileProgram(program, number, devices, options, headers_number, headers, header_names,
+                            notify, data);
+
+  const long long start = Stats_clock();
+  const cl_int status = clCompileProgram(program, number, devices, options, headers_number, headers, header_names,
+                                         notify, data);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argDevices(margs, number, devices);
+  margs = Trace_arg(margs, "options", options ? String_raw(strlen(options), options) : String_raw(0, 0));
+  margs = Trace_argNumber(margs, "num_input_headers", headers_number);
+  margs = Trace_argNumber(margs, "status", status);
+  Trace_event("clCompileProgram", start, end, margs);
+
+  return status;
+}
+
+static cl_program Trace_clLinkProgram(const cl_context context, const cl_uint number,
+                                      const cl_device_id* const devices, const char* const options,
+                                      const cl_uint programs_number, const cl_program* const programs,
+                                      void (CL_CALLBACK* const notify)(cl_program, void*), void* const data,
+                                      cl_int* const status) {
+  if (!Trace_current)
+    return clLinkProgram(context, number, devices, options, programs_number, programs, notify, data, status);
+
+  const long long start = Stats_clock();
+  const cl_program program = clLinkProgram(context, number, devices, options, programs_number, programs,
+                                           notify, data, status);
+  const long long end = Stats_clock();
+
+  MString margs = MString_empty();
+  margs = Trace_argDevices(margs, number, devices);
+  margs = Trace_arg(margs, "options", options ? String_raw(strlen(options), options) : String_raw(0, 0));
+  margs = Trace_argNumber(margs, "num_input_programs", programs_number);
+  margs = Trace_argNumber(margs, "status", *status);
+  Trace_event("clLinkProgram", start, end, margs);
+
+  return program;
+}
+#endif // CL_VERSION_1_2
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Messages (length prefixed strings over a socket, routines return -1 if the connection fails)
+
+// Longest message read (longer ones fail the connection rather than having the peer pick how much is allocated)
+#define Message_MAXIMUM ((uint64_t)1 << 30)
+
+// Write messages
+static int Message_write(const int socket, const String message) {
+  unsigned char length[8];
+
+  for (size_t iterator = 0; iterator < sizeof length; ++iterator)
+    length[iterator] = (unsigned char)((uint64_t)message.number >> (8*iterator));
+
+  const String parts[] = { String_raw(sizeof length, (const char*)length), message };
+
+  for (size_t parts_iterator = 0; parts_iterator < sizeof parts/sizeof *parts; ++parts_iterator)
+    for (size_t fill = 0; fill < parts[parts_iterator].number; ) {
+      const ssize_t inc = send(socket, &parts[parts_iterator].elements[fill], parts[parts_iterator].number - fill,
+                               MSG_NOSIGNAL);
+      if (inc < 0 && errno == EINTR)
+        continue;
+      if (inc <= 0)
+        return -1;
+      fill += inc;
+    }
+
+  return 0;
+}
+
+static int Message_cwrite(const int socket, const char* const cmessage) {
+  return Message_write(socket, String_raw(strlen(cmessage), cmessage));
+}
+
+static int Message_writeNumber(const int socket, const long long number) {
+  char cnumber[32];
+  snprintf(cnumber, sizeof cnumber, "%lld", number);
+  return Message_cwrite(socket, cnumber);
+}
+
+static int Message_writeMaybe(const int socket, const MaybeString maybe) {
+  if (MaybeString_isNothing(maybe))
+    return Message_cwrite(socket, "0");
+  if (Message_cwrite(socket, "1") < 0)
+    return -1;
+  return Message_write(socket, MaybeString_assert(maybe));
+}
+
+static int Message_writeVector(const int socket, const VectorString vector) {
+  if (Message_writeNumber(socket, vector.number) < 0)
+    return -1;
+  for (size_t iterator = 0; iterator < vector.number; ++iterator)
+    if (Message_write(socket, vector.elements[iterator]) < 0)
+      return -1;
+  return 0;
+}
+
+
+// Read messages
+static MaybeString Message_read(const int socket) {
+  unsigned char length[8];
+  uint64_t number = 0;
+  char* elements;
+
+  {
+    size_t fill = 0;
+    while (fill < sizeof length) {
+      const ssize_t inc = recv(socket, &length[fill], sizeof length - fill, 0);
+      if (inc < 0 && errno == EINTR)
+        continue;
+      if (inc <= 0)
+        return MaybeString_nothing();
+      fill += inc;
+    }
+  }
+  for (size_t iterator = 0; iterator < sizeof length; ++iterator)
+    number |= (uint64_t)length[iterator] << (8*iterator);
+
+  if (number > Message_MAXIMUM)
+    return MaybeString_nothing();
+  if ( (elements = (char*)Memory_allocate(number)) == 0 && number != 0 )
+    return MaybeString_nothing();
+
+  {
+    size_t fill = 0;
+    while (fill < number) {
+      const ssize_t inc = recv(socket, &elements[fill], number - fill, 0);
+      if (inc < 0 && errno == EINTR)
+        continue;
+      if (inc <= 0) {
+        Memory_free(elements);
+        return MaybeString_nothing();
+      }
+      fill += inc;
+    }
+  }
+
+  return MaybeString_raw(String_raw(number, elements));
+}
+
+static int Message_readNumber(const int socket, long long* const number) {
+  const MaybeString maybe = Message_read(socket);
+  int status = -1;
+
+  if (MaybeString_isJust(maybe)) {
+    const char* cnumber = CString_string(MaybeString_assert(maybe));
+    char* end;
+
+    errno = 0;
+    *number = strtoll(cnumber, &end, 10);
+    if (errno == 0 && end != cnumber && *end == 0)
+      status = 0;
+
+    CString_free(cnumber);
+    MaybeString_free(maybe);
+  }
+
+  return status;
+}
+
+static int Message_readMaybe(const int socket, MaybeString* const maybe) {
+  long long flag;
+
+  if (Message_readNumber(socket, &flag) < 0)
+    return -1;
+  if (flag == 0) {
+    *maybe = MaybeString_nothing();
+    return 0;
+  }
+
+  return MaybeString_isJust(*maybe = Message_read(socket)) ? 0 : -1;
+}
+
+// Vectors are held to the longest message in all (counting the length of each string) so the peer can't have
+// unbounded numbers of strings read
+static int Message_readVector(const int socket, VectorString* const vector) {
+  uint64_t remaining = Message_MAXIMUM;
+  long long number;
+
+  if (Message_readNumber(socket, &number) < 0 || number < 0 || (uint64_t)number > remaining / sizeof(uint64_t))
+    return -1;
+
+  MVectorString mvector = MVectorString_empty();
+
+  for (long long iterator = 0; iterator < number; ++iterator) {
+    const MaybeString maybe = Message_read(socket);
+
+    if (MaybeString_isJust(maybe) && MaybeString_assert(maybe).number + sizeof(uint64_t) > remaining) {
+      MaybeString_free(maybe);
+      VectorString_free(MVectorString_freeze(mvector));
+      return -1;
+    }
+    if (MaybeString_isNothing(maybe)) {
+      VectorString_free(MVectorString_freeze(mvector));
+      return -1;
+    }
+    remaining -= MaybeString_assert(maybe).number + sizeof(uint64_t);
+
+    // Vector takes over the string so only the maybe box is released
+    mvector = MVectorString_pushRaw(mvector, MaybeString_assert(maybe));
+    Memory_free(maybe);
+  }
+
+  *vector = MVectorString_freeze(mvector);
+  return 0;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Server
+//
+//   request  = "clcc-serve 1" platform? device? binary? options codes
+//   response = "clcc-serve 1" number (platform device status log binary)*
+//
+
+static int Server_connect(const String name) {
+  struct sockaddr_un address = { .sun_family = AF_UNIX };
+  int client;
+
+  if (name.number >= sizeof address.sun_path)
+    Error_die(EX_USAGE, "Socket name \"%.*s\" is too long", (int)name.number, name.elements);
+  memcpy(address.sun_path, name.elements, name.number);
+
+  if ( (client = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 )
+    Error_dieErrno(errno, EX_OSERR, "Unable to create socket");
+  if (connect(client, (struct sockaddr*)&address, sizeof address) < 0)
+    Error_dieErrno(errno, EX_UNAVAILABLE, "Unable to connect to server on \"%s\"", address.sun_path);
+
+  return client;
+}
+
+
+// Options with relative include directories made absolute and the current directory searched last (the server has
+// its own current directory so headers are otherwise looked for relative to it instead of to the client's)
+static VectorString Server_options(const VectorString options) {
+  char* const cdirectory = get_current_dir_name();
+  if (!cdirectory)
+    Error_dieErrno(errno, EX_OSERR, "Unable to get current directory");
+
+  const String directory = String_raw(strlen(cdirectory), cdirectory);
+  MVectorString moptions = MVectorString_empty();
+
+  for (size_t iterator = 0; iterator < options.number; ++iterator) {
+    const String option = options.elements[iterator];
+    const int separate = String_ccompare(option, "-I") == 0 && iterator+1 < options.number;
+    const int joined = option.number > 2 && memcmp(option.elements, "-I", 2) == 0;
+
+    // Definitions are passed as they are even if they look like an include directory
+    if (String_ccompare(option, "-D") == 0 && iterator+1 < options.number) {
+      moptions = MVectorString_push(moptions, option);
+      moptions = MVectorString_push(moptions, options.elements[++iterator]);
+      continue;
+    }
+    if (!separate && !joined) {
+      moptions = MVectorString_push(moptions, option);
+      continue;
+    }
+
+    // Directory is either the next option or the rest of this one
+    const String include = separate ? options.elements[++iterator] : String_raw(option.number-2, option.elements+2);
+    MString mabsolute = MString_empty();
+
+    if (include.number == 0 || include.elements[0] != '/')
+      mabsolute = MString_push(MString_append(mabsolute, directory), '/');
+    mabsolute = MString_append(mabsolute, include);
+
+    moptions = MVectorString_cpush(moptions, "-I");
+    moptions = MVectorString_pushRaw(moptions, MString_freeze(mabsolute));
+  }
+
+  moptions = MVectorString_cpush(moptions, "-I");
+  moptions = MVectorString_push(moptions, directory);
+  free(cdirectory);
+
+  return MVectorString_freeze(moptions);
+}
+
+
+// Have the server do the builds
+static VectorBuild Server_compile(const String name, const VectorString codes, const Settings settings) {
+  const int client = Server_connect(name);
+  const VectorString options = Server_options(settings.options);
+
+  if (Message_cwrite(client, "clcc-serve 1") < 0 ||
+      Message_writeMaybe(client, settings.platform) < 0 ||
+      Message_writeMaybe(client, settings.device) < 0 ||
+      Message_writeMaybe(client, settings.binary) < 0 ||
+      Message_writeVector(client, options) < 0 ||
+      Message_writeVector(client, codes) < 0)
+    Error_dieErrno(errno, EX_IOERR, "Unable to send request to server");
+  VectorString_free(options);
+
+  MVectorBuild mbuilds = MVectorBuild_empty();
+  {
+    const MaybeString version = Message_read(client);
+    long long number;
+
+    if (MaybeString_isNothing(version) || String_ccompare(MaybeString_assert(version), "clcc-serve 1") != 0 ||
+        Message_readNumber(client, &number) < 0)
+      Error_die(EX_PROTOCOL, "Invalid response from server");
+    MaybeString_free(version);
+
+    for (long long iterator = 0; iterator < number; ++iterator) {
+      const MaybeString platform_name = Message_read(client);
+      const MaybeString device_name = Message_read(client);
+      long long status;
+      const MaybeString log = Message_readNumber(client, &status) < 0 ? MaybeString_nothing() : Message_read(client);
+      const MaybeString binary = MaybeString_isNothing(log) ? MaybeString_nothing() : Message_read(client);
+
+      if (MaybeString_isNothing(platform_name) || MaybeString_isNothing(device_name) ||
+          MaybeString_isNothing(binary))
+        Error_die(EX_PROTOCOL, "Truncated response from server");
+
+      Build build = Build_raw(0, MaybeString_assert(platform_name), 0, MaybeString_assert(device_name));
+      build.status = status;
+      build.log = MaybeString_assert(log);
+      build.binary = MaybeString_assert(binary);
+      mbuilds = MVectorBuild_push(mbuilds, build);
+
+      // Strings now belong to the build
+      Memory_free(platform_name);
+      Memory_free(device_name);
+      Memory_free(log);
+      Memory_free(binary);
+    }
+  }
+
+  while (close(client) < 0 && errno == EINTR);
+
+  return MVectorBuild_freeze(mbuilds);
+}
+
+
+// Handle a connection to the server (drops the connection on any protocol error)
+static void* Server_thread(void* const data) {
+  Connection* const connection = (Connection*)data;
+  const int client = connection->socket;
+
+  // Everything for the request is allocated from the arena and released at once when it is done
+  Arena* const arena = Arena_create();
+  Arena_use(arena);
+
+  MaybeString version = MaybeString_nothing();
+  MaybeString platform = MaybeString_nothing();
+  MaybeString device = MaybeString_nothing();
+  MaybeString binary = MaybeString_nothing();
+  VectorString options = VectorString_raw(0, 0);
+  VectorString codes = VectorString_raw(0, 0);
+
+  if (MaybeString_isJust(version = Message_read(client)) &&
+      String_ccompare(MaybeString_assert(version), "clcc-serve 1") == 0 &&
+      Message_readMaybe(client, &platform) == 0 &&
+      Message_readMaybe(client, &device) == 0 &&
+      Message_readMaybe(client, &binary) == 0 &&
+      Message_readVector(client, &options) == 0 &&
+      Message_readVector(client, &codes) == 0) {
+
+    // Requests use the server's settings apart from the options and if binaries are wanted
+    Settings settings = *connection->settings;
+    settings.options = options;
+    settings.binary = binary;
+
+    const MVectorBuild mbuilds = Build_filter(connection->targets, platform, device);
+
+    Workers_run(mbuilds, codes, &settings, 0);
+
+    if (MaybeString_isJust(settings.cache) && settings.cache_size > 0)
+      Cache_trim(MaybeString_assert(settings.cache), settings.cache_size);
+
+    const VectorBuild builds = MVectorBuild_freeze(mbuilds);
+
+    if (Message_cwrite(client, "clcc-serve 1") == 0 &&
+        Message_writeNumber(client, builds.number) == 0)
+      for (size_t iterator = 0; iterator < builds.number; ++iterator) {
+        const Build build = builds.elements[iterator];
+
+        if (Message_write(client, build.platform_name) < 0 ||
+            Message_write(client, build.device_name) < 0 ||
+            Message_writeNumber(client, build.status) < 0 ||
+            Message_write(client, build.log) < 0 ||
+            Message_write(client, build.binary) < 0)
+          break;
+      }
+
+    VectorBuild_free(builds);
+  }
+
+  MaybeString_free(version);
+  MaybeString_free(platform);
+  MaybeString_free(device);
+  MaybeString_free(binary);
+  VectorString_free(options);
+  VectorString_free(codes);
+
+  while (close(client) < 0 && errno == EINTR);
+  Memory_free(connection);
+
+  Arena_use(0);
+  Arena_free(arena);
+
+  return 0;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Batch (each manifest line is a job of sources and options as they would be given on the command line)
+//
+//   sources, -p/-d to further restrict the devices, -o for binaries, and compiler options (added to the common ones)
+
+// Split line into words on whitespace (quotes and backslashes as in the shell, # starts a comment)
+static VectorString Batch_words(const String line) {
+  MVectorString mwords = MVectorString_empty();
+
+  for (size_t iterator = 0; iterator < line.number; ) {
+    // Skip to start of word
+    if (isspace((unsigned char)line.elements[iterator])) {
+      ++iterator;
+      continue;
+    }
+    if (line.elements[iterator] == '#')
+      break;
+
+    // Accumulate word
+    MString mword = MString_empty();
+    char quote = 0;
+
+    for ( ; iterator < line.number && (quote || !isspace((unsigned char)line.elements[iterator])); ++iterator) {
+      const char element = line.elements[iterator];
+
+      if (element == quote)
+        quote = 0;
+      else if (!quote && (element == '"' || element == '\''))
+        quote = element;
+      else if (element == '\\' && quote != '\'' && iterator+1 < line.number)
+        mword = MString_push(mword, line.elements[++iterator]);
+      else
+        mword = MString_push(mword, element);
+    }
+
+    mwords = MVectorString_pushRaw(mwords, MString_freeze(mword));
+  }
+
+  return MVectorString_freeze(mwords);
+}
+
+
+// Parse job words as command line arguments (where is the program name for error messages, returns the error if
+// the job is invalid in which case there are no settings to free)
+static MaybeString Batch_settings(const VectorString words, const char* const where, Settings* const settings) {
+  MSettings msettings = MSettings_initial();
+
+  // Errors are collected rather than printed and exited on so the rest of the batch still runs
+  char* cerrors = 0;
+  size_t cerrors_number = 0;
+  FILE* const errors = open_memstream(&cerrors, &cerrors_number);
+
+  if (!errors)
+    Error_dieErrno(errno, EX_OSERR, "Unable to open stream for job option errors");
+
+  {
+    char* argv[words.number+2];
+
+    argv[0] = (char*)where;
+    for (size_t iterator = 0; iterator < words.number; ++iterator)
+      argv[iterator+1] = (char*)CString_string(words.elements[iterator]);
+    argv[words.number+1] = 0;
+
+    // Both argp and getopt write their errors to standard error
+    FILE* const standard = stderr;
+    stderr = errors;
+    argp_parse(&Settings_argp, words.number+1, argv, ARGP_LONG_ONLY | ARGP_NO_EXIT | ARGP_NO_HELP, 0, &msettings);
+    stderr = standard;
+
+    for (size_t iterator = 0; iterator < words.number; ++iterator)
+      CString_free(argv[iterator+1]);
+  }
+
+  fclose(errors);
+  *settings = MSettings_freeze(msettings);
+
+  // Only the first line is the error (the rest is argp pointing to --help)
+  MaybeString error = MaybeString_nothing();
+
+  if (cerrors_number > 0)
+    error = MaybeString_raw(String_string((String){ strcspn(cerrors, "\n"), cerrors }));
+  else if (settings->command != Command_UNSET || settings->jobs != 1 || settings->share || settings->async ||
+           MaybeString_isJust(settings->cache) || settings->cache_size != 0 ||
+           MaybeString_isJust(settings->socket) || MaybeString_isJust(settings->snapshot) || settings->calls ||
+           settings->stats != StatsFormat_NONE || MaybeString_isJust(settings->trace) ||
+           MaybeString_isJust(settings->baseline) || settings->depend || MaybeString_isJust(settings->depfile) ||
+           MaybeString_isJust(settings->target) || settings->separate || settings->kernels ||
+           MaybeString_isJust(settings->run) || settings->specialize)
+    error = MaybeString_raw(String_cappend(String_cstring(where),
+                                           ": only sources, device selection, binary prefix, and compiler options "
+                                           "are job options"));
+  else if (settings->sources.number < 1)
+    error = MaybeString_raw(String_cappend(String_cstring(where), ": job requires source file"));
+
+  free(cerrors);
+
+  if (MaybeString_isJust(error))
+    Settings_free(*settings);
+
+  return error;
+}
+
+
+// Check job sources can be read (returns the error for the first that can't, standard input is left to the build)
+static MaybeString Batch_sources(const VectorString sources) {
+  for (size_t iterator = 0; iterator < sources.number; ++iterator) {
+    const String source = sources.elements[iterator];
+
+    if (String_ccompare(source, "-") == 0)
+      continue;
+
+    const char* const csource = CString_string(source);
+    const int readable = access(csource, R_OK) == 0;
+    const int error = errno;
+
+    CString_free(csource);
+
+    if (!readable) {
+      MString merror = MString_cstring("Unable to open \"");
+      merror = MString_append(merror, source);
+      merror = MString_cappend(merror, "\" for reading: ");
+      merror = MString_cappend(merror, strerror(error));
+      return MaybeString_raw(MString_freeze(merror));
+    }
+  }
+
+  return MaybeString_nothing();
+}
+
+
+// Print job results as a JSON line and save binaries (returns number of failures)
+static size_t Batch_report(const VectorBuild builds, const Settings job, const size_t number, const size_t line) {
+  size_t failures = 0;
+  MString mreport = MString_empty();
+
+  {
+    char cnumbers[64];
+    snprintf(cnumbers, sizeof cnumbers, "{\"job\":%zu,\"line\":%zu,\"sources\":[", number, line);
+    mreport = MString_cappend(mreport, cnumbers);
+  }
+
+  for (size_t iterator = 0; iterator < job.sources.number; ++iterator) {
+    if (iterator > 0)
+      mreport = MString_push(mreport, ',');
+    mreport = MString_appendJSON(mreport, job.sources.elements[iterator]);
+  }
+
+  mreport = MString_cappend(mreport, "],\"builds\":[");
+
+  for (size_t iterator = 0; iterator < builds.number; ++iterator) {
+    const Build build = builds.elements[iterator];
+
+    if (build.status != CL_SUCCESS)
+      ++failures;
+    else if (MaybeString_isJust(job.binary))
+      Build_save(builds, iterator, MaybeString_assert(job.binary));
+
+    if (iterator > 0)
+      mreport = MString_push(mreport, ',');
+    mreport = MString_cappend(mreport, "{\"platform\":");
+    mreport = MString_appendJSON(mreport, build.platform_name);
+    mreport = MString_cappend(mreport, ",\"device\":");
+    mreport = MString_appendJSON(mreport, build.device_name);
+    mreport = MString_cappend(mreport, ",\"status\":");
+    mreport = MString_cappend(mreport, build.status != CL_SUCCESS ? "\"failure\"" :
+                              String_blank(build.log) ? "\"success\"" : "\"warnings\"");
+    mreport = MString_cappend(mreport, ",\"log\":");
+    mreport = MString_appendJSON(mreport, build.log);
+    mreport = MString_push(mreport, '}');
+  }
+
+  {
+    char cfailures[64];
+    snprintf(cfailures, sizeof cfailures, "],\"failures\":%zu}\n", failures);
+    mreport = MString_cappend(mreport, cfailures);
+  }
+
+  const String report = MString_freeze(mreport);
+  fwrite(report.elements, 1, report.number, stdout);
+  fflush(stdout);
+  String_free(report);
+
+  return failures;
+}
+
+
+// Print why a job could not be compiled as a JSON line
+static void Batch_error(const String error, const size_t number, const size_t line) {
+  MString mreport = MString_empty();
+
+  {
+    char cnumbers[64];
+    snprintf(cnumbers, sizeof cnumbers, "{\"job\":%zu,\"line\":%zu,\"error\":", number, line);
+    mreport = MString_cappend(mreport, cnumbers);
+  }
+
+  mreport = MString_appendJSON(mreport, error);
+  mreport = MString_cappend(mreport, "}\n");
+
+  const String report = MString_freeze(mreport);
+  fwrite(report.elements, 1, report.number, stdout);
+  fflush(stdout);
+  String_free(report);
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Bench (cold builds get a new context each time and warm ones reuse the device's after a first untimed build)
+//
+// Baseline is "clcc-bench 1\n" followed by a "<platform>\t<device>\t<program>\t<cold>\t<warm>\n" line of median
+// nanoseconds for each measurement. Host benchmarks of clcc's own routines are "(host)\t(host)\t<name>\t<small>\t
+// <large>\n" lines of median nanoseconds for the two numbers of elements.
+
+// Corpus of representative programs
+static const BenchProgram Bench_programs[] = {
+  { "small",   Bench_small },                       // Single short kernel
+  { "large",   Bench_large },                       // Few thousand lines of functions called from one kernel
+  { "macros",  Bench_macros },                      // Heavily templated with macros
+  { "kernels", Bench_kernels }                      // Many kernels in one program
+};
+
+static String Bench_small() {
+  return String_cstring("__kernel void saxpy(const float a, __global const float* x, __global float* y) {\n"
+                        "  const size_t i = get_global_id(0);\n"
+                        "  y[i] = a*x[i] + y[i];\n"
+                        "}\n");
+}
+
+static String Bench_large() {
+  MString mcode = MString_empty();
+  char cline[256];
+
+  for (int iterator = 0; iterator < 500; ++iterator) {
+    snprintf(cline, sizeof cline,
+             "float f%d(const float x) {\n"
+             "  float y = x*%d.0f + 1.0f;\n"
+             "  y = y*y - x;\n"
+             "  return y/(1.0f + fabs(y));\n"
+             "}\n\n", iterator, iterator);
+    mcode = MString_cappend(mcode, cline);
+  }
+
+  mcode = MString_cappend(mcode, "__kernel void large(__global const float* x, __global float* y) {\n"
+                                 "  const size_t i = get_global_id(0);\n"
+                                 "  float s = 0.0f;\n");
+  for (int iterator = 0; iterator < 500; ++iterator) {
+    snprintf(cline, sizeof cline, "  s += f%d(x[i]);\n", iterator);
+    mcode = MString_cappend(mcode, cline);
+  }
+  mcode = MString_cappend(mcode, "  y[i] = s;\n"
+                                 "}\n");
+
+  return MString_freeze(mcode);
+}
+
+static String Bench_macros() {
+  MString mcode = MString_cstring(
+    "#define BINARY(name, type, op) type name##_##type(const type a, const type b) { return a op b; }\n"
+    "#define ARITHMETIC(type) BINARY(add, type, +) BINARY(sub, type, -) BINARY(mul, type, *)\n"
+    "#define STEP(type, n) s = add_##type(mul_##type(s, x[i+n]), sub_##type(y[i], x[n]));\n"
+    "#define STEP4(type, n) STEP(type, n) STEP(type, n+1) STEP(type, n+2) STEP(type, n+3)\n"
+    "#define STEP16(type, n) STEP4(type, n) STEP4(type, n+4) STEP4(type, n+8) STEP4(type, n+12)\n"
+    "#define REDUCE(type, n) \\\n"
+    "  __kernel void reduce_##type##_##n(__global const type* x, __global type* y) { \\\n"
+    "    const size_t i = get_global_id(0)*n; \\\n"
+    "    type s = y[i]; \\\n"
+    "    STEP16(type, 0) STEP16(type, 16) \\\n"
+    "    y[i] = s; \\\n"
+    "  }\n"
+    "#define TYPE(type) ARITHMETIC(type) REDUCE(type, 32) REDUCE(type, 64) REDUCE(type, 128)\n\n");
+
+  const char* const types[] = {
+    "char", "uchar", "short", "ushort", "int", "uint", "long", "ulong", "float",
+    "char4", "uchar4", "short4", "ushort4", "int4", "uint4", "long4", "ulong4", "float4",
+    "char16", "uchar16", "short16", "ushort16", "int16", "uint16", "long16", "ulong16", "float16"
+  };
+
+  for (size_t iterator = 0; iterator < sizeof types/sizeof *types; ++iterator) {
+    mcode = MString_cappend(mcode, "TYPE(");
+    mcode = MString_cappend(mcode, types[iterator]);
+    mcode = MString_cappend(mcode, ")\n");
+  }
+
+  return MString_freeze(mcode);
+}
+
+static String Bench_kernels() {
+  MString mcode = MString_empty();
+  char ckernel[512];
+
+  for (int iterator = 0; iterator < 250; ++iterator) {
+    snprintf(ckernel, sizeof ckernel,
+             "__kernel void kernel%d(__global const float* x, __global float* y, const uint n) {\n"
+             "  const size_t i = get_global_id(0);\n"
+             "  if (i < n)\n"
+             "    y[i] = x[i]*%d.0f + x[(i+%d) %% n];\n"
+             "}\n\n", iterator, iterator, iterator+1);
+    mcode = MString_cappend(mcode, ckernel);
+  }
+
+  return MString_freeze(mcode);
+}
+
+
+// Host benchmarks (run with both numbers of elements so the time per element shows how they scale)
+static const BenchHost Bench_hosts[] = {
+  { "mstring_push",   Bench_mstringPush },          // Push characters one at a time
+  { "mstring_append", Bench_mstringAppend },        // Append short strings
+  { "mvector_push",   Bench_mvectorPush },          // Push copies of short strings
+  { "mvector_views",  Bench_mvectorViews },         // Push views (only the vector grows)
+  { "split_char",     Bench_splitCharacter },       // Split a multi-megabyte list on a single character
+  { "split_string",   Bench_splitString }           // Split a multi-megabyte list on a string
+};
+
+static const size_t Bench_hostsNumbers[] = { 100000, 1000000 };
+
+static long long Bench_mstringPush(const size_t number) {
+  const long long start = Stats_clock();
+
+  MString mstring = MString_empty();
+  for (size_t iterator = 0; iterator < number; ++iterator)
+    mstring = MString_push(mstring, 'a' + iterator % 26);
+  String_free(MString_freeze(mstring));
+
+  return Stats_clock() - start;
+}
+
+static long long Bench_mstringAppend(const size_t number) {
+  const long long start = Stats_clock();
+
+  MString mstring = MString_empty();
+  for (size_t iterator = 0; iterator < number; ++iterator)
+    mstring = MString_cappend(mstring, "-cl-opt ");
+  String_free(MString_freeze(mstring));
+
+  return Stats_clock() - start;
+}
+
+static long long Bench_mvectorPush(const size_t number) {
+  const String element = String_raw(strlen("cl_khr_fp64"), "cl_khr_fp64");
+  const long long start = Stats_clock();
+
+  MVectorString mvector = MVectorString_empty();
+  for (size_t iterator = 0; iterator < number; ++iterator)
+    mvector = MVectorString_push(mvector, element);
+  VectorString_free(MVectorString_freeze(mvector));
+
+  return Stats_clock() - start;
+}
+
+static long long Bench_mvectorViews(const size_t number) {
+  const String element = String_raw(strlen("cl_khr_fp64"), "cl_khr_fp64");
+  const long long start = Stats_clock();
+
+  MVectorString mvector = MVectorString_empty();
+  for (size_t iterator = 0; iterator < number; ++iterator)
+    mvector = MVectorString_pushRaw(mvector, element);
+  VectorString_freeViews(MVectorString_freeze(mvector));
+
+  return Stats_clock() - start;
+}
+
+static long long Bench_splitCharacter(const size_t number) {
+  return Bench_split(number, " ");
+}
+
+static long long Bench_splitString(const size_t number) {
+  return Bench_split(number, ", ");
+}
+
+// Nanoseconds to split an extension list like source of number fields (making it is not timed)
+static long long Bench_split(const size_t number, const char* const deliminator) {
+  MString msource = MString_empty();
+  char cfield[32];
+
+  for (size_t iterator = 0; iterator < number; ++iterator) {
+    snprintf(cfield, sizeof cfield, "%scl_ext_%zu", iterator > 0 ? deliminator : "", iterator);
+    msource = MString_cappend(msource, cfield);
+  }
+
+  const String source = MString_freeze(msource);
+  const long long start = Stats_clock();
+
+  const VectorString fields = String_csplit(deliminator, source);
+  VectorString_freeViews(fields);
+
+  const long long time = Stats_clock() - start;
+
+  if (fields.number != number)
+    Error_die(EX_SOFTWARE, "Split benchmark gave %zu fields instead of %zu", fields.number, number);
+  String_free(source);
+
+  return time;
+}
+
+
+// Nanoseconds to build codes (dies if it does not build as the timing would not be representative)
+static long long Bench_build(Build build, const VectorString codes, const Settings* const settings,
+                             const char* const program) {
+  Job job = Job_raw(&build, 1, 0);
+
+  const long long start = Stats_clock();
+  Job_begin(&job, codes, settings, 0);
+  Job_end(&job, settings);
+  const long long time = Stats_clock() - start;
+
+  if (build.status != CL_SUCCESS)
+    Error_die(EX_DATAERR, "Benchmark program %s failed to build (platform \"%.*s\", device \"%.*s\"):\n%.*s",
+              program, (int)build.platform_name.number, build.platform_name.elements,
+              (int)build.device_name.number, build.device_name.elements,
+              (int)build.log.number, build.log.elements);
+
+  String_free(build.log);
+  String_free(build.binary);
+
+  return time;
+}
+
+
+// Percentile of times (sorts them)
+static long long Bench_percentile(long long* const times, const size_t number, const unsigned int percent) {
+  qsort(times, number, sizeof *times, Bench_compare);
+
+  const size_t rank = (number*percent + 99)/100;
+  return times[rank > 0 ? rank-1 : 0];
+}
+
+static int Bench_compare(const void* const time0, const void* const time1) {
+  const long long value0 = *(const long long*)time0;
+  const long long value1 = *(const long long*)time1;
+  return (value0 > value1) - (value0 < value1);
+}
+
+
+// Field of the baseline line starting with key (-1 if there is none)
+static long long Bench_baseline(const VectorString lines, const String key, const size_t field) {
+  for (size_t lines_iterator = 1; lines_iterator < lines.number; ++lines_iterator) {
+    const String line = lines.elements[lines_iterator];
+
+    if (line.number < key.number || memcmp(line.elements, key.elements, key.number) != 0)
+      continue;
+
+    const VectorString fields = String_csplit("\t", String_raw(line.number-key.number, line.elements+key.number));
+    long long value = -1;
+
+    if (field < fields.number) {
+      const char* const cfield = CString_string(fields.elements[field]);
+      char* end;
+      errno = 0;
+      value = strtoll(cfield, &end, 10);
+      if (errno != 0 || *end != 0 || end == cfield || value < 0)
+        value = -1;
+      CString_free(cfield);
+    }
+
+    VectorString_freeViews(fields);
+    return value;
+  }
+
+  return -1;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Dependencies (#include directives are followed regardless of conditionals so the files are a superset)
+
+// Sources (not standard input) followed by every file they include directly or indirectly
+static VectorString Dependency_scan(const VectorString sources, const VectorString options) {
+  MVectorString mfiles = MVectorString_empty();
+
+  for (size_t sources_iterator = 0; sources_iterator < sources.number; ++sources_iterator)
+    if (String_ccompare(sources.elements[sources_iterator], "-") != 0)
+      mfiles = MVectorString_push(mfiles, sources.elements[sources_iterator]);
+
+  // Files found are appended so scanning them in turn covers the nested includes too
+  for (size_t files_iterator = 0; files_iterator < mfiles.number; ++files_iterator) {
+    const String file = mfiles.elements[files_iterator];
+    const String contents = String_map(file);
+
+    // Quoted names are looked for in the directory of the including file (sources are compiled from memory)
+    String directory = String_raw(0, "");
+    if (files_iterator >= sources.number) {
+      const char* const slash = (const char*)memrchr(file.elements, '/', file.number);
+      if (slash)
+        directory = String_raw(slash-file.elements+1, file.elements);
+    }
+
+    mfiles = Dependency_appendIncludes(mfiles, contents, directory, options);
+    String_unmap(contents);
+  }
+
+  return MVectorString_freeze(mfiles);
+}
+
+
+// Every file the codes include directly or indirectly (codes are compiled from memory so their quoted names are
+// looked for as for sources)
+static VectorString Dependency_includes(const VectorString codes, const VectorString options) {
+  MVectorString mfiles = MVectorString_empty();
+
+  for (size_t iterator = 0; iterator < codes.number; ++iterator)
+    mfiles = Dependency_appendIncludes(mfiles, codes.elements[iterator], String_raw(0, ""), options);
+
+  for (size_t files_iterator = 0; files_iterator < mfiles.number; ++files_iterator) {
+    const String file = mfiles.elements[files_iterator];
+    const String contents = String_map(file);
+    const char* const slash = (const char*)memrchr(file.elements, '/', file.number);
+    const String directory = slash ? String_raw(slash-file.elements+1, file.elements) : String_raw(0, "");
+
+    mfiles = Dependency_appendIncludes(mfiles, contents, directory, options);
+    String_unmap(contents);
+  }
+
+  return MVectorString_freeze(mfiles);
+}
+
+
+// Append the files contents includes that are not already in files (quoted names are looked for in directory first)
+static MVectorString Dependency_appendIncludes(MVectorString mfiles, const String contents, const String directory,
+                                               const VectorString options) {
+  const char* const contents_end = contents.elements + contents.number;
+  const char* line = contents.elements;
+
+  while (line < contents_end) {
+    const char* line_end = (const char*)memchr(line, '\n', contents_end-line);
+    if (!line_end)
+      line_end = contents_end;
+
+    // Match #include "name" or #include <name> allowing blanks around the #
+    const char* cursor = line;
+    while (cursor < line_end && (*cursor == ' ' || *cursor == '\t'))
+      ++cursor;
+    if (cursor < line_end && *cursor == '#') {
+      ++cursor;
+      while (cursor < line_end && (*cursor == ' ' || *cursor == '\t'))
+        ++cursor;
+      if (line_end-cursor > 7 && memcmp(cursor, "include", 7) == 0) {
+        cursor += 7;
+        while (cursor < line_end && (*cursor == ' ' || *cursor == '\t'))
+          ++cursor;
+
+        const char close = cursor == line_end ? 0 : *cursor == '"' ? '"' : *cursor == '<' ? '>' : 0;
+        const char* const name_end = close ? (const char*)memchr(cursor+1, close, line_end-cursor-1) : 0;
+        String path;
+
+        if (name_end &&
+            Dependency_find(String_raw(name_end-cursor-1, cursor+1), close == '"' ? &directory : 0,
+                            options, &path) == 0) {
+          size_t iterator = 0;
+          while (iterator < mfiles.number && String_compare(mfiles.elements[iterator], path) != 0)
+            ++iterator;
+
+          if (iterator == mfiles.number)
+            mfiles = MVectorString_pushRaw(mfiles, path);
+          else
+            String_free(path);
+        }
+      }
+    }
+
+    line = line_end+1;
+  }
+
+  return mfiles;
+}
+
+
+// Search for an included file in the directory if given and then the -I ones (returns -1 if it isn't found)
+static int Dependency_find(const String name, const String* const directory, const VectorString options,
+                           String* const path) {
+  if (directory && Dependency_file(*directory, name, path) == 0)
+    return 0;
+
+  for (size_t iterator = 0; iterator+1 < options.number; ++iterator)
+    if (String_ccompare(options.elements[iterator], "-I") == 0 &&
+        Dependency_file(options.elements[++iterator], name, path) == 0)
+      return 0;
+
+  return -1;
+}
+
+
+// Name relative to directory (unless absolute) if it is a regular file (returns -1 if not)
+static int Dependency_file(const String directory, const String name, String* const path) {
+  MString mpath = MString_empty();
+
+  if (name.number == 0 || name.elements[0] != '/') {
+    mpath = MString_append(mpath, directory);
+    if (directory.number > 0 && directory.elements[directory.number-1] != '/')
+      mpath = MString_push(mpath, '/');
+  }
+  mpath = MString_append(mpath, name);
+
+  const String candidate = MString_freeze(mpath);
+  const char* const ccandidate = CString_string(candidate);
+  struct stat status;
+  const int found = stat(ccandidate, &status) == 0 && S_ISREG(status.st_mode);
+
+  CString_free(ccandidate);
+
+  if (!found) {
+    String_free(candidate);
+    return -1;
+  }
+
+  *path = candidate;
+  return 0;
+}
+
+
+// Dependency file given or the first source with its extension replaced by .d (parser ensures it isn't stdin)
+static String Dependency_name(const Settings settings) {
+  if (MaybeString_isJust(settings.depfile))
+    return String_string(MaybeString_assert(settings.depfile));
+
+  const String source = settings.sources.elements[0];
+  size_t stem = source.number;
+  while (stem > 0 && source.elements[stem-1] != '.' && source.elements[stem-1] != '/')
+    --stem;
+  if (stem == 0 || source.elements[stem-1] != '.')
+    stem = source.number+1;
+
+  return String_cappend(String_raw(stem-1, source.elements), ".d");
+}
+
+
+// Hash of everything besides the files that decides what a compilation produces
+static String Dependency_key(const Settings settings) {
+  Hash hash = Hash_initial();
+
+  hash = Hash_cappend(hash, "clcc-depend 1");
+
+  {
+    char number[32];
+    snprintf(number, sizeof number, "%zu", settings.sources.number);
+    hash = Hash_field(hash, String_raw(strlen(number), number));
+  }
+  for (size_t iterator = 0; iterator < settings.sources.number; ++iterator)
+    hash = Hash_field(hash, settings.sources.elements[iterator]);
+
+  {
+    const String option = String_cintercalate(" ", settings.options);
+    hash = Hash_field(hash, option);
+    String_free(option);
+  }
+
+  {
+    const MaybeString selections[] = { settings.platform, settings.device, settings.binary };
+
+    for (size_t iterator = 0; iterator < sizeof selections/sizeof *selections; ++iterator) {
+      hash = Hash_cappend(hash, MaybeString_isJust(selections[iterator]) ? "+" : "-");
+      if (MaybeString_isJust(selections[iterator]))
+        hash = Hash_field(hash, MaybeString_assert(selections[iterator]));
+    }
+  }
+
+  return Hash_final(hash);
+}
+
+
+// Extend string by file name escaped for make
+static MString Dependency_appendEscaped(MString mstring, const String name) {
+  for (size_t iterator = 0; iterator < name.number; ++iterator) {
+    const char element = name.elements[iterator];
+
+    if (element == ' ' || element == '#')
+      mstring = MString_push(mstring, '\\');
+    else if (element == '$')
+      mstring = MString_push(mstring, '$');
+    mstring = MString_push(mstring, element);
+  }
+
+  return mstring;
+}
+
+
+// Write make rule of target on the files (first line is a comment recording the key it was written for)
+static void Dependency_write(const Settings settings, const VectorString files) {
+  const String name = Dependency_name(settings);
+  const String key = Dependency_key(settings);
+
+  MString mrule = MString_cstring("# clcc-depend 1 ");
+  mrule = MString_append(mrule, key);
+  mrule = MString_push(mrule, '\n');
+  mrule = Dependency_appendEscaped(mrule, MaybeString_isJust(settings.target) ?
+                                   MaybeString_assert(settings.target) : name);
+  mrule = MString_push(mrule, ':');
+  for (size_t iterator = 0; iterator < files.number; ++iterator) {
+    mrule = MString_cappend(mrule, " \\\n  ");
+    mrule = Dependency_appendEscaped(mrule, files.elements[iterator]);
+  }
+  mrule = MString_push(mrule, '\n');
+
+  const String rule = MString_freeze(mrule);
+  String_fileWrite(name, rule);
+
+  String_free(rule);
+  String_free(key);
+  String_free(name);
+}
+
+
+// Whether the dependency file was written for the same key and none of its files are missing or newer than it
+static int Dependency_unchanged(const Settings settings) {
+  const String name = Dependency_name(settings);
+  const char* const cname = CString_string(name);
+  struct stat status;
+  int unchanged = 0;
+
+  if (stat(cname, &status) == 0) {
+    const struct timespec stamp = status.st_mtim;
+    const String rule = String_file(name);
+    const String key = Dependency_key(settings);
+    const String header = String_raw(strlen("# clcc-depend 1 "), "# clcc-depend 1 ");
+
+    const char* cursor = rule.elements;
+    const char* const rule_end = rule.elements + rule.number;
+
+    // Check header records the key
+    if ( rule.number >= header.number+key.number+1 &&
+         memcmp(cursor, header.elements, header.number) == 0 &&
+         memcmp(cursor+header.number, key.elements, key.number) == 0 &&
+         cursor[header.number+key.number] == '\n' ) {
+      cursor += header.number+key.number+1;
+
+      // Skip over target
+      while (cursor < rule_end && *cursor != ':')
+        cursor += *cursor == '\\' && cursor+1 < rule_end ? 2 : 1;
+      if (cursor < rule_end)
+        ++cursor;
+
+      // Check each of the files undoing the escapes
+      unchanged = 1;
+      while (unchanged && cursor < rule_end) {
+        MString mfile = MString_empty();
+
+        while (cursor < rule_end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' ||
+                                     (*cursor == '\\' && cursor+1 < rule_end && cursor[1] == '\n')))
+          cursor += *cursor == '\\' ? 2 : 1;
+        while (cursor < rule_end && *cursor != ' ' && *cursor != '\t' && *cursor != '\n' &&
+               !(*cursor == '\\' && cursor+1 < rule_end && cursor[1] == '\n')) {
+          if ( cursor+1 < rule_end && ((*cursor == '\\' && (cursor[1] == ' ' || cursor[1] == '#')) ||
+                                       (*cursor == '$' && cursor[1] == '$')) )
+            ++cursor;
+          mfile = MString_push(mfile, *cursor);
+          ++cursor;
+        }
+
+        const String file = MString_freeze(mfile);
+
+        if (file.number > 0) {
+          const char* const cfile = CString_string(file);
+          struct stat file_status;
+
+          if ( stat(cfile, &file_status) != 0 ||
+               file_status.st_mtim.tv_sec > stamp.tv_sec ||
+               (file_status.st_mtim.tv_sec == stamp.tv_sec && file_status.st_mtim.tv_nsec >= stamp.tv_nsec) )
+            unchanged = 0;
+
+          CString_free(cfile);
+        }
+
+        String_free(file);
+      }
+    }
+
+    String_free(key);
+    String_free(rule);
+  }
+
+  CString_free(cname);
+  String_free(name);
+
+  return unchanged;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+// Watch (directories of the files are watched as editors often replace files instead of writing them)
+
+#define Watch_DEBOUNCE 100                          // Milliseconds without events that ends a burst
+
+static volatile sig_atomic_t Watch_interrupted = 0;
+
+
+// Watch the directories of the files recording the descriptor of each file's directory
+static int Watch_open(const VectorString files, int* const wds) {
+  int watch;
+
+  if ( (watch = inotify_init1(IN_CLOEXEC)) < 0 )
+    Error_dieErrno(errno, EX_OSERR, "Unable to create inotify instance");
+
+  for (size_t iterator = 0; iterator < files.number; ++iterator) {
+    const String file = files.elements[iterator];
+    const char* const slash = (const char*)memrchr(file.elements, '/', file.number);
+    const String directory = slash ? String_raw(slash == file.elements ? 1 : slash-file.elements, file.elements) :
+      String_raw(1, ".");
+    const char* const cdirectory = CString_string(directory);
+
+    // Adding an already watched directory gives its existing descriptor
+    if ( (wds[iterator] = inotify_add_watch(watch, cdirectory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE |
+                                            IN_DELETE | IN_MOVED_FROM | IN_ATTRIB | IN_ONLYDIR)) < 0 )
+      Error_dieErrno(errno, EX_NOINPUT, "Unable to watch directory \"%s\"", cdirectory);
+
+    CString_free(cdirectory);
+  }
+
+  return watch;
+}
+
+
+// Wait for one of the files to change and then for the burst of events to die down setting file to a copy of
+// the name of the first one changed (returns -1 if interrupted)
+static int Watch_wait(const int watch, const VectorString files, const int* const wds, String* const file) {
+  int changed = 0;
+  int timeout = -1;
+
+  for (;;) {
+    struct pollfd poll_watch = { watch, POLLIN, 0 };
+    int ready;
+
+    if ( (ready = poll(&poll_watch, 1, timeout)) < 0 ) {
+      if (errno != EINTR)
+        Error_dieErrno(errno, EX_OSERR, "Unable to wait for inotify events");
+      if (Watch_interrupted)
+        break;
+      continue;
+    }
+    if (ready == 0)
+      return 0;
+
+    // Read in a batch of events and see if any are for the files
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t buffer_fill;
+
+    if ( (buffer_fill = read(watch, buffer, sizeof buffer)) < 0 ) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      Error_dieErrno(errno, EX_OSERR, "Unable to read inotify events");
+    }
+
+    for (ssize_t offset = 0; offset < buffer_fill && !changed; ) {
+      const struct inotify_event* const event = (const struct inotify_event*)&buffer[offset];
+      offset += sizeof *event + event->len;
+
+      for (size_t iterator = 0; iterator < files.number && !changed; ++iterator) {
+        const String name = files.elements[iterator];
+        const char* const slash = (const char*)memrchr(name.elements, '/', name.number);
+        const String base = slash ? String_raw(name.elements+name.number-slash-1, slash+1) : name;
+
+        // Overflows lost events and ignored means the directory went away so assume the file changed
+        if ( (event->mask & (IN_Q_OVERFLOW | IN_IGNORED)) ||
+             (event->wd == wds[iterator] && event->len > 0 && String_ccompare(base, event->name) == 0) ) {
+          *file = String_string(name);
+          changed = 1;
+        }
+      }
+    }
+
+    // Once a file has changed keep reading until events stop arriving for a while
+    if (changed)
+      timeout = Watch_DEBOUNCE;
+  }
+
+  if (changed)
+    String_free(*file);
+
+  return -1;
+}
+
+
+// Note the interrupt for the wait to return
+static void Watch_interrupt(const int signal) {
+  (void)signal;
+  Watch_interrupted = 1;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------//
+static void Print_device_DeviceId(const unsigned int indent, const cl_device_id value) {
+  printf("%lu", (unsigned long)value);
+}
+
+static void Print_device_PlatformId(const unsigned int indent, const cl_platform_id value) {
+  printf("%lu", (unsigned long)value);
+}
+
+static void Print_device_DeviceType(const unsigned int indent, const cl_device_type value) {
+  VectorString values;
+  {
+    MVectorString mvalues = MVectorString_empty();
+
+    if (value & CL_DEVICE_TYPE_CPU)
+      mvalues = MVectorString_cpush(mvalues, "CPU");
+    if (value & CL_DEVICE_TYPE_GPU)
+      mvalues = MVectorString_cpush(mvalues, "GPU");
+    if (value & CL_DEVICE_TYPE_GPU)
+      mvalues = MVectorString_cpush(mvalues, "Accelerator");
+    if (value & CL_DEVICE_TYPE_GPU)
+      mvalues = MVectorString_cpush(mvalues, "Custom");
+
+    values = MVectorString_freeze(mvalues);
+  }
+
+  Print_device_VectorString(indent, values);
+  VectorString_free(values);
+}
+
+static void Print_device_FPConfig(const unsigned int indent, const cl_device_fp_config value) {
+}
+
+static void Print_device_MemCacheType(const unsigned int indent, const cl_device_mem_cache_type value) {
+}
+
+static void Print_device_MemLocalType(const unsigned int indent, const cl_device_local_mem_type value) {
+}
+
+static void Print_device_ExecCapabilities(const unsigned int indent, const cl_device_exec_capabilities value) {
+}
+
+static void Print_device_QueueProperties(const unsigned int indent, const cl_command_queue_properties value) {
+}
+
+#ifdef CL_VERSION_1_2
+static void Print_device_PartitionProperty(const unsigned int indent, const cl_device_partition_property value) {
+}
+
+static void Print_device_AffinityDomain(const unsigned int indent, const cl_device_affinity_domain value) {
+}
+#endif // CL_VERSION_1_2
+
+static void Print_device_Bool(const unsigned int indent, const cl_bool value) {
+  printf("%s", value ? "True" : "False");
+}
+
+static void Print_device_UInt(const unsigned int indent, const cl_ulong value) {
+  printf("%lu", (unsigned long)value);
+}
+
+static void Print_device_ULong(const unsigned int indent, const cl_uint value) {
+  printf("%lu", (unsigned long)value);
+}
+
+static void Print_device_Size(const unsigned int indent, const size_t value) {
+  printf("%zu", value);
+}
+
+static void Print_device_String(const unsigned int indent, const String value) {
+  printf("%.*s", (int)value.number, value.elements);
+}
+
+static void Print_device_VectorSize(const unsigned int indent, const VectorSize value) {
+  printf("[");
+  if (value.number > 0) {
+    printf(" ");
+    Print_device_Size(indent+2, value.elements[0]);
+
+    for (size_t iterator = 1; iterator < value.number; ++iterator) {
+      printf(", ");
+      Print_device_Size(indent+2, value.elements[iterator]);
+    }
+    printf(" ");
+  }
+  printf("]");
+}
+
+static void Print_device_VectorString(const unsigned int indent, const VectorString value) {
+  printf("[");
+  if (value.number > 0) {
+    printf(" ");
+    Print_device_String(indent+2, value.elements[0]);
+
+    for (size_t iterator = 1; iterator < value.number; ++iterator) {
+      printf(", ");
+      Print_device_String(indent+2, value.elements[iterator]);
+    }
+    printf(" ");
+  }
+  printf("]");
+}
+
+static void Print_device_VectorColon(const unsigned int indent, const VectorString value) {
+  Print_device_VectorString(indent, value);
+}
+
+static void Print_device_VectorSpace(const unsigned int indent, const VectorString value) {
+  Print_device_VectorString(indent, value);
+}
+
+#ifdef CL_VERSION_1_2
+static void Print_device_VectorPartitionProperty(const unsigned int indent, const VectorCLPartitionProperty value) {
+  printf("[");
+  if (value.number > 0) {
+    printf(" ");
+    Print_device_PartitionProperty(indent+2, value.elements[0]);
 
     for (size_t iterator = 1; iterator < value.number; ++iterator) {
       printf(", ");
@@ -1661,6 +8793,25 @@ int main(const int argc, char **const argv) {
     settings = MSettings_freeze(msettings);
   }
 
+  // Skip compilation if requested and nothing it depends on changed (before anything touches OpenCL)
+  if (settings.command == Command_UNSET && settings.changed && settings.sources.number > 0 &&
+      Dependency_unchanged(settings)) {
+    Settings_free(settings);
+    return 0;
+  }
+
+  // Trace OpenCL calls if requested (written on exit)
+  if (MaybeString_isJust(settings.trace))
+    Trace_use(MaybeString_assert(settings.trace));
+
+  // Gather statistics if requested (reported on exit)
+  if (settings.stats != StatsFormat_NONE)
+    Stats_use(settings.stats);
+
+  // Answer platform and device queries from snapshot if requested
+  Snapshot* const snapshot = MaybeString_isJust(settings.snapshot) ?
+    Snapshot_use(MaybeString_assert(settings.snapshot)) : 0;
+
   // Perform requested action
   switch (settings.command) {
   case Command_UNSET:
@@ -1669,81 +8820,175 @@ int main(const int argc, char **const argv) {
   case Command_LIST:
     Action_list(settings);
     break;
+  case Command_SERVE:
+    Action_serve(settings);
+    break;
+  case Command_BATCH:
+    Action_batch(settings);
+    break;
+  case Command_BENCH:
+    Action_bench(settings);
+    break;
+  case Command_WATCH:
+    Action_watch(settings);
+    break;
   default:
     Error_die(EX_SOFTWARE, "Unhandled command mode %d", settings.command);
     break;
   }
 
+  // Report device property driver calls if requested
+  if (settings.calls)
+    fprintf(stderr, "Device property driver calls: %llu made, %llu saved\n",
+            CL_deviceInfoCalls, CL_deviceInfoSaved);
+
   // Release settings
+  Object_free();
+  DeviceInfo_free();
+  Snapshot_free(snapshot);
   Settings_free(settings);
 
   return 0;
 }
 
+// Compile the given sources on the targets (selected afresh if none) reporting logs and saving binaries in device
+// order (returns number of failures)
+static size_t Action_compileStep(const Settings settings, const VectorBuild* const targets,
+                                 size_t* const builds_number) {
+  const VectorString codes = Build_codes(settings.sources);
+
+  // Build against all selected devices (here or by the server)
+  VectorBuild builds;
+  size_t failures;
+
+  if (MaybeString_isJust(settings.socket)) {
+    builds = Server_compile(MaybeString_assert(settings.socket), codes, settings);
+    failures = Build_report(builds, 0, builds.number, settings.binary);
+  }
+  else {
+    const MVectorBuild mbuilds = targets ? Build_filter(*targets, MaybeString_nothing(), MaybeString_nothing()) :
+      Build_select(settings.platform, settings.device);
+
+    if (MaybeString_isJust(settings.cache))
+      Cache_create(MaybeString_assert(settings.cache));
+
+    failures = Workers_run(mbuilds, codes, &settings, 1);
+
+    if (MaybeString_isJust(settings.cache) && settings.cache_size > 0)
+      Cache_trim(MaybeString_assert(settings.cache), settings.cache_size);
+
+    builds = MVectorBuild_freeze(mbuilds);
+  }
+  *builds_number = builds.number;
+
+  if (settings.resources != StatsFormat_NONE)
+    Kernel_report(builds, settings.resources);
+  if (settings.occupancy != StatsFormat_NONE)
+    Kernel_reportOccupancy(builds, settings.occupancy, settings.work);
+  if (settings.tune_math)
+    Run_reportMath(builds);
+  else if (MaybeString_isJust(settings.run))
+    Run_report(builds);
+  if (settings.tune)
+    Run_writeTuned(builds, &settings);
+
+  // Record the files the sources depend on if requested (only on success so failed builds are always retried)
+  if (settings.depend && failures == 0) {
+    const VectorString files = Dependency_scan(settings.sources, settings.options);
+    Dependency_write(settings, files);
+    VectorString_free(files);
+  }
+
+  VectorBuild_free(builds);
+  Build_codesFree(codes);
+
+  return failures;
+}
+
+
 // Compile the given source
 static void Action_compile(const Settings settings) {
-  // Load the source codes
   if (settings.sources.number < 1 )
     Error_die(EX_USAGE, "Compilation mode requires source file");
 
-  VectorString sources;
-  {
-    MVectorString msources = MVectorString_empty();
-    for (size_t iterator = 0; iterator < settings.sources.number; ++iterator) {
-      msources = MVectorString_cpush(msources, "#line 1 \"");
-      msources = MVectorString_push(msources, settings.sources.elements[iterator]);
-      msources = MVectorString_cpush(msources, "\"\n");
-      msources = MVectorString_push(msources, String_file(settings.sources.elements[iterator]));
-    }
-    sources = MVectorString_freeze(msources);
-  }
+  size_t builds_number;
+  const size_t failures = Action_compileStep(settings, 0, &builds_number);
 
-  // For all the platforms
-  const VectorCLPlatform platforms = CL_platformsQuery();
+  if (failures > 0)
+    Error_die(EX_DATAERR, "Compilation failure on %zu of %zu devices", failures, builds_number);
+}
 
-  for (size_t platforms_iterator = 0; platforms_iterator < platforms.number; ++platforms_iterator) {
-    const cl_platform_id platform_id = platforms.elements[platforms_iterator];
 
-    // If platform selected, filter out ones that don't match
-    const String platform_name = CL_platformName(platform_id);
-    if (MaybeString_isNothing(settings.platform) ||
-        String_compare(MaybeString_assert(settings.platform), platform_name) == 0) {
+// Compile the given sources every time one of them or a file they include changes keeping the contexts alive
+static void Action_watch(const Settings settings) {
+  if (settings.sources.number < 1 )
+    Error_die(EX_USAGE, "Watch mode requires source file");
+  for (size_t iterator = 0; iterator < settings.sources.number; ++iterator)
+    if (String_ccompare(settings.sources.elements[iterator], "-") == 0)
+      Error_die(EX_USAGE, "Watch mode can't watch standard input");
 
-      // For all the devices
-      const VectorCLDevice devices = CL_devicesQuery(platform_id);
+  // Sources and includes are edited while being watched so they are read rather than mapped (truncating a file in
+  // place would fault a build that has it mapped)
+  String_mapFiles = 0;
 
-      for (size_t devices_iterator = 0; devices_iterator < devices.number; ++devices_iterator) {
-        const cl_device_id device_id = devices.elements[devices_iterator];
+  // Targets are all the selected devices with a context each (or one per platform if sharing) unless serving
+  const VectorBuild targets = MaybeString_isJust(settings.socket) ? MVectorBuild_freeze(MVectorBuild_empty()) :
+    Build_targets(settings.platform, settings.device, settings.share);
 
-        // If device selected, filter out ones that don't match
-        const String device_name = CL_devicePropertyName(device_id);
+  // Interrupting finishes up normally (so statistics and traces are still written)
+  {
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = Watch_interrupt;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, 0);
+    sigaction(SIGTERM, &action, 0);
+  }
 
-        if (MaybeString_isNothing(settings.device) ||
-            String_compare(MaybeString_assert(settings.device), device_name) == 0) {
+  // Everything for a build is allocated from the arena and released at once when it is done
+  Arena* const arena = Arena_create();
 
-          cl_context context = CL_contextCreate(platform_id, device_id);
-          cl_program program = CL_programCreate(context, device_id, sources, settings.options);
+  for (;;) {
+    // Files are scanned again each time so changed includes are followed and watching starts before building
+    const VectorString files = Dependency_scan(settings.sources, settings.options);
+    int wds[files.number];
+    const int watch = Watch_open(files, wds);
 
-          CL_programFree(program);
-          CL_contextFree(context);
+    {
+      const long long start = Stats_clock();
+      size_t builds_number;
 
-          //          status = clBuildProgram(program, 0, 0, options, 0, 0);
-          //          status = clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, 0, &log_len);
-          //          status = clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_len, log, 0);
-        }
+      Arena_use(arena);
+      const size_t failures = Action_compileStep(settings, MaybeString_isJust(settings.socket) ? 0 : &targets,
+                                                 &builds_number);
+      Arena_use(0);
+      Arena_reset(arena);
 
-        String_free(device_name);
-      }
+      if (failures > 0)
+        fprintf(stderr, "Compilation failure on %zu of %zu devices", failures, builds_number);
+      else
+        fprintf(stderr, "Compilation success on %zu devices", builds_number);
+      fprintf(stderr, " in %.0f ms (watching %zu files)\n", (Stats_clock()-start)/1e6, files.number);
+    }
 
-      VectorCLDevice_free(devices);
+    String file = String_raw(0, 0);
+    const int status = Watch_wait(watch, files, wds, &file);
+
+    if (status == 0) {
+      fprintf(stderr, "Compiling again as \"%.*s\" changed\n", (int)file.number, file.elements);
+      String_free(file);
     }
 
-    String_free(platform_name);
+    while (close(watch) < 0 && errno == EINTR);
+    VectorString_free(files);
+
+    if (status < 0)
+      break;
   }
 
-  VectorCLPlatform_free(platforms);
+  Arena_free(arena);
 
-  VectorString_free(sources);
+  Build_targetsFree(targets);
 }
 
 
@@ -1836,3 +9081,364 @@ static void Action_list(const Settings settings) {
 
   VectorCLPlatform_free(platforms);
 }
+
+
+// Serve compilation requests on a unix socket keeping the platforms, devices, and contexts alive
+static void Action_serve(const Settings settings) {
+  const String name = MaybeString_assert(settings.socket);
+
+  // Targets are all the selected devices with a context each (or one per platform if sharing)
+  const VectorBuild targets = Build_targets(settings.platform, settings.device, settings.share);
+
+  if (MaybeString_isJust(settings.cache))
+    Cache_create(MaybeString_assert(settings.cache));
+
+  // Listen on socket (replacing any stale one)
+  int server;
+  {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+    if (name.number >= sizeof address.sun_path)
+      Error_die(EX_USAGE, "Socket name \"%.*s\" is too long", (int)name.number, name.elements);
+    memcpy(address.sun_path, name.elements, name.number);
+
+    if ( (server = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to create socket");
+    if (unlink(address.sun_path) < 0 && errno != ENOENT)
+      Error_dieErrno(errno, EX_CANTCREAT, "Unable to remove stale socket \"%s\"", address.sun_path);
+    if (bind(server, (struct sockaddr*)&address, sizeof address) < 0)
+      Error_dieErrno(errno, EX_CANTCREAT, "Unable to bind socket \"%s\"", address.sun_path);
+    if (listen(server, SOMAXCONN) < 0)
+      Error_dieErrno(errno, EX_OSERR, "Unable to listen on socket \"%s\"", address.sun_path);
+  }
+
+  // Handle each connection in its own thread
+  for (;;) {
+    int client;
+
+    if ( (client = accept(server, 0, 0)) < 0 ) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      Error_dieErrno(errno, EX_OSERR, "Unable to accept connection on socket");
+    }
+
+    Connection* connection;
+    if ( (connection = (Connection*)Memory_allocate(sizeof *connection)) == 0 )
+      Error_dieErrno(errno, EX_OSERR, "Unable to allocate %zd bytes for connection", sizeof *connection);
+    connection->socket = client;
+    connection->targets = targets;
+    connection->settings = &settings;
+
+    pthread_t thread;
+    int status;
+    if ( (status = pthread_create(&thread, 0, Server_thread, connection)) != 0 )
+      Error_dieErrno(status, EX_OSERR, "Unable to create connection thread");
+    pthread_detach(thread);
+  }
+}
+
+
+// Compile each job in a manifest against the selected devices keeping the platforms, devices, and contexts alive
+static void Action_batch(const Settings settings) {
+  const String name = MaybeString_assert(settings.manifest);
+  const String manifest = String_file(name);
+  const VectorString lines = String_csplit("\n", manifest);
+
+  const VectorBuild targets = Build_targets(settings.platform, settings.device, settings.share);
+
+  if (MaybeString_isJust(settings.cache))
+    Cache_create(MaybeString_assert(settings.cache));
+
+  size_t jobs_number = 0;
+  size_t jobs_failed = 0;
+
+  // Everything for a job is allocated from the arena and released at once when it is done
+  Arena* const arena = Arena_create();
+
+  for (size_t lines_iterator = 0; lines_iterator < lines.number; ++lines_iterator) {
+    Arena_use(arena);
+
+    const VectorString words = Batch_words(lines.elements[lines_iterator]);
+
+    if (words.number == 0) {
+      VectorString_free(words);
+      Arena_use(0);
+      Arena_reset(arena);
+      continue;
+    }
+
+    // Jobs use the batch settings apart from the sources, devices, binaries, and additional options (a job that
+    // can't be compiled is reported and counted as failed without stopping the batch)
+    Settings job;
+    MaybeString error;
+    {
+      MString mwhere = MString_string(name);
+      char cline[32];
+      snprintf(cline, sizeof cline, ":%zu", lines_iterator+1);
+      mwhere = MString_cappend(mwhere, cline);
+
+      const String where = MString_freeze(mwhere);
+      const char* const cwhere = CString_string(where);
+
+      error = Batch_settings(words, cwhere, &job);
+
+      CString_free(cwhere);
+      String_free(where);
+    }
+
+    if (MaybeString_isNothing(error)) {
+      error = Batch_sources(job.sources);
+      if (MaybeString_isJust(error))
+        Settings_free(job);
+    }
+
+    if (MaybeString_isJust(error)) {
+      Batch_error(MaybeString_assert(error), ++jobs_number, lines_iterator+1);
+      ++jobs_failed;
+
+      MaybeString_free(error);
+      VectorString_free(words);
+
+      Arena_use(0);
+      Arena_reset(arena);
+      continue;
+    }
+
+    VectorString options;
+    {
+      MVectorString moptions = MVectorString_empty();
+      for (size_t iterator = 0; iterator < settings.options.number; ++iterator)
+        moptions = MVectorString_push(moptions, settings.options.elements[iterator]);
+      for (size_t iterator = 0; iterator < job.options.number; ++iterator)
+        moptions = MVectorString_push(moptions, job.options.elements[iterator]);
+      options = MVectorString_freeze(moptions);
+    }
+
+    Settings run = settings;
+    run.sources = job.sources;
+    run.options = options;
+    run.binary = MaybeString_isJust(job.binary) ? job.binary : settings.binary;
+
+    const VectorString codes = Build_codes(run.sources);
+    const MVectorBuild mbuilds = Build_filter(targets, job.platform, job.device);
+
+    Workers_run(mbuilds, codes, &run, 0);
+
+    const VectorBuild builds = MVectorBuild_freeze(mbuilds);
+
+    if (Batch_report(builds, run, ++jobs_number, lines_iterator+1) > 0)
+      ++jobs_failed;
+
+    VectorBuild_free(builds);
+    Build_codesFree(codes);
+    VectorString_free(options);
+    Settings_free(job);
+    VectorString_free(words);
+
+    Arena_use(0);
+    Arena_reset(arena);
+  }
+
+  Arena_free(arena);
+
+  if (MaybeString_isJust(settings.cache) && settings.cache_size > 0)
+    Cache_trim(MaybeString_assert(settings.cache), settings.cache_size);
+
+  Build_targetsFree(targets);
+  VectorString_freeViews(lines);
+  String_free(manifest);
+
+  if (jobs_failed > 0)
+    Error_die(EX_DATAERR, "Compilation failure on %zu of %zu jobs", jobs_failed, jobs_number);
+}
+
+
+// Time cold and warm builds of the corpus (or the given sources) on each device and check against the baseline
+static void Action_bench(const Settings settings) {
+  // Baseline to compare against (or to write if there is none yet)
+  String baseline_file = String_raw(0, 0);
+  VectorString baseline = VectorString_raw(0, 0);
+  int baseline_exists = 0;
+
+  if (MaybeString_isJust(settings.baseline)) {
+    const String name = MaybeString_assert(settings.baseline);
+    const char* const cname = CString_string(name);
+    struct stat status;
+
+    if (stat(cname, &status) == 0) {
+      baseline_exists = 1;
+      baseline_file = String_file(name);
+      baseline = String_csplit("\n", baseline_file);
+      if (baseline.number < 1 ||
+          String_compare(baseline.elements[0], String_raw(strlen("clcc-bench 1"), "clcc-bench 1")) != 0)
+        Error_die(EX_DATAERR, "Baseline \"%s\" is not a clcc benchmark baseline", cname);
+    }
+    else if (errno != ENOENT)
+      Error_dieErrno(errno, EX_NOINPUT, "Unable to check for baseline \"%s\"", cname);
+
+    CString_free(cname);
+  }
+
+  // Programs are the corpus or the sources if given
+  const size_t programs_number = settings.sources.number > 0 ? 1 : sizeof Bench_programs/sizeof *Bench_programs;
+
+  // Builds are done one after the other without caching or saving binaries
+  Settings run = settings;
+  run.cache = MaybeString_nothing();
+  run.binary = MaybeString_nothing();
+
+  const VectorBuild targets = Build_targets(settings.platform, settings.device, 0);
+
+  MString mbaseline = MString_cstring("clcc-bench 1\n");
+  size_t measurements = 0;
+  size_t regressions = 0;
+  long long* const cold = (long long*)Memory_allocate(settings.bench > SIZE_MAX/sizeof(long long) ? SIZE_MAX :
+                                                      sizeof(long long) * settings.bench);
+  long long* const warm = (long long*)Memory_allocate(settings.bench > SIZE_MAX/sizeof(long long) ? SIZE_MAX :
+                                                      sizeof(long long) * settings.bench);
+
+  if (!cold || !warm)
+    Error_dieErrno(errno, EX_OSERR, "Unable to allocate times for %zu benchmark builds", settings.bench);
+
+  printf("%-24s  %-24s  %-8s  %5s  %15s  %12s  %15s  %12s\n", "Platform", "Device", "Program", "Runs",
+         "Cold median ms", "Cold p95 ms", "Warm median ms", "Warm p95 ms");
+
+  for (size_t targets_iterator = 0; targets_iterator < targets.number; ++targets_iterator) {
+    const Build target = targets.elements[targets_iterator];
+
+    for (size_t programs_iterator = 0; programs_iterator < programs_number; ++programs_iterator) {
+      const char* const program = settings.sources.number > 0 ? "sources" : Bench_programs[programs_iterator].name;
+      VectorString codes;
+
+      if (settings.sources.number > 0)
+        codes = Build_codes(settings.sources);
+      else {
+        MVectorString mcodes = MVectorString_empty();
+        mcodes = MVectorString_pushRaw(mcodes, Bench_programs[programs_iterator].generate());
+        codes = MVectorString_freeze(mcodes);
+      }
+
+      // Cold builds in a new context and warm ones in the device's long lived one (after warming it up)
+      Build build = target;
+
+      build.context = 0;
+      for (size_t iterator = 0; iterator < settings.bench; ++iterator)
+        cold[iterator] = Bench_build(build, codes, &run, program);
+
+      build.context = target.context;
+      Bench_build(build, codes, &run, program);
+      for (size_t iterator = 0; iterator < settings.bench; ++iterator)
+        warm[iterator] = Bench_build(build, codes, &run, program);
+
+      const long long cold_median = Bench_percentile(cold, settings.bench, 50);
+      const long long warm_median = Bench_percentile(warm, settings.bench, 50);
+
+      printf("%-24.*s  %-24.*s  %-8s  %5zu  %15.3f  %12.3f  %15.3f  %12.3f\n",
+             (int)target.platform_name.number, target.platform_name.elements,
+             (int)target.device_name.number, target.device_name.elements, program, settings.bench,
+             cold_median/1e6, Bench_percentile(cold, settings.bench, 95)/1e6,
+             warm_median/1e6, Bench_percentile(warm, settings.bench, 95)/1e6);
+      fflush(stdout);
+
+      // Compare medians against the baseline and record them for a new one
+      MString mkey = MString_string(target.platform_name);
+      mkey = MString_push(mkey, '\t');
+      mkey = MString_append(mkey, target.device_name);
+      mkey = MString_push(mkey, '\t');
+      mkey = MString_cappend(mkey, program);
+      mkey = MString_push(mkey, '\t');
+      const String key = MString_freeze(mkey);
+
+      const long long medians[] = { cold_median, warm_median };
+      const char* const kinds[] = { "cold", "warm" };
+
+      for (size_t iterator = 0; iterator < sizeof medians/sizeof *medians; ++iterator) {
+        const long long base = Bench_baseline(baseline, key, iterator);
+
+        ++measurements;
+        if (base >= 0 && medians[iterator] > base*(1 + settings.threshold/100)) {
+          ++regressions;
+          fprintf(stderr, "Regression (platform \"%.*s\", device \"%.*s\", program %s): "
+                  "%s median %.3f ms against baseline %.3f ms\n",
+                  (int)target.platform_name.number, target.platform_name.elements,
+                  (int)target.device_name.number, target.device_name.elements, program, kinds[iterator],
+                  medians[iterator]/1e6, base/1e6);
+        }
+      }
+
+      char cmedians[64];
+      snprintf(cmedians, sizeof cmedians, "%lld\t%lld\n", cold_median, warm_median);
+      mbaseline = MString_append(mbaseline, key);
+      mbaseline = MString_cappend(mbaseline, cmedians);
+
+      String_free(key);
+      if (settings.sources.number > 0)
+        Build_codesFree(codes);
+      else
+        VectorString_free(codes);
+    }
+  }
+
+  // Host benchmarks go with the corpus (they time clcc rather than the sources)
+  if (settings.sources.number == 0) {
+    printf("\n%-24s  %10s  %5s  %12s  %12s  %12s\n", "Host benchmark", "Elements", "Runs", "Median ms", "p95 ms",
+           "Median ns/el");
+
+    for (size_t hosts_iterator = 0; hosts_iterator < sizeof Bench_hosts/sizeof *Bench_hosts; ++hosts_iterator) {
+      const BenchHost host = Bench_hosts[hosts_iterator];
+      const size_t numbers_number = sizeof Bench_hostsNumbers/sizeof *Bench_hostsNumbers;
+      long long medians[numbers_number];
+
+      for (size_t numbers_iterator = 0; numbers_iterator < numbers_number; ++numbers_iterator) {
+        const size_t number = Bench_hostsNumbers[numbers_iterator];
+
+        for (size_t iterator = 0; iterator < settings.bench; ++iterator)
+          cold[iterator] = host.run(number);
+
+        medians[numbers_iterator] = Bench_percentile(cold, settings.bench, 50);
+        printf("%-24s  %10zu  %5zu  %12.3f  %12.3f  %12.3f\n", host.name, number, settings.bench,
+               medians[numbers_iterator]/1e6, Bench_percentile(cold, settings.bench, 95)/1e6,
+               (double)medians[numbers_iterator]/number);
+        fflush(stdout);
+      }
+
+      MString mkey = MString_cstring("(host)\t(host)\t");
+      mkey = MString_cappend(mkey, host.name);
+      mkey = MString_push(mkey, '\t');
+      const String key = MString_freeze(mkey);
+
+      for (size_t iterator = 0; iterator < numbers_number; ++iterator) {
+        const long long base = Bench_baseline(baseline, key, iterator);
+
+        ++measurements;
+        if (base >= 0 && medians[iterator] > base*(1 + settings.threshold/100)) {
+          ++regressions;
+          fprintf(stderr, "Regression (host benchmark %s): %zu element median %.3f ms against baseline %.3f ms\n",
+                  host.name, Bench_hostsNumbers[iterator], medians[iterator]/1e6, base/1e6);
+        }
+      }
+
+      char cmedians[64];
+      snprintf(cmedians, sizeof cmedians, "%lld\t%lld\n", medians[0], medians[1]);
+      mbaseline = MString_append(mbaseline, key);
+      mbaseline = MString_cappend(mbaseline, cmedians);
+
+      String_free(key);
+    }
+  }
+
+  const String new_baseline = MString_freeze(mbaseline);
+  if (MaybeString_isJust(settings.baseline) && !baseline_exists)
+    String_fileWrite(MaybeString_assert(settings.baseline), new_baseline);
+
+  String_free(new_baseline);
+  Memory_free(warm);
+  Memory_free(cold);
+  Build_targetsFree(targets);
+  VectorString_freeViews(baseline);
+  String_free(baseline_file);
+
+  if (regressions > 0)
+    Error_die(EX_DATAERR, "Benchmark regression beyond %g%% on %zu of %zu measurements",
+              settings.threshold, regressions, measurements);
+}